@@ -114,6 +114,195 @@ public:
      */
     static const QString PluginBlacklistSettingName;
 
+    /**
+     * @brief Category name for transfer settings
+     */
+    static const QString TransferCategoryName;
+
+    /**
+     * @brief Setting name for the transfer send window high watermark
+     *
+     * Transfers stop queueing packets once this many bytes are waiting to be
+     * written to the transport.
+     */
+    static const QString TransferHighWatermarkSettingName;
+
+    /**
+     * @brief Setting name for the transfer send window low watermark
+     *
+     * Once the number of bytes waiting to be written drops to this value,
+     * the transfer refills the window up to the high watermark.
+     */
+    static const QString TransferLowWatermarkSettingName;
+
+    /**
+     * @brief Setting name for the number of connections used per transfer
+     *
+     * Additional connections are only opened if the receiver acknowledges
+     * them; older peers always receive the transfer over a single connection.
+     */
+    static const QString TransferStreamsSettingName;
+
+    /**
+     * @brief Setting name for the minimum size of items split across streams
+     *
+     * Items at least this large are sent in chunks over all of the streams
+     * instead of over a single one.
+     */
+    static const QString TransferStripeThresholdSettingName;
+
+    /**
+     * @brief Setting name for the minimum size of transfers that can resume
+     *
+     * Receivers keep a journal of interrupted transfers at least this large
+     * so that retrying them only sends the missing data. Zero disables it.
+     */
+    static const QString TransferResumeThresholdSettingName;
+
+    /**
+     * @brief Setting name for the minimum size of items sent as a delta
+     *
+     * For items at least this large, the receiver sends checksums of its
+     * existing copy and only the changed blocks are sent. Zero disables it.
+     */
+    static const QString TransferDeltaThresholdSettingName;
+
+    /**
+     * @brief Setting name for compressing item content during transfer
+     *
+     * Compression is only used if the receiver supports it and is skipped for
+     * data that does not compress well.
+     */
+    static const QString TransferCompressionSettingName;
+
+    /**
+     * @brief Setting name for the maximum size of items sent in batches
+     *
+     * Items no larger than this are packed together with their headers so
+     * that many small files do not each cost a round of packets. Zero
+     * disables it.
+     */
+    static const QString TransferBatchThresholdSettingName;
+
+    /**
+     * @brief Setting name for the number of threads used to run transfers
+     *
+     * Transfers are spread across this many threads so that reading,
+     * writing, and processing packets does not block the UI. Zero runs
+     * transfers on the main thread.
+     */
+    static const QString TransferWorkerThreadsSettingName;
+
+    /**
+     * @brief Setting name for the digest used to verify item content
+     *
+     * Either "xxh64" (fast) or "sha256" (cryptographic) - the digest is
+     * computed as items are sent and received and any mismatch fails the
+     * transfer. Any other value disables verification.
+     */
+    static const QString TransferDigestSettingName;
+
+    /**
+     * @brief Setting name for the limit on the rate of outgoing transfers
+     *
+     * The limit is in KiB/s and is shared by all transfers sending items.
+     * Zero removes the limit.
+     */
+    static const QString TransferUploadLimitSettingName;
+
+    /**
+     * @brief Setting name for the limit on the rate of incoming transfers
+     *
+     * The limit is in KiB/s and is shared by all transfers receiving items.
+     * Zero removes the limit.
+     */
+    static const QString TransferDownloadLimitSettingName;
+
+    /**
+     * @brief Setting name for the limit on the rate of transfers per device
+     *
+     * The limit is in KiB/s and applies to the transfers to and from each
+     * device separately. Zero removes the limit.
+     */
+    static const QString TransferDeviceLimitSettingName;
+
+    /**
+     * @brief Setting name for the times of day when limits are applied
+     *
+     * Windows are written as "HH:mm-HH:mm" and separated by commas (for
+     * example, "09:00-17:00"). If empty, the limits always apply.
+     */
+    static const QString TransferLimitScheduleSettingName;
+
+    /**
+     * @brief Setting name for the maximum number of active outgoing transfers
+     *
+     * Additional transfers are queued until one of the active transfers
+     * finishes. Zero removes the limit.
+     */
+    static const QString TransferMaxActiveSettingName;
+
+    /**
+     * @brief Setting name for the maximum number of active transfers per device
+     *
+     * This limits the outgoing transfers to each device separately. Zero
+     * removes the limit.
+     */
+    static const QString TransferMaxActivePerDeviceSettingName;
+
+    /**
+     * @brief Setting name for the size of the write-behind buffer
+     *
+     * Received data is written to disk on a separate thread and up to this
+     * many bytes may be waiting to be written before reading from the peer
+     * pauses. Zero writes data as soon as it is received.
+     */
+    static const QString TransferWriteBufferSettingName;
+
+    /**
+     * @brief Setting name for the size of the read-ahead buffer
+     *
+     * Items about to be sent are opened and read on a separate thread and up
+     * to this many bytes are read before they are needed. Zero reads data
+     * only when it is about to be sent.
+     */
+    static const QString TransferReadAheadSettingName;
+
+    /**
+     * @brief Setting name for transferring file data without copying it
+     *
+     * Transports that support it send the content of files directly from
+     * disk and write received content directly to disk. This is only
+     * possible when the content is neither compressed nor checked with a
+     * digest.
+     */
+    static const QString TransferZeroCopySettingName;
+
+    /**
+     * @brief Setting name for the memory available for received packets
+     *
+     * Packets received on all connections share this many bytes; reading
+     * from the network stops once they are used and resumes as packets are
+     * processed. Zero removes the limit.
+     */
+    static const QString TransferReceiveBudgetSettingName;
+
+    /**
+     * @brief Setting name for the read buffer of each connection
+     *
+     * Each connection reads at most this many bytes from the network ahead
+     * of the packets being processed. Zero removes the limit.
+     */
+    static const QString TransferReadBufferSettingName;
+
+    /**
+     * @brief Setting name for the largest packet that may be received
+     *
+     * The limit is sent to the peer when a transfer starts and larger
+     * packets are rejected. Values below 4 MiB are raised to 4 MiB.
+     */
+    static const QString TransferMaxPacketSizeSettingName;
+
     /**
      * @brief Create a new application object
      * @param settings pointer to QSettings
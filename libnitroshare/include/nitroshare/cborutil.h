@@ -0,0 +1,77 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_CBORUTIL_H
+#define LIBNITROSHARE_CBORUTIL_H
+
+#include <QByteArray>
+#include <QObject>
+#include <QVariant>
+
+#include <nitroshare/config.h>
+
+/**
+ * @brief CBOR (RFC 7049) utility methods
+ *
+ * CBOR is a compact binary alternative to JSON. Only the subset needed for
+ * metadata is supported: integers, floating-point numbers, booleans, null,
+ * byte and text strings, arrays, and maps with text keys. Strings, arrays,
+ * and maps must have a definite length.
+ */
+class NITROSHARE_EXPORT CborUtil
+{
+public:
+
+    /**
+     * @brief Create a CBOR map from the properties in an object
+     * @param object pointer to QObject
+     * @return encoded map
+     *
+     * Unlike JsonUtil::objectToJson(), 64-bit integers are encoded as
+     * integers since CBOR can represent them without data loss.
+     */
+    static QByteArray objectToCbor(QObject *object);
+
+    /**
+     * @brief Encode a value as CBOR
+     * @param value value to encode
+     * @return encoded data
+     *
+     * Values of types that CBOR cannot represent are encoded as text strings.
+     */
+    static QByteArray encode(const QVariant &value);
+
+    /**
+     * @brief Decode a CBOR value
+     * @param data encoded data
+     * @param ok set to false if the data is invalid or unsupported
+     * @return decoded value
+     *
+     * Integers are decoded as qint64 (or quint64 if they do not fit), text
+     * strings as QString, arrays as QVariantList, and maps as QVariantMap.
+     */
+    static QVariant decode(const QByteArray &data, bool *ok = nullptr);
+};
+
+#endif // LIBNITROSHARE_CBORUTIL_H
@@ -0,0 +1,96 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_DELTAUTIL_H
+#define LIBNITROSHARE_DELTAUTIL_H
+
+#include <QByteArray>
+
+#include <nitroshare/config.h>
+
+class Item;
+
+/**
+ * @brief Utility methods for transferring only the changed parts of items
+ *
+ * The receiver splits its existing copy of an item into blocks and sends a
+ * signature containing a weak (rolling) and strong checksum for each block.
+ * The sender slides a window over the item, using the rolling checksum to
+ * cheaply find blocks that the receiver already has.
+ */
+class NITROSHARE_EXPORT DeltaUtil
+{
+public:
+
+    /**
+     * @brief Size in bytes of each entry in a signature
+     */
+    static const int SignatureEntrySize;
+
+    /**
+     * @brief Calculate the weak checksum of a block
+     * @param data pointer to the block
+     * @param length size of the block in bytes
+     * @return checksum
+     */
+    static quint32 checksum(const char *data, int length);
+
+    /**
+     * @brief Update a weak checksum as the window slides forward one byte
+     * @param checksum checksum of the previous window
+     * @param removed byte leaving the window
+     * @param added byte entering the window
+     * @param length size of the window in bytes
+     * @return checksum of the new window
+     */
+    static quint32 roll(quint32 checksum, uchar removed, uchar added, int length);
+
+    /**
+     * @brief Calculate the strong checksum of a block
+     * @param data pointer to the block
+     * @param length size of the block in bytes
+     * @return checksum (8 bytes)
+     */
+    static QByteArray strongChecksum(const char *data, int length);
+
+    /**
+     * @brief Determine the block size to use for an item
+     * @param size size of the item in bytes
+     * @return block size in bytes
+     */
+    static int blockSize(qint64 size);
+
+    /**
+     * @brief Create a signature of the existing content of an item
+     * @param item pointer to Item (which must be open)
+     * @param blockSize size of each block in bytes
+     * @return signature
+     *
+     * The item is read from the beginning and left positioned at the start.
+     * If the item does not support seeking, the signature contains no blocks.
+     */
+    static QByteArray signature(Item *item, int blockSize);
+};
+
+#endif // LIBNITROSHARE_DELTAUTIL_H
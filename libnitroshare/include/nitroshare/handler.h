@@ -57,8 +57,21 @@ public:
      * @param type identifier
      * @param properties map of properties
      * @return newly created item
+     *
+     * This method may be invoked from a transfer worker thread and must not
+     * modify the handler or touch objects that belong to the UI.
      */
     virtual Item *createItem(const QString &type, const QVariantMap &properties) = 0;
+
+    /**
+     * @brief Retrieve the amount of space available for received items
+     * @return number of bytes or -1 if unknown
+     *
+     * Transfers check this before receiving any items and are rejected right
+     * away if they will not fit. The default implementation returns -1. Like
+     * createItem(), this may be invoked from a transfer worker thread.
+     */
+    virtual qint64 bytesAvailable() const;
 };
 
 #endif // LIBNITROSHARE_HANDLER_H
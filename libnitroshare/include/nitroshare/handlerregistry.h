@@ -55,6 +55,8 @@ public:
      * @brief Find a handler by its name
      * @param name unique identifier for the handler
      * @return pointer to Handler or nullptr
+     *
+     * This method may be invoked from a transfer worker thread.
      */
     Handler *find(const QString &name);
 
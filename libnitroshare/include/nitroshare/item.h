@@ -99,6 +99,39 @@ public:
      */
     virtual void write(const QByteArray &data);
 
+    /**
+     * @brief Move to the specified position in the item
+     * @param offset position in bytes from the beginning of the item
+     * @return true if the position was changed
+     *
+     * Items that support random access can be split into chunks that are
+     * transferred in parallel. The default implementation returns false.
+     */
+    virtual bool seek(qint64 offset);
+
+    /**
+     * @brief Retrieve the native file descriptor for the open item
+     * @return descriptor or -1 if the item is not backed by a file
+     *
+     * Transports that support it can send the content of items backed by a
+     * file directly from the descriptor without copying it. The descriptor
+     * must remain valid until the item is closed and reading from it must
+     * not depend on the current position. The default implementation
+     * returns -1.
+     */
+    virtual int handle() const;
+
+    /**
+     * @brief Retrieve the amount of content already in the item
+     * @return number of bytes or -1 if unknown
+     *
+     * Items opened for writing that keep their existing content report how
+     * much of it there is so that the receiver can confirm a partially
+     * received item is still present before continuing it. The default
+     * implementation returns -1.
+     */
+    virtual qint64 existingSize() const;
+
     /**
      * @brief Close the item
      *
@@ -25,25 +25,23 @@
 #ifndef LIBNITROSHARE_PACKET_H
 #define LIBNITROSHARE_PACKET_H
 
-#include <QObject>
+#include <QByteArray>
+#include <QMetaType>
 
 #include <nitroshare/config.h>
 
-class NITROSHARE_EXPORT PacketPrivate;
-
 /**
  * @brief A fragment of metadata or item content for transfer
  *
  * Each packet includes its type and payload. Packets that convey information
  * about state often have empty payloads.
+ *
+ * Packets are values - they are cheap to copy since the payload is
+ * implicitly shared and creating one does not allocate anything beyond the
+ * payload itself.
  */
-class NITROSHARE_EXPORT Packet : public QObject
+class NITROSHARE_EXPORT Packet
 {
-    Q_OBJECT
-    Q_ENUMS(Type)
-    Q_PROPERTY(Type type READ type)
-    Q_PROPERTY(QByteArray content READ content)
-
 public:
 
     /**
@@ -57,16 +55,29 @@ public:
         /// JSON metadata
         Json,
         /// Binary data (item content)
-        Binary
+        Binary,
+        /// Item content prefixed with its offset (64-bit little-endian)
+        Chunk,
+        /// Checksums of the blocks in the receiver's copy of an item
+        Signature,
+        /// Literal runs and block references describing item content
+        Delta,
+        /// Compressed item content prefixed with the method used (8-bit)
+        Compressed,
+        /// Headers and content of several small items
+        Batch,
+        /// CBOR metadata
+        Cbor,
+        /// Digest of the content of the preceding item
+        Digest
     };
 
     /**
      * @brief Create a new packet
      * @param type one of Type
      * @param content payload
-     * @param parent QObject
      */
-    Packet(Type type, const QByteArray &content = QByteArray(), QObject *parent = nullptr);
+    explicit Packet(Type type = Success, const QByteArray &content = QByteArray());
 
     /**
      * @brief Retrieve the packet type
@@ -78,11 +89,15 @@ public:
      * @brief Retrieve the content of the packet
      * @return payload
      */
-    QByteArray content() const;
+    const QByteArray &content() const;
 
 private:
 
-    PacketPrivate *const d;
+    Type mType;
+    QByteArray mContent;
 };
 
+Q_DECLARE_TYPEINFO(Packet, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(Packet)
+
 #endif // LIBNITROSHARE_PACKET_H
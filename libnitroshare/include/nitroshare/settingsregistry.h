@@ -43,6 +43,9 @@ class NITROSHARE_EXPORT SettingsRegistryPrivate;
  *
  * By using a central registry for settings, it becomes possible for plugins to
  * provide an interface for manipulating settings.
+ *
+ * Values may be read and written from any thread, although signals are
+ * emitted on the thread that made the change.
  */
 class NITROSHARE_EXPORT SettingsRegistry : public QObject
 {
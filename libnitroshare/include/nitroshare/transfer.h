@@ -26,6 +26,7 @@
 #define LIBNITROSHARE_TRANSFER_H
 
 #include <QObject>
+#include <QVariantMap>
 
 #include <nitroshare/config.h>
 
@@ -43,14 +44,24 @@ class NITROSHARE_EXPORT TransferPrivate;
  * This class implements the protocol for performing a transfer between peers.
  * The two constructors determine whether the transfer sends or receives items
  * since a transfer sending items requires a bundle to transfer.
+ *
+ * Unless disabled, the transports, items, and protocol state of a transfer
+ * live on one of a small pool of worker threads. The properties below are
+ * snapshots published on the thread that created the transfer and several
+ * changes in quick succession may be reported with a single signal.
+ *
+ * Transfers sending items are queued by TransferModel when the number of
+ * active transfers is limited and start in order of priority.
  */
 class NITROSHARE_EXPORT Transfer : public QObject
 {
     Q_OBJECT
     Q_ENUMS(Direction)
     Q_ENUMS(State)
+    Q_ENUMS(Priority)
     Q_PROPERTY(Direction direction READ direction)
     Q_PROPERTY(State state READ state NOTIFY stateChanged)
+    Q_PROPERTY(Priority priority READ priority WRITE setPriority)
     Q_PROPERTY(int progress READ progress NOTIFY progressChanged)
     Q_PROPERTY(qint64 speed READ speed NOTIFY speedChanged)
     Q_PROPERTY(qint64 bytesRemaining READ bytesRemaining)
@@ -79,7 +90,26 @@ public:
         /// An error occurred during transfer
         Failed,
         /// Transfer has completed successfully
-        Succeeded
+        Succeeded,
+        /// Transfer is waiting for other transfers to finish
+        Queued,
+        /// Transfer was paused and is waiting to be resumed
+        Paused
+    };
+
+    /**
+     * @brief Order in which queued transfers are started
+     *
+     * A queued transfer may pause an active transfer with a lower priority
+     * in order to start; the paused transfer resumes once there is room.
+     */
+    enum Priority {
+        /// Large transfers that can wait for others
+        Bulk,
+        /// Default for transfers that are not small
+        Normal,
+        /// Small transfers (URLs, etc.) that should not wait
+        Interactive
     };
 
     /**
@@ -103,6 +133,14 @@ public:
      */
     Transfer(Application *application, Transport *transport, QObject *parent = nullptr);
 
+    /**
+     * @brief Destroy the transfer
+     *
+     * If the transfer is running on a worker thread, its transports and
+     * items are freed there once any packet being processed is finished.
+     */
+    virtual ~Transfer();
+
     /**
      * @brief Retrieve the direction of transfer
      * @return transfer direction
@@ -115,6 +153,20 @@ public:
      */
     State state() const;
 
+    /**
+     * @brief Retrieve the priority of the transfer
+     * @return transfer priority
+     */
+    Priority priority() const;
+
+    /**
+     * @brief Set the priority of the transfer
+     * @param priority new priority
+     *
+     * The priority only affects transfers that are queued.
+     */
+    void setPriority(Priority priority);
+
     /**
      * @brief Retrieve the progress of the transfer
      * @return integer between 0 and 100 inclusive
@@ -140,6 +192,22 @@ public:
      */
     qint64 bytesRemaining() const;
 
+    /**
+     * @brief Retrieve the time and data spent in each phase of the transfer
+     * @return map of counters
+     *
+     * The map contains the following counters (times are in microseconds):
+     *
+     * - readTime, readBytes, readCount - reading items from disk
+     * - writeTime, writeBytes, writeCount - writing items to disk
+     * - headerTime, headerCount - preparing or processing item headers
+     * - blockedTime, blockedCount - waiting for a full socket buffer to drain
+     *
+     * The counters are refreshed at least once a second while the transfer
+     * is in progress; there is no signal for indicating changes.
+     */
+    QVariantMap stats() const;
+
     /**
      * @brief Retrieve the name of the remote peer
      * @return device name
@@ -197,9 +265,22 @@ public Q_SLOTS:
      */
     void cancel();
 
+    /**
+     * @brief Stop sending or receiving data until resumed
+     *
+     * The connection to the peer remains open while the transfer is paused.
+     */
+    void pause();
+
+    /**
+     * @brief Continue a transfer that was paused
+     */
+    void resume();
+
 private:
 
     TransferPrivate *const d;
+    friend class TransferModelPrivate;
 };
 
 #endif // LIBNITROSHARE_TRANSFER_H
@@ -35,6 +35,9 @@ class NITROSHARE_EXPORT TransferModelPrivate;
 
 /**
  * @brief Model representing transfers in progress and completed
+ *
+ * The model also schedules outgoing transfers, limiting how many are active
+ * at once (overall and for each device) and starting them by priority.
  */
 class NITROSHARE_EXPORT TransferModel : public QAbstractListModel
 {
@@ -52,7 +55,9 @@ public:
      * @brief Add a transfer to the model
      * @param transfer pointer to Transfer
      *
-     * The model assumes ownership of the transfer.
+     * The model assumes ownership of the transfer. Transfers sending items
+     * that are queued (see Transfer::Queued) are started by the model once
+     * the limits on active transfers allow it.
      */
     void add(Transfer *transfer);
 
@@ -74,6 +79,9 @@ public:
 private:
 
     TransferModelPrivate *const d;
+    friend class ApplicationPrivate;
+    friend class TransferModelPrivate;
+    friend class TransferPrivate;
 };
 
 #endif // LIBNITROSHARE_TRANSFERMODEL_H
@@ -26,10 +26,10 @@
 #define LIBNITROSHARE_TRANSPORT_H
 
 #include <QObject>
+#include <QStringList>
 
 #include <nitroshare/config.h>
-
-class Packet;
+#include <nitroshare/packet.h>
 
 /**
  * @brief Method for transmitting bundles to other devices
@@ -50,9 +50,109 @@ public:
 
     /**
      * @brief Send a packet on the transport
-     * @param packet pointer to Packet
+     * @param packet packet to send
+     *
+     * The transport must copy the packet (or its content) if it needs it
+     * after returning - this is cheap since the content is implicitly shared.
+     */
+    virtual void sendPacket(const Packet &packet) = 0;
+
+    /**
+     * @brief Retrieve the number of bytes waiting to be written
+     * @return pending bytes
+     *
+     * Transfers use this value to keep a bounded amount of data in flight.
+     * The default implementation returns -1, which indicates that the value
+     * is unknown - transfers then send a single packet each time packetSent()
+     * is emitted.
+     */
+    virtual qint64 bytesToWrite() const;
+
+    /**
+     * @brief Stop or resume reading packets from the peer
+     * @param paused true to stop reading
+     *
+     * Transfers use this to enforce bandwidth limits when receiving. While
+     * paused, the transport should leave data with the operating system so
+     * that flow control slows the peer down. The default implementation
+     * does nothing.
+     */
+    virtual void setReadPaused(bool paused);
+
+    /**
+     * @brief Determine if sendFile() can be used
+     * @return true if file data can be sent without copying it
+     *
+     * The default implementation returns false.
+     */
+    virtual bool canSendFile() const;
+
+    /**
+     * @brief Send a packet whose content ends with data from a file
+     * @param type type of packet
+     * @param prefix content that precedes the data from the file
+     * @param handle native file descriptor to read from
+     * @param offset position of the data in the file
+     * @param length number of bytes of data
+     *
+     * This is only called if canSendFile() returns true. The data is sent
+     * after any packets already sent and before any that follow it. The
+     * transport must not rely on the descriptor remaining open after this
+     * method returns. The default implementation does nothing.
+     */
+    virtual void sendFile(Packet::Type type, const QByteArray &prefix,
+                          int handle, qint64 offset, qint64 length);
+
+    /**
+     * @brief Determine if receiveFile() can be used
+     * @return true if received data can be written without copying it
+     *
+     * The default implementation returns false.
      */
-    virtual void sendPacket(Packet *packet) = 0;
+    virtual bool canReceiveFile() const;
+
+    /**
+     * @brief Write the content of binary packets directly to a file
+     * @param handle native descriptor of a file open for writing or -1 to stop
+     * @param offset position in the file at which to write the data
+     *
+     * This is only called if canReceiveFile() returns true. Until it is
+     * called again with a handle of -1, the content of each binary packet is
+     * written to the file one after the other and fileReceived() is emitted
+     * instead of packetReceived(). Other packets are received as usual. The
+     * default implementation does nothing.
+     */
+    virtual void receiveFile(int handle, qint64 offset);
+
+    /**
+     * @brief Set the largest packet that may be received
+     * @param size maximum size of the packet content in bytes
+     *
+     * Transports should emit error() instead of buffering a packet whose
+     * announced size is larger. The default implementation does nothing.
+     */
+    virtual void setMaxPacketSize(qint64 size);
+
+    /**
+     * @brief Retrieve the features of the transport itself
+     * @return list of feature names
+     *
+     * Senders request these in the transfer header along with the features
+     * of the transfer, which legacy receivers ignore; receivers acknowledge
+     * the ones their transport also lists. The default implementation
+     * returns an empty list.
+     */
+    virtual QStringList features() const;
+
+    /**
+     * @brief Indicate which of the transport's features the receiver supports
+     * @param features names of the features that were acknowledged
+     *
+     * This is invoked on the sending end once the transfer header has been
+     * acknowledged or the receiver failed to respond, in which case the list
+     * is empty. The default implementation does nothing.
+     */
+    virtual void setPeerFeatures(const QStringList &features);
 
     /**
      * @brief Disconnect and close the transport.
@@ -68,15 +168,28 @@ Q_SIGNALS:
 
     /**
      * @brief Indicate that a packet has been received from the transport
-     * @param packet pointer to Packet
+     * @param packet packet that was received
+     *
+     * The packet is owned by the transport and is only valid until the slots
+     * return; slots that need it later must keep a copy.
+     */
+    void packetReceived(const Packet &packet);
+
+    /**
+     * @brief Indicate that the content of a binary packet was written
+     * @param length number of bytes written to the file
+     *
+     * This signal is used in place of packetReceived() for binary packets
+     * while receiveFile() is in effect.
      */
-    void packetReceived(Packet *packet);
+    void fileReceived(qint64 length);
 
     /**
-     * @brief Indicate that the previous packet has been sent
+     * @brief Indicate that data has been written to the peer
      *
-     * This signals to the transfer code that the next packet may be sent
-     * through the transport.
+     * This signals to the transfer code that space may be available in the
+     * send window; bytesToWrite() is consulted to determine how many more
+     * packets may be sent through the transport.
      */
     void packetSent();
 
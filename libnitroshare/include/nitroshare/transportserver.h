@@ -58,6 +58,18 @@ public:
      */
     virtual Transport *createTransport(Device *device) = 0;
 
+    /**
+     * @brief Create a transport that is not shared with other transfers
+     * @param device pointer to Device
+     * @return pointer to Transport or nullptr
+     *
+     * This method is invoked instead of createTransport() for the additional
+     * streams of a transfer and for large bundles, which should have a
+     * connection to themselves. The default implementation simply invokes
+     * createTransport().
+     */
+    virtual Transport *createDedicatedTransport(Device *device);
+
 Q_SIGNALS:
 
     /**
@@ -69,6 +69,55 @@ public:
      */
     Transport *createTransport(Device *device);
 
+    /**
+     * @brief Create a transport for the specified device that is not shared
+     * @param device pointer to Device
+     * @return pointer to Transport or nullptr
+     */
+    Transport *createDedicatedTransport(Device *device);
+
+    /**
+     * @brief Set the amount of memory available for received packets
+     * @param bytes maximum number of bytes or 0 for no limit
+     *
+     * The budget is shared by every transport; memory already reserved
+     * remains reserved if the budget is reduced.
+     */
+    void setReceiveBudget(qint64 bytes);
+
+    /**
+     * @brief Retrieve the amount of memory available for received packets
+     * @return maximum number of bytes or 0 for no limit
+     */
+    qint64 receiveBudget() const;
+
+    /**
+     * @brief Retrieve the amount of memory reserved for received packets
+     * @return number of bytes
+     */
+    qint64 receiveMemoryUsed() const;
+
+    /**
+     * @brief Reserve memory for a received packet
+     * @param bytes number of bytes to reserve
+     * @return true if the memory was reserved
+     *
+     * A reservation is refused if it would exceed the budget, unless no
+     * memory is reserved at all (so that a single packet larger than the
+     * budget can still be received). Transports that are refused should
+     * stop reading and try again once receiveMemoryReleased() is emitted.
+     * This method is thread-safe.
+     */
+    bool reserveReceiveMemory(qint64 bytes);
+
+    /**
+     * @brief Release memory reserved with reserveReceiveMemory()
+     * @param bytes number of bytes to release
+     *
+     * This method is thread-safe.
+     */
+    void releaseReceiveMemory(qint64 bytes);
+
 Q_SIGNALS:
 
     /**
@@ -77,6 +126,13 @@ Q_SIGNALS:
      */
     void transportReceived(Transport *transport);
 
+    /**
+     * @brief Indicate that memory was released after a reservation was refused
+     *
+     * This signal may be emitted from any thread.
+     */
+    void receiveMemoryReleased();
+
 private:
 
     TransportServerRegistryPrivate *const d;
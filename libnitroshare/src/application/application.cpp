@@ -28,6 +28,7 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QHostInfo>
+#include <QThread>
 #include <QUuid>
 
 #include <nitroshare/application.h>
@@ -35,6 +36,7 @@
 #include <nitroshare/transport.h>
 
 #include "application_p.h"
+#include "../transfer/transfermodel_p.h"
 
 const QString PluginDir = "plugin-dir";
 const QString PluginBlacklist = "plugin-blacklist";
@@ -47,6 +49,30 @@ const QString Application::PluginCategoryName = "plugin";
 const QString Application::PluginDirectoriesSettingName = "PluginDirectories";
 const QString Application::PluginBlacklistSettingName = "PluginBlacklist";
 
+const QString Application::TransferCategoryName = "transfer";
+const QString Application::TransferHighWatermarkSettingName = "TransferHighWatermark";
+const QString Application::TransferLowWatermarkSettingName = "TransferLowWatermark";
+const QString Application::TransferStreamsSettingName = "TransferStreams";
+const QString Application::TransferStripeThresholdSettingName = "TransferStripeThreshold";
+const QString Application::TransferResumeThresholdSettingName = "TransferResumeThreshold";
+const QString Application::TransferDeltaThresholdSettingName = "TransferDeltaThreshold";
+const QString Application::TransferCompressionSettingName = "TransferCompression";
+const QString Application::TransferBatchThresholdSettingName = "TransferBatchThreshold";
+const QString Application::TransferWorkerThreadsSettingName = "TransferWorkerThreads";
+const QString Application::TransferDigestSettingName = "TransferDigest";
+const QString Application::TransferUploadLimitSettingName = "TransferUploadLimit";
+const QString Application::TransferDownloadLimitSettingName = "TransferDownloadLimit";
+const QString Application::TransferDeviceLimitSettingName = "TransferDeviceLimit";
+const QString Application::TransferLimitScheduleSettingName = "TransferLimitSchedule";
+const QString Application::TransferMaxActiveSettingName = "TransferMaxActive";
+const QString Application::TransferMaxActivePerDeviceSettingName = "TransferMaxActivePerDevice";
+const QString Application::TransferWriteBufferSettingName = "TransferWriteBuffer";
+const QString Application::TransferReadAheadSettingName = "TransferReadAhead";
+const QString Application::TransferZeroCopySettingName = "TransferZeroCopy";
+const QString Application::TransferReceiveBudgetSettingName = "TransferReceiveBudget";
+const QString Application::TransferReadBufferSettingName = "TransferReadBuffer";
+const QString Application::TransferMaxPacketSizeSettingName = "TransferMaxPacketSize";
+
 ApplicationPrivate::ApplicationPrivate(Application *application, QSettings *existingSettings)
     : QObject(application),
       q(application),
@@ -86,6 +112,164 @@ ApplicationPrivate::ApplicationPrivate(Application *application, QSettings *exis
           { Setting::CategoryKey, Application::PluginCategoryName },
           { Setting::DefaultValueKey, QStringList() }
       }),
+      transferCategory({
+          { Category::NameKey, Application::TransferCategoryName },
+          { Category::TitleKey, tr("Transfer") }
+      }),
+      transferHighWatermark({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferHighWatermarkSettingName },
+          { Setting::TitleKey, tr("Send window high watermark (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 4194304 }
+      }),
+      transferLowWatermark({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferLowWatermarkSettingName },
+          { Setting::TitleKey, tr("Send window low watermark (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 1048576 }
+      }),
+      transferStreams({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferStreamsSettingName },
+          { Setting::TitleKey, tr("Parallel connections per transfer") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 1 }
+      }),
+      transferStripeThreshold({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferStripeThresholdSettingName },
+          { Setting::TitleKey, tr("Minimum size for splitting items across connections (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 16777216 }
+      }),
+      transferResumeThreshold({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferResumeThresholdSettingName },
+          { Setting::TitleKey, tr("Minimum size for resuming interrupted transfers (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 67108864 }
+      }),
+      transferDeltaThreshold({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferDeltaThresholdSettingName },
+          { Setting::TitleKey, tr("Minimum size for sending only changed blocks (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 0 }
+      }),
+      transferCompression({
+          { Setting::TypeKey, Setting::Boolean },
+          { Setting::NameKey, Application::TransferCompressionSettingName },
+          { Setting::TitleKey, tr("Compress item content") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, false }
+      }),
+      transferBatchThreshold({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferBatchThresholdSettingName },
+          { Setting::TitleKey, tr("Maximum size of items sent in batches (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 65536 }
+      }),
+      transferWorkerThreads({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferWorkerThreadsSettingName },
+          { Setting::TitleKey, tr("Number of threads used for transfers (0 uses the main thread)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, qBound(1, QThread::idealThreadCount(), 4) }
+      }),
+      transferDigest({
+          { Setting::TypeKey, Setting::String },
+          { Setting::NameKey, Application::TransferDigestSettingName },
+          { Setting::TitleKey, tr("Digest used to verify items (xxh64, sha256, or none)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, "none" }
+      }),
+      transferUploadLimit({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferUploadLimitSettingName },
+          { Setting::TitleKey, tr("Upload limit for all transfers (KiB/s, 0 for none)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 0 }
+      }),
+      transferDownloadLimit({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferDownloadLimitSettingName },
+          { Setting::TitleKey, tr("Download limit for all transfers (KiB/s, 0 for none)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 0 }
+      }),
+      transferDeviceLimit({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferDeviceLimitSettingName },
+          { Setting::TitleKey, tr("Limit for transfers with each device (KiB/s, 0 for none)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 0 }
+      }),
+      transferLimitSchedule({
+          { Setting::TypeKey, Setting::String },
+          { Setting::NameKey, Application::TransferLimitScheduleSettingName },
+          { Setting::TitleKey, tr("Times when limits apply (e.g. 09:00-17:00, blank for always)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, QString() }
+      }),
+      transferMaxActive({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferMaxActiveSettingName },
+          { Setting::TitleKey, tr("Maximum number of active outgoing transfers (0 for none)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 8 }
+      }),
+      transferMaxActivePerDevice({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferMaxActivePerDeviceSettingName },
+          { Setting::TitleKey, tr("Maximum number of active transfers to each device (0 for none)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 2 }
+      }),
+      transferWriteBuffer({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferWriteBufferSettingName },
+          { Setting::TitleKey, tr("Size of write-behind buffer for received data (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 16777216 }
+      }),
+      transferReadAhead({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferReadAheadSettingName },
+          { Setting::TitleKey, tr("Size of read-ahead buffer for sent data (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 8388608 }
+      }),
+      transferZeroCopy({
+          { Setting::TypeKey, Setting::Boolean },
+          { Setting::NameKey, Application::TransferZeroCopySettingName },
+          { Setting::TitleKey, tr("Transfer file content without copying it") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, true }
+      }),
+      transferReceiveBudget({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferReceiveBudgetSettingName },
+          { Setting::TitleKey, tr("Memory available for received packets (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 268435456 }
+      }),
+      transferReadBuffer({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferReadBufferSettingName },
+          { Setting::TitleKey, tr("Size of the read buffer of each connection (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 1048576 }
+      }),
+      transferMaxPacketSize({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, Application::TransferMaxPacketSizeSettingName },
+          { Setting::TitleKey, tr("Largest packet that may be received (bytes)") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 16777216 }
+      }),
       settings(existingSettings ? existingSettings : new QSettings(this)),
       actionRegistry(application),
       pluginModel(application),
@@ -100,6 +284,32 @@ ApplicationPrivate::ApplicationPrivate(Application *application, QSettings *exis
     settingsRegistry.addSetting(&pluginDirectories);
     settingsRegistry.addSetting(&pluginBlacklist);
 
+    settingsRegistry.addCategory(&transferCategory);
+    settingsRegistry.addSetting(&transferHighWatermark);
+    settingsRegistry.addSetting(&transferLowWatermark);
+    settingsRegistry.addSetting(&transferStreams);
+    settingsRegistry.addSetting(&transferStripeThreshold);
+    settingsRegistry.addSetting(&transferResumeThreshold);
+    settingsRegistry.addSetting(&transferDeltaThreshold);
+    settingsRegistry.addSetting(&transferCompression);
+    settingsRegistry.addSetting(&transferBatchThreshold);
+    settingsRegistry.addSetting(&transferWorkerThreads);
+    settingsRegistry.addSetting(&transferDigest);
+    settingsRegistry.addSetting(&transferUploadLimit);
+    settingsRegistry.addSetting(&transferDownloadLimit);
+    settingsRegistry.addSetting(&transferDeviceLimit);
+    settingsRegistry.addSetting(&transferLimitSchedule);
+    settingsRegistry.addSetting(&transferMaxActive);
+    settingsRegistry.addSetting(&transferMaxActivePerDevice);
+    settingsRegistry.addSetting(&transferWriteBuffer);
+    settingsRegistry.addSetting(&transferReadAhead);
+    settingsRegistry.addSetting(&transferZeroCopy);
+    settingsRegistry.addSetting(&transferReceiveBudget);
+    settingsRegistry.addSetting(&transferReadBuffer);
+    settingsRegistry.addSetting(&transferMaxPacketSize);
+
+    transferModel.d->setRegistries(&settingsRegistry, &transportServerRegistry);
+
     connect(&transportServerRegistry, &TransportServerRegistry::transportReceived, [&](Transport *transport) {
         transferModel.add(new Transfer(q, transport));
     });
@@ -114,6 +324,30 @@ ApplicationPrivate::~ApplicationPrivate()
     settingsRegistry.removeSetting(&pluginBlacklist);
     settingsRegistry.removeSetting(&pluginDirectories);
     settingsRegistry.removeCategory(&pluginCategory);
+
+    settingsRegistry.removeSetting(&transferHighWatermark);
+    settingsRegistry.removeSetting(&transferLowWatermark);
+    settingsRegistry.removeSetting(&transferStreams);
+    settingsRegistry.removeSetting(&transferStripeThreshold);
+    settingsRegistry.removeSetting(&transferResumeThreshold);
+    settingsRegistry.removeSetting(&transferDeltaThreshold);
+    settingsRegistry.removeSetting(&transferCompression);
+    settingsRegistry.removeSetting(&transferBatchThreshold);
+    settingsRegistry.removeSetting(&transferWorkerThreads);
+    settingsRegistry.removeSetting(&transferDigest);
+    settingsRegistry.removeSetting(&transferUploadLimit);
+    settingsRegistry.removeSetting(&transferDownloadLimit);
+    settingsRegistry.removeSetting(&transferDeviceLimit);
+    settingsRegistry.removeSetting(&transferLimitSchedule);
+    settingsRegistry.removeSetting(&transferMaxActive);
+    settingsRegistry.removeSetting(&transferMaxActivePerDevice);
+    settingsRegistry.removeSetting(&transferWriteBuffer);
+    settingsRegistry.removeSetting(&transferReadAhead);
+    settingsRegistry.removeSetting(&transferZeroCopy);
+    settingsRegistry.removeSetting(&transferReceiveBudget);
+    settingsRegistry.removeSetting(&transferReadBuffer);
+    settingsRegistry.removeSetting(&transferMaxPacketSize);
+    settingsRegistry.removeCategory(&transferCategory);
 }
 
 QString ApplicationPrivate::defaultPluginDirectory() const
@@ -60,6 +60,30 @@ public:
     Setting pluginDirectories;
     Setting pluginBlacklist;
 
+    Category transferCategory;
+    Setting transferHighWatermark;
+    Setting transferLowWatermark;
+    Setting transferStreams;
+    Setting transferStripeThreshold;
+    Setting transferResumeThreshold;
+    Setting transferDeltaThreshold;
+    Setting transferCompression;
+    Setting transferBatchThreshold;
+    Setting transferWorkerThreads;
+    Setting transferDigest;
+    Setting transferUploadLimit;
+    Setting transferDownloadLimit;
+    Setting transferDeviceLimit;
+    Setting transferLimitSchedule;
+    Setting transferMaxActive;
+    Setting transferMaxActivePerDevice;
+    Setting transferWriteBuffer;
+    Setting transferReadAhead;
+    Setting transferZeroCopy;
+    Setting transferReceiveBudget;
+    Setting transferReadBuffer;
+    Setting transferMaxPacketSize;
+
     QSettings *settings;
 
     ActionRegistry actionRegistry;
@@ -68,8 +92,13 @@ public:
     Logger logger;
     PluginModel pluginModel;
     SettingsRegistry settingsRegistry;
-    TransferModel transferModel;
+
+    /*
+     * Transports release their receive memory when they are destroyed, so
+     * the registry must outlive the transfers that own them
+     */
     TransportServerRegistry transportServerRegistry;
+    TransferModel transferModel;
 
     bool uiEnabled;
 };
@@ -43,6 +43,21 @@ void Item::write(const QByteArray &)
 {
 }
 
+bool Item::seek(qint64)
+{
+    return false;
+}
+
+int Item::handle() const
+{
+    return -1;
+}
+
+qint64 Item::existingSize() const
+{
+    return -1;
+}
+
 void Item::close()
 {
 }
@@ -22,23 +22,9 @@
  * IN THE SOFTWARE.
  */
 
-#ifndef LIBNITROSHARE_PACKET_P_H
-#define LIBNITROSHARE_PACKET_P_H
+#include <nitroshare/handler.h>
 
-#include <QObject>
-
-#include <nitroshare/packet.h>
-
-class PacketPrivate : public QObject
+qint64 Handler::bytesAvailable() const
 {
-    Q_OBJECT
-
-public:
-
-    PacketPrivate(QObject *parent, Packet::Type type, const QByteArray &content);
-
-    Packet::Type type;
-    QByteArray content;
-};
-
-#endif // LIBNITROSHARE_PACKET_P_H
+    return -1;
+}
@@ -22,6 +22,8 @@
  * IN THE SOFTWARE.
  */
 
+#include <QMutexLocker>
+
 #include <nitroshare/handler.h>
 #include <nitroshare/handlerregistry.h>
 
@@ -40,15 +42,18 @@ HandlerRegistry::HandlerRegistry(QObject *parent)
 
 Handler *HandlerRegistry::find(const QString &name)
 {
+    QMutexLocker locker(&d->mutex);
     return d->handlers.value(name);
 }
 
 void HandlerRegistry::add(Handler *handler)
 {
+    QMutexLocker locker(&d->mutex);
     d->handlers.insert(handler->name(), handler);
 }
 
 void HandlerRegistry::remove(Handler *handler)
 {
+    QMutexLocker locker(&d->mutex);
     d->handlers.remove(handler->name());
 }
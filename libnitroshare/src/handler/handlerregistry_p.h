@@ -26,6 +26,7 @@
 #define LIBNITROSHARE_HANDLERREGISTRY_P_H
 
 #include <QMap>
+#include <QMutex>
 #include <QObject>
 
 class Handler;
@@ -38,6 +39,9 @@ public:
 
     explicit HandlerRegistryPrivate(QObject *parent);
 
+    /* Transfers running on worker threads look up handlers too */
+    QMutex mutex;
+
     QMap<QString, Handler*> handlers;
 };
 
@@ -22,6 +22,8 @@
  * IN THE SOFTWARE.
  */
 
+#include <QMutexLocker>
+
 #include <nitroshare/category.h>
 #include <nitroshare/setting.h>
 #include <nitroshare/settingsregistry.h>
@@ -35,6 +37,16 @@ SettingsRegistryPrivate::SettingsRegistryPrivate(QObject *parent, QSettings *set
 {
 }
 
+Setting *SettingsRegistryPrivate::findSetting(const QString &name) const
+{
+    foreach (Setting *setting, settingsList) {
+        if (setting->name() == name) {
+            return setting;
+        }
+    }
+    return nullptr;
+}
+
 SettingsRegistry::SettingsRegistry(QSettings *settings, QObject *parent)
     : QObject(parent),
       d(new SettingsRegistryPrivate(this, settings))
@@ -43,16 +55,19 @@ SettingsRegistry::SettingsRegistry(QSettings *settings, QObject *parent)
 
 QList<Category*> SettingsRegistry::categories() const
 {
+    QMutexLocker locker(&d->mutex);
     return d->categoryList;
 }
 
 QList<Setting*> SettingsRegistry::settings() const
 {
+    QMutexLocker locker(&d->mutex);
     return d->settingsList;
 }
 
 Category *SettingsRegistry::findCategory(const QString &name) const
 {
+    QMutexLocker locker(&d->mutex);
     foreach (Category *category, d->categoryList) {
         if (category->name() == name) {
             return category;
@@ -63,41 +78,50 @@ Category *SettingsRegistry::findCategory(const QString &name) const
 
 void SettingsRegistry::addCategory(Category *category)
 {
-    d->categoryList.append(category);
+    {
+        QMutexLocker locker(&d->mutex);
+        d->categoryList.append(category);
+    }
     emit categoryAdded(category);
 }
 
 void SettingsRegistry::removeCategory(Category *category)
 {
-    d->categoryList.removeOne(category);
+    {
+        QMutexLocker locker(&d->mutex);
+        d->categoryList.removeOne(category);
+    }
     emit categoryRemoved(category);
 }
 
 Setting *SettingsRegistry::findSetting(const QString &name) const
 {
-    foreach (Setting *setting, d->settingsList) {
-        if (setting->name() == name) {
-            return setting;
-        }
-    }
-    return nullptr;
+    QMutexLocker locker(&d->mutex);
+    return d->findSetting(name);
 }
 
 void SettingsRegistry::addSetting(Setting *setting)
 {
-    d->settingsList.append(setting);
+    {
+        QMutexLocker locker(&d->mutex);
+        d->settingsList.append(setting);
+    }
     emit settingAdded(setting);
 }
 
 void SettingsRegistry::removeSetting(Setting *setting)
 {
-    d->settingsList.removeOne(setting);
+    {
+        QMutexLocker locker(&d->mutex);
+        d->settingsList.removeOne(setting);
+    }
     emit settingRemoved(setting);
 }
 
 QVariant SettingsRegistry::value(const QString &name) const
 {
-    Setting *setting = findSetting(name);
+    QMutexLocker locker(&d->mutex);
+    Setting *setting = d->findSetting(name);
     if (setting) {
         if (d->settings->contains(name)) {
             return d->settings->value(name);
@@ -112,25 +136,34 @@ QVariant SettingsRegistry::value(const QString &name) const
 
 void SettingsRegistry::setValue(const QString &name, const QVariant &value)
 {
-    if (d->settings->contains(name) && d->settings->value(name) == value) {
-        return;
-    }
-    d->settings->setValue(name, value);
-    if (d->isInGroup) {
-        d->groupNames.insert(name);
-    } else {
-        emit settingsChanged({ name });
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->settings->contains(name) && d->settings->value(name) == value) {
+            return;
+        }
+        d->settings->setValue(name, value);
+        if (d->isInGroup) {
+            d->groupNames.insert(name);
+            return;
+        }
     }
+    emit settingsChanged({ name });
 }
 
 void SettingsRegistry::begin()
 {
+    QMutexLocker locker(&d->mutex);
     d->isInGroup = true;
 }
 
 void SettingsRegistry::end()
 {
-    emit settingsChanged(d->groupNames.toList());
-    d->isInGroup = false;
-    d->groupNames.clear();
+    QStringList names;
+    {
+        QMutexLocker locker(&d->mutex);
+        names = d->groupNames.toList();
+        d->isInGroup = false;
+        d->groupNames.clear();
+    }
+    emit settingsChanged(names);
 }
@@ -26,6 +26,7 @@
 #define LIBNITROSHARE_SETTINGSREGISTRY_P_H
 
 #include <QList>
+#include <QMutex>
 #include <QObject>
 #include <QSet>
 #include <QSettings>
@@ -41,6 +42,11 @@ public:
 
     explicit SettingsRegistryPrivate(QObject *parent, QSettings *settings);
 
+    Setting *findSetting(const QString &name) const;
+
+    /* Transfers running on worker threads read settings too */
+    QMutex mutex;
+
     QSettings *settings;
     QList<Category*> categoryList;
     QList<Setting*> settingsList;
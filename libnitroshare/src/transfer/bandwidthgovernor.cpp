@@ -0,0 +1,183 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <cmath>
+
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTime>
+
+#include "bandwidthgovernor_p.h"
+
+// Time after which a transfer that has not used a bucket no longer counts
+// towards splitting it
+const qint64 ShareTimeout = 1000;
+
+BandwidthGovernor::BandwidthGovernor()
+    : mUpload{ 0, 0, 0, {} },
+      mDownload{ 0, 0, 0, {} },
+      mDeviceLimit(0)
+{
+    mTimer.start();
+}
+
+void BandwidthGovernor::configure(qint64 uploadLimit, qint64 downloadLimit, qint64 deviceLimit, const QString &schedule)
+{
+    QMutexLocker locker(&mMutex);
+
+    // Each bucket starts full, allowing a second's worth of data through
+    qint64 now = mTimer.elapsed();
+    if (mUpload.rate != uploadLimit) {
+        mUpload = { uploadLimit, static_cast<double>(uploadLimit), now, {} };
+    }
+    if (mDownload.rate != downloadLimit) {
+        mDownload = { downloadLimit, static_cast<double>(downloadLimit), now, {} };
+    }
+    if (mDeviceLimit != deviceLimit) {
+        mDeviceLimit = deviceLimit;
+        mDevices.clear();
+    }
+
+    // Windows are given as "HH:mm-HH:mm" separated by commas and may span
+    // midnight - invalid windows are ignored
+    mWindows.clear();
+    foreach (const QString &window, schedule.split(",", QString::SkipEmptyParts)) {
+        QStringList times = window.trimmed().split("-");
+        if (times.count() != 2) {
+            continue;
+        }
+        QTime start = QTime::fromString(times.at(0).trimmed(), "HH:mm");
+        QTime end = QTime::fromString(times.at(1).trimmed(), "HH:mm");
+        if (start.isValid() && end.isValid()) {
+            mWindows.append({ start.msecsSinceStartOfDay() / 60000, end.msecsSinceStartOfDay() / 60000 });
+        }
+    }
+}
+
+qint64 BandwidthGovernor::delay(Transfer::Direction direction, const QString &device, const void *consumer)
+{
+    QMutexLocker locker(&mMutex);
+
+    if (!isActive()) {
+        return 0;
+    }
+
+    // Wait until every bucket that applies is out of debt - a transfer that
+    // is also in debt for its share waits until that is paid off as well
+    qint64 delay = 0;
+    foreach (Bucket *bucket, buckets(direction, device, consumer)) {
+        if (bucket->tokens < 0) {
+            delay = qMax(delay, static_cast<qint64>(std::ceil(-bucket->tokens * 1000.0 / bucket->rate)));
+            const Share &share = bucket->shares[consumer];
+            if (share.tokens < 0) {
+                double rate = static_cast<double>(bucket->rate) / bucket->shares.count();
+                delay = qMax(delay, static_cast<qint64>(std::ceil(-share.tokens * 1000.0 / rate)));
+            }
+        }
+    }
+    return delay;
+}
+
+void BandwidthGovernor::consume(Transfer::Direction direction, const QString &device, const void *consumer, qint64 bytes)
+{
+    QMutexLocker locker(&mMutex);
+
+    if (!isActive()) {
+        return;
+    }
+
+    // A block may take a bucket into debt, which the next caller waits out;
+    // debt for a share is limited to a second's worth so that a transfer
+    // that had the bucket to itself is not held back for long afterwards
+    qint64 now = mTimer.elapsed();
+    foreach (Bucket *bucket, buckets(direction, device, consumer)) {
+        bucket->tokens -= bytes;
+        Share &share = bucket->shares[consumer];
+        double rate = static_cast<double>(bucket->rate) / bucket->shares.count();
+        share.tokens = qMax(-rate, share.tokens - bytes);
+        share.lastUsed = now;
+    }
+}
+
+bool BandwidthGovernor::isActive() const
+{
+    if (mWindows.isEmpty()) {
+        return true;
+    }
+
+    int minute = QTime::currentTime().msecsSinceStartOfDay() / 60000;
+    for (auto i = mWindows.constBegin(); i != mWindows.constEnd(); ++i) {
+        if (i->first <= i->second ? minute >= i->first && minute < i->second :
+                minute >= i->first || minute < i->second) {
+            return true;
+        }
+    }
+    return false;
+}
+
+QList<BandwidthGovernor::Bucket*> BandwidthGovernor::buckets(Transfer::Direction direction, const QString &device, const void *consumer)
+{
+    QList<Bucket*> buckets;
+    buckets.append(direction == Transfer::Send ? &mUpload : &mDownload);
+    if (mDeviceLimit) {
+        if (!mDevices.contains(device)) {
+            mDevices.insert(device, { mDeviceLimit, static_cast<double>(mDeviceLimit), mTimer.elapsed(), {} });
+        }
+        buckets.append(&mDevices[device]);
+    }
+
+    // Refill the buckets that have a limit and skip the others
+    qint64 now = mTimer.elapsed();
+    for (auto i = buckets.begin(); i != buckets.end();) {
+        Bucket *bucket = *i;
+        if (!bucket->rate) {
+            i = buckets.erase(i);
+            continue;
+        }
+        bucket->tokens = qMin(static_cast<double>(bucket->rate),
+            bucket->tokens + bucket->rate * (now - bucket->lastRefill) / 1000.0);
+        bucket->lastRefill = now;
+
+        // Transfers that stopped using the bucket no longer get a share
+        for (auto j = bucket->shares.begin(); j != bucket->shares.end();) {
+            if (j.key() != consumer && now - j->lastUsed > ShareTimeout) {
+                j = bucket->shares.erase(j);
+            } else {
+                ++j;
+            }
+        }
+        if (!bucket->shares.contains(consumer)) {
+            bucket->shares.insert(consumer, { 0, now, now });
+        }
+
+        // Refill each share at its part of the rate
+        double rate = static_cast<double>(bucket->rate) / bucket->shares.count();
+        for (auto j = bucket->shares.begin(); j != bucket->shares.end(); ++j) {
+            j->tokens = qMin(rate, j->tokens + rate * (now - j->lastRefill) / 1000.0);
+            j->lastRefill = now;
+        }
+        ++i;
+    }
+    return buckets;
+}
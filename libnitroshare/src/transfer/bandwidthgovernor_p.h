@@ -0,0 +1,89 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_BANDWIDTHGOVERNOR_P_H
+#define LIBNITROSHARE_BANDWIDTHGOVERNOR_P_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QString>
+
+#include <nitroshare/transfer.h>
+
+/*
+ * Token buckets shared by all transfers that limit the rate at which data is
+ * sent and received - there is a bucket for each direction and one for each
+ * device (identified by its UUID), and the limits may be restricted to
+ * certain times of day
+ *
+ * Each bucket is split evenly between the transfers using it; while the
+ * bucket is in debt, transfers that have used more than their share wait
+ * longer than the others
+ */
+class BandwidthGovernor
+{
+public:
+
+    BandwidthGovernor();
+
+    void configure(qint64 uploadLimit, qint64 downloadLimit, qint64 deviceLimit, const QString &schedule);
+
+    qint64 delay(Transfer::Direction direction, const QString &device, const void *consumer);
+    void consume(Transfer::Direction direction, const QString &device, const void *consumer, qint64 bytes);
+
+private:
+
+    struct Share
+    {
+        double tokens;
+        qint64 lastRefill;
+        qint64 lastUsed;
+    };
+
+    struct Bucket
+    {
+        qint64 rate;
+        double tokens;
+        qint64 lastRefill;
+        QHash<const void*, Share> shares;
+    };
+
+    bool isActive() const;
+    QList<Bucket*> buckets(Transfer::Direction direction, const QString &device, const void *consumer);
+
+    QMutex mMutex;
+    QElapsedTimer mTimer;
+
+    Bucket mUpload;
+    Bucket mDownload;
+    QHash<QString, Bucket> mDevices;
+    qint64 mDeviceLimit;
+
+    QList<QPair<int, int>> mWindows;
+};
+
+#endif // LIBNITROSHARE_BANDWIDTHGOVERNOR_P_H
@@ -0,0 +1,120 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifdef ENABLE_ZSTD
+#  include <zstd.h>
+#endif
+
+#include <QtEndian>
+
+#include "compression_p.h"
+
+// Favor speed over ratio since compression must keep up with the network
+const int ZlibLevel = 1;
+const int ZstdLevel = 1;
+
+// Limit on the size of a decompressed block to guard against malicious input
+const qint64 MaxDecompressedSize = 16777216;
+
+QStringList Compression::supportedMethods()
+{
+    // Methods are listed in order of preference
+    return QStringList{
+#ifdef ENABLE_ZSTD
+        "zstd",
+#endif
+        "zlib"
+    };
+}
+
+Compression::Method Compression::fromName(const QString &name)
+{
+    if (name == "zlib") {
+        return Zlib;
+    }
+#ifdef ENABLE_ZSTD
+    if (name == "zstd") {
+        return Zstd;
+    }
+#endif
+    return None;
+}
+
+QByteArray Compression::compress(Method method, const QByteArray &data)
+{
+    switch (method) {
+    case Zlib:
+        return qCompress(data, ZlibLevel);
+#ifdef ENABLE_ZSTD
+    case Zstd:
+    {
+        QByteArray compressed;
+        compressed.resize(static_cast<int>(ZSTD_compressBound(data.size())));
+        size_t size = ZSTD_compress(compressed.data(), compressed.size(),
+                                    data.constData(), data.size(), ZstdLevel);
+        if (ZSTD_isError(size)) {
+            return QByteArray();
+        }
+        compressed.resize(static_cast<int>(size));
+        return compressed;
+    }
+#endif
+    default:
+        return QByteArray();
+    }
+}
+
+QByteArray Compression::decompress(Method method, const QByteArray &data)
+{
+    switch (method) {
+    case Zlib:
+
+        // qCompress() prefixes the data with its size (32-bit big-endian)
+        if (data.size() < 4 || qFromBigEndian<quint32>(
+                reinterpret_cast<const uchar*>(data.constData())) > MaxDecompressedSize) {
+            return QByteArray();
+        }
+        return qUncompress(data);
+#ifdef ENABLE_ZSTD
+    case Zstd:
+    {
+        unsigned long long size = ZSTD_getFrameContentSize(data.constData(), data.size());
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN ||
+                size > MaxDecompressedSize) {
+            return QByteArray();
+        }
+        QByteArray decompressed;
+        decompressed.resize(static_cast<int>(size));
+        size_t result = ZSTD_decompress(decompressed.data(), decompressed.size(),
+                                        data.constData(), data.size());
+        if (ZSTD_isError(result) || result != size) {
+            return QByteArray();
+        }
+        return decompressed;
+    }
+#endif
+    default:
+        return QByteArray();
+    }
+}
@@ -0,0 +1,252 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QtEndian>
+
+#include <nitroshare/deltautil.h>
+#include <nitroshare/item.h>
+
+#include "deltaencoder_p.h"
+
+// Limits on the amount of data described by a single packet
+const int MaxOpsSize = 65536;
+const qint64 MaxOpsBytes = 67108864;
+
+// Amount of consumed data to keep before discarding it from the buffer
+const int MaxBufferWaste = 1048576;
+
+DeltaEncoder::DeltaEncoder(const QByteArray &signature, qint64 size)
+    : mBlockSize(0),
+      mSignature(signature),
+      mSize(size),
+      mValid(false),
+      mAtEnd(false),
+      mBufferOffset(0),
+      mPos(0),
+      mLiteralStart(0),
+      mChecksum(0),
+      mChecksumValid(false),
+      mCopyOffset(0),
+      mCopyLength(0),
+      mOpsBytes(0)
+{
+    if (signature.size() < static_cast<int>(sizeof(qint32)) ||
+            (signature.size() - sizeof(qint32)) % DeltaUtil::SignatureEntrySize) {
+        return;
+    }
+
+    mBlockSize = qFromLittleEndian<qint32>(reinterpret_cast<const uchar*>(signature.constData()));
+    if (mBlockSize <= 0) {
+        return;
+    }
+
+    // Index the blocks by their weak checksum
+    int count = (signature.size() - sizeof(qint32)) / DeltaUtil::SignatureEntrySize;
+    for (int i = 0; i < count; ++i) {
+        mBlocks.insert(qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(
+            signature.constData() + sizeof(qint32) + i * DeltaUtil::SignatureEntrySize)), i);
+    }
+
+    mValid = true;
+}
+
+bool DeltaEncoder::isValid() const
+{
+    return mValid;
+}
+
+bool DeltaEncoder::atEnd() const
+{
+    return mAtEnd;
+}
+
+QByteArray DeltaEncoder::next(Item *item, qint64 &bytesEncoded)
+{
+    mOps.clear();
+    mOpsBytes = 0;
+
+    while (!mAtEnd && mOps.size() < MaxOpsSize && mOpsBytes < MaxOpsBytes) {
+
+        // Make sure that the window and the byte following it are available
+        if (!fill(item)) {
+            return QByteArray();
+        }
+
+        // If there is not enough data left for another block, the remainder
+        // is sent as a literal run
+        int available = mBuffer.size() - mPos;
+        if (available < mBlockSize) {
+            mPos = mBuffer.size();
+            flushCopy();
+            flushLiteral();
+            mAtEnd = true;
+            break;
+        }
+
+        if (!mChecksumValid) {
+            mChecksum = DeltaUtil::checksum(mBuffer.constData() + mPos, mBlockSize);
+            mChecksumValid = true;
+        }
+
+        qint32 block = findBlock();
+        if (block != -1) {
+
+            // Extend the pending reference if the blocks are contiguous
+            flushLiteral();
+            qint64 offset = static_cast<qint64>(block) * mBlockSize;
+            if (mCopyLength && offset == mCopyOffset + mCopyLength) {
+                mCopyLength += mBlockSize;
+            } else {
+                flushCopy();
+                mCopyOffset = offset;
+                mCopyLength = mBlockSize;
+            }
+            if (mCopyLength >= MaxOpsBytes) {
+                flushCopy();
+            }
+
+            mPos += mBlockSize;
+            mLiteralStart = mPos;
+            mChecksumValid = false;
+
+        } else {
+
+            // The byte leaving the window becomes part of a literal run
+            flushCopy();
+            if (available > mBlockSize) {
+                mChecksum = DeltaUtil::roll(
+                    mChecksum,
+                    mBuffer.at(mPos),
+                    mBuffer.at(mPos + mBlockSize),
+                    mBlockSize
+                );
+            } else {
+                mChecksumValid = false;
+            }
+            ++mPos;
+
+            if (mPos - mLiteralStart >= MaxOpsSize) {
+                flushLiteral();
+            }
+        }
+
+        // Discard data that has already been encoded
+        if (mLiteralStart > MaxBufferWaste) {
+            mBuffer.remove(0, mLiteralStart);
+            mBufferOffset += mLiteralStart;
+            mPos -= mLiteralStart;
+            mLiteralStart = 0;
+        }
+    }
+
+    bytesEncoded = mOpsBytes;
+    return mOps;
+}
+
+bool DeltaEncoder::fill(Item *item)
+{
+    while (mBuffer.size() - mPos <= mBlockSize &&
+            mBufferOffset + mBuffer.size() < mSize) {
+        QByteArray data = item->read();
+        if (data.isEmpty()) {
+            return false;
+        }
+        mBuffer.append(data);
+    }
+    return true;
+}
+
+qint32 DeltaEncoder::findBlock()
+{
+    QList<qint32> blocks = mBlocks.values(mChecksum);
+    if (blocks.isEmpty()) {
+        return -1;
+    }
+
+    // The receiver rebuilds the item in place, so only blocks that have not
+    // yet been overwritten (those at or after the current position) are used
+    qint64 position = mBufferOffset + mPos;
+    QByteArray strongChecksum;
+    qint32 match = -1;
+    foreach (qint32 block, blocks) {
+        qint64 offset = static_cast<qint64>(block) * mBlockSize;
+        if (offset < position) {
+            continue;
+        }
+
+        // Only calculate the strong checksum when it is needed
+        if (strongChecksum.isNull()) {
+            strongChecksum = DeltaUtil::strongChecksum(mBuffer.constData() + mPos, mBlockSize);
+        }
+        if (strongChecksum != QByteArray::fromRawData(
+                mSignature.constData() + sizeof(qint32) +
+                    block * DeltaUtil::SignatureEntrySize + sizeof(quint32),
+                DeltaUtil::SignatureEntrySize - sizeof(quint32))) {
+            continue;
+        }
+
+        // Prefer blocks that are already in place or continue the reference
+        if (offset == position || (mCopyLength && offset == mCopyOffset + mCopyLength)) {
+            return block;
+        }
+        if (match == -1) {
+            match = block;
+        }
+    }
+
+    return match;
+}
+
+void DeltaEncoder::flushLiteral()
+{
+    int length = mPos - mLiteralStart;
+    if (!length) {
+        return;
+    }
+
+    char header[1 + sizeof(qint32)];
+    header[0] = Literal;
+    qToLittleEndian<qint32>(length, reinterpret_cast<uchar*>(header + 1));
+    mOps.append(header, sizeof(header));
+    mOps.append(mBuffer.constData() + mLiteralStart, length);
+
+    mOpsBytes += length;
+    mLiteralStart = mPos;
+}
+
+void DeltaEncoder::flushCopy()
+{
+    if (!mCopyLength) {
+        return;
+    }
+
+    char op[1 + sizeof(qint64) * 2];
+    op[0] = Copy;
+    qToLittleEndian<qint64>(mCopyOffset, reinterpret_cast<uchar*>(op + 1));
+    qToLittleEndian<qint64>(mCopyLength, reinterpret_cast<uchar*>(op + 1 + sizeof(qint64)));
+    mOps.append(op, sizeof(op));
+
+    mOpsBytes += mCopyLength;
+    mCopyLength = 0;
+}
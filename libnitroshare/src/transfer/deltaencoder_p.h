@@ -0,0 +1,84 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_DELTAENCODER_P_H
+#define LIBNITROSHARE_DELTAENCODER_P_H
+
+#include <QByteArray>
+#include <QMultiHash>
+
+class Item;
+
+/*
+ * Produces the content of delta packets for an item by comparing it with the
+ * signature sent by the receiver; each packet contains a sequence of literal
+ * runs and references to blocks that the receiver already has
+ */
+class DeltaEncoder
+{
+public:
+
+    enum Operation {
+        Literal = 0,
+        Copy
+    };
+
+    DeltaEncoder(const QByteArray &signature, qint64 size);
+
+    bool isValid() const;
+    bool atEnd() const;
+
+    QByteArray next(Item *item, qint64 &bytesEncoded);
+
+private:
+
+    bool fill(Item *item);
+    qint32 findBlock();
+    void flushLiteral();
+    void flushCopy();
+
+    int mBlockSize;
+    QMultiHash<quint32, qint32> mBlocks;
+    QByteArray mSignature;
+
+    qint64 mSize;
+    bool mValid;
+    bool mAtEnd;
+
+    QByteArray mBuffer;
+    qint64 mBufferOffset;
+    int mPos;
+    int mLiteralStart;
+
+    quint32 mChecksum;
+    bool mChecksumValid;
+
+    qint64 mCopyOffset;
+    qint64 mCopyLength;
+
+    QByteArray mOps;
+    qint64 mOpsBytes;
+};
+
+#endif // LIBNITROSHARE_DELTAENCODER_P_H
@@ -0,0 +1,178 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <cstring>
+
+#include <QtEndian>
+
+#include "digest_p.h"
+
+// Primes used by XXH64
+const quint64 Prime1 = 11400714785074694791ULL;
+const quint64 Prime2 = 14029467366897019727ULL;
+const quint64 Prime3 = 1609587929392839161ULL;
+const quint64 Prime4 = 9650029242287828579ULL;
+const quint64 Prime5 = 2870177450012600261ULL;
+
+// Size of the blocks consumed by the four XXH64 lanes
+const int StripeSize = 32;
+
+static inline quint64 rotateLeft(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline quint64 mixLane(quint64 acc, quint64 input)
+{
+    acc += input * Prime2;
+    acc = rotateLeft(acc, 31);
+    return acc * Prime1;
+}
+
+static inline quint64 mergeRound(quint64 acc, quint64 value)
+{
+    acc ^= mixLane(0, value);
+    return acc * Prime1 + Prime4;
+}
+
+Digest::Method Digest::fromName(const QString &name)
+{
+    if (name == "xxh64") {
+        return Xxh64;
+    }
+    if (name == "sha256") {
+        return Sha256;
+    }
+    return None;
+}
+
+QString Digest::name(Method method)
+{
+    switch (method) {
+    case Xxh64:
+        return "xxh64";
+    case Sha256:
+        return "sha256";
+    default:
+        return QString();
+    }
+}
+
+Digest::Digest(Method method)
+    : mMethod(method),
+      mHash(QCryptographicHash::Sha256),
+      mLanes{ Prime1 + Prime2, Prime2, 0, 0 - Prime1 },
+      mLength(0),
+      mBufferSize(0)
+{
+}
+
+void Digest::addData(const QByteArray &data)
+{
+    if (mMethod == Sha256) {
+        mHash.addData(data);
+        return;
+    }
+
+    const uchar *pos = reinterpret_cast<const uchar*>(data.constData());
+    const uchar *end = pos + data.size();
+    mLength += data.size();
+
+    // Complete a stripe left over from the previous call
+    if (mBufferSize) {
+        int length = qMin<int>(StripeSize - mBufferSize, end - pos);
+        memcpy(mBuffer + mBufferSize, pos, length);
+        mBufferSize += length;
+        pos += length;
+        if (mBufferSize < StripeSize) {
+            return;
+        }
+        processStripe(mBuffer);
+        mBufferSize = 0;
+    }
+
+    // The lanes are independent so the compiler can interleave them
+    while (end - pos >= StripeSize) {
+        processStripe(pos);
+        pos += StripeSize;
+    }
+
+    memcpy(mBuffer, pos, end - pos);
+    mBufferSize = end - pos;
+}
+
+QByteArray Digest::result()
+{
+    if (mMethod == Sha256) {
+        return mHash.result();
+    }
+
+    quint64 hash;
+    if (mLength >= static_cast<quint64>(StripeSize)) {
+        hash = rotateLeft(mLanes[0], 1) + rotateLeft(mLanes[1], 7) +
+                rotateLeft(mLanes[2], 12) + rotateLeft(mLanes[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            hash = mergeRound(hash, mLanes[i]);
+        }
+    } else {
+        hash = Prime5;
+    }
+    hash += mLength;
+
+    // Mix in whatever did not fill a complete stripe
+    const uchar *pos = mBuffer;
+    const uchar *end = mBuffer + mBufferSize;
+    for (; end - pos >= 8; pos += 8) {
+        hash ^= mixLane(0, qFromLittleEndian<quint64>(pos));
+        hash = rotateLeft(hash, 27) * Prime1 + Prime4;
+    }
+    if (end - pos >= 4) {
+        hash ^= static_cast<quint64>(qFromLittleEndian<quint32>(pos)) * Prime1;
+        hash = rotateLeft(hash, 23) * Prime2 + Prime3;
+        pos += 4;
+    }
+    for (; pos < end; ++pos) {
+        hash ^= *pos * Prime5;
+        hash = rotateLeft(hash, 11) * Prime1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= Prime2;
+    hash ^= hash >> 29;
+    hash *= Prime3;
+    hash ^= hash >> 32;
+
+    // The canonical representation is big-endian
+    QByteArray digest(sizeof(quint64), 0);
+    qToBigEndian<quint64>(hash, reinterpret_cast<uchar*>(digest.data()));
+    return digest;
+}
+
+void Digest::processStripe(const uchar *data)
+{
+    mLanes[0] = mixLane(mLanes[0], qFromLittleEndian<quint64>(data));
+    mLanes[1] = mixLane(mLanes[1], qFromLittleEndian<quint64>(data + 8));
+    mLanes[2] = mixLane(mLanes[2], qFromLittleEndian<quint64>(data + 16));
+    mLanes[3] = mixLane(mLanes[3], qFromLittleEndian<quint64>(data + 24));
+}
@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_DIGEST_P_H
+#define LIBNITROSHARE_DIGEST_P_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QString>
+
+/*
+ * Incremental digest of item content used to verify it after transfer -
+ * XXH64 is fast enough to keep up with the network while SHA-256 guards
+ * against deliberate tampering as well as corruption
+ */
+class Digest
+{
+public:
+
+    enum Method {
+        None = 0,
+        Xxh64,
+        Sha256
+    };
+
+    static Method fromName(const QString &name);
+    static QString name(Method method);
+
+    explicit Digest(Method method);
+
+    void addData(const QByteArray &data);
+    QByteArray result();
+
+private:
+
+    Q_DISABLE_COPY(Digest)
+
+    void processStripe(const uchar *data);
+
+    Method mMethod;
+    QCryptographicHash mHash;
+
+    quint64 mLanes[4];
+    quint64 mLength;
+    uchar mBuffer[32];
+    int mBufferSize;
+};
+
+#endif // LIBNITROSHARE_DIGEST_P_H
@@ -24,27 +24,18 @@
 
 #include <nitroshare/packet.h>
 
-#include "packet_p.h"
-
-PacketPrivate::PacketPrivate(QObject *parent, Packet::Type type, const QByteArray &content)
-    : QObject(parent),
-      type(type),
-      content(content)
-{
-}
-
-Packet::Packet(Type type, const QByteArray &content, QObject *parent)
-    : QObject(parent),
-      d(new PacketPrivate(this, type, content))
+Packet::Packet(Type type, const QByteArray &content)
+    : mType(type),
+      mContent(content)
 {
 }
 
 Packet::Type Packet::type() const
 {
-    return d->type;
+    return mType;
 }
 
-QByteArray Packet::content() const
+const QByteArray &Packet::content() const
 {
-    return d->content;
+    return mContent;
 }
@@ -0,0 +1,211 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <QMutexLocker>
+
+#include <nitroshare/item.h>
+
+#include "readahead_p.h"
+
+ReadAhead::ReadAhead(qint64 capacity)
+    : mCapacity(capacity),
+      mBytesBuffered(0),
+      mBusyItem(nullptr),
+      mStopping(false)
+{
+    start();
+}
+
+ReadAhead::~ReadAhead()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mStopping = true;
+        mQueued.wakeOne();
+    }
+    wait();
+
+    // Close any items that were opened but never sent
+    foreach (Entry *entry, mEntries) {
+        if (entry->state == Opened) {
+            entry->item->close();
+        }
+    }
+    qDeleteAll(mEntries);
+}
+
+void ReadAhead::prefetch(Item *item, bool buffered)
+{
+    QMutexLocker locker(&mMutex);
+    mEntries.append(new Entry{
+        item, Pending, buffered, false, !buffered || item->size() <= 0, 0, QQueue<QByteArray>()
+    });
+    mQueued.wakeOne();
+}
+
+bool ReadAhead::contains(Item *item)
+{
+    QMutexLocker locker(&mMutex);
+    return find(item);
+}
+
+bool ReadAhead::open(Item *item)
+{
+    QMutexLocker locker(&mMutex);
+    Entry *entry = find(item);
+    while (entry->state == Pending) {
+        mRead.wait(&mMutex);
+    }
+    return entry->state == Opened;
+}
+
+bool ReadAhead::isSeekable(Item *item)
+{
+    QMutexLocker locker(&mMutex);
+    return find(item)->seekable;
+}
+
+QByteArray ReadAhead::read(Item *item)
+{
+    QMutexLocker locker(&mMutex);
+    Entry *entry = find(item);
+
+    // Items that were only opened ahead of time are read directly
+    if (!entry->buffered) {
+        locker.unlock();
+        return item->read();
+    }
+
+    while (entry->blocks.isEmpty() && (entry->state == Pending ||
+            (entry->state == Opened && !entry->atEnd))) {
+        mRead.wait(&mMutex);
+    }
+    if (entry->blocks.isEmpty()) {
+        return QByteArray();
+    }
+
+    // Reading can continue now that there is room in the buffer
+    QByteArray data = entry->blocks.dequeue();
+    mBytesBuffered -= data.size();
+    mQueued.wakeOne();
+    return data;
+}
+
+void ReadAhead::close(Item *item)
+{
+    bool opened;
+    {
+        QMutexLocker locker(&mMutex);
+
+        // The item cannot be closed while a read is in progress
+        while (mBusyItem == item) {
+            mRead.wait(&mMutex);
+        }
+
+        Entry *entry = find(item);
+        foreach (const QByteArray &data, entry->blocks) {
+            mBytesBuffered -= data.size();
+        }
+        opened = entry->state == Opened;
+        mEntries.removeOne(entry);
+        delete entry;
+        mQueued.wakeOne();
+    }
+
+    if (opened) {
+        item->close();
+    }
+}
+
+void ReadAhead::run()
+{
+    forever {
+        Entry *entry = nullptr;
+        State state;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!mStopping && !(entry = next())) {
+                mQueued.wait(&mMutex);
+            }
+            if (mStopping) {
+                return;
+            }
+            state = entry->state;
+            mBusyItem = entry->item;
+        }
+
+        // Open items ahead of time so that they are ready by the time the
+        // previous item has been sent, otherwise read the next block
+        if (state == Pending) {
+            bool opened = entry->item->open(Item::Read);
+            bool seekable = opened && entry->item->seek(0);
+
+            QMutexLocker locker(&mMutex);
+            entry->state = opened ? Opened : Failed;
+            entry->seekable = seekable;
+        } else {
+            QByteArray data = entry->item->read();
+
+            QMutexLocker locker(&mMutex);
+            if (data.isEmpty()) {
+                entry->atEnd = true;
+            } else {
+                entry->blocks.enqueue(data);
+                entry->bytesRead += data.size();
+                entry->atEnd = entry->bytesRead >= entry->item->size();
+                mBytesBuffered += data.size();
+            }
+        }
+
+        QMutexLocker locker(&mMutex);
+        mBusyItem = nullptr;
+        mRead.wakeAll();
+    }
+}
+
+ReadAhead::Entry *ReadAhead::find(Item *item)
+{
+    foreach (Entry *entry, mEntries) {
+        if (entry->item == item) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+ReadAhead::Entry *ReadAhead::next()
+{
+    // Items are read in order until the buffer fills up, at which point the
+    // remaining items are still opened so they are ready to go
+    foreach (Entry *entry, mEntries) {
+        if (entry->state == Pending) {
+            return entry;
+        }
+        if (entry->state == Opened && !entry->atEnd && mBytesBuffered < mCapacity) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
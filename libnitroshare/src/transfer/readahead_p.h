@@ -0,0 +1,99 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef LIBNITROSHARE_READAHEAD_P_H
+#define LIBNITROSHARE_READAHEAD_P_H
+
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+class Item;
+
+/*
+ * Reads items that are about to be sent on its own thread so that opening
+ * files and reading from a slow or cold disk does not hold up the network -
+ * items are opened in the order they were queued and blocks of buffered items
+ * are read ahead until the buffer is full
+ */
+class ReadAhead : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    explicit ReadAhead(qint64 capacity);
+    virtual ~ReadAhead();
+
+    void prefetch(Item *item, bool buffered);
+    bool contains(Item *item);
+
+    bool open(Item *item);
+    bool isSeekable(Item *item);
+    QByteArray read(Item *item);
+    void close(Item *item);
+
+protected:
+
+    virtual void run();
+
+private:
+
+    enum State {
+        Pending,
+        Opened,
+        Failed
+    };
+
+    struct Entry
+    {
+        Item *item;
+        State state;
+        bool buffered;
+        bool seekable;
+        bool atEnd;
+        qint64 bytesRead;
+        QQueue<QByteArray> blocks;
+    };
+
+    Entry *find(Item *item);
+    Entry *next();
+
+    qint64 mCapacity;
+
+    QMutex mMutex;
+    QWaitCondition mQueued;
+    QWaitCondition mRead;
+
+    QList<Entry*> mEntries;
+    qint64 mBytesBuffered;
+    Item *mBusyItem;
+    bool mStopping;
+};
+
+#endif // LIBNITROSHARE_READAHEAD_P_H
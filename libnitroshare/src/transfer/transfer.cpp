@@ -24,14 +24,22 @@
 
 #include <cstring>
 
+#include <QCryptographicHash>
 #include <QDateTime>
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonParseError>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QThread>
+#include <QUuid>
 #include <QtEndian>
 
 #include <nitroshare/application.h>
 #include <nitroshare/bundle.h>
+#include <nitroshare/cborutil.h>
+#include <nitroshare/deltautil.h>
 #include <nitroshare/device.h>
 #include <nitroshare/handler.h>
 #include <nitroshare/handlerregistry.h>
@@ -40,249 +48,1911 @@
 #include <nitroshare/logger.h>
 #include <nitroshare/message.h>
 #include <nitroshare/packet.h>
+#include <nitroshare/qtutil.h>
+#include <nitroshare/settingsregistry.h>
 #include <nitroshare/transfer.h>
 #include <nitroshare/transfermodel.h>
 #include <nitroshare/transport.h>
 #include <nitroshare/transportserverregistry.h>
 
+#include "deltaencoder_p.h"
+#include "phasetimer_p.h"
 #include "transfer_p.h"
+#include "transferjournal_p.h"
+#include "transfermodel_p.h"
+#include "readahead_p.h"
+#include "transferworkerpool_p.h"
+#include "writebehind_p.h"
 
 const QString MessageTag = "transfer";
 
 // Interval for calculating transfer speed
 const qint64 SpeedInterval = 1000;
 
+// Time to wait for the receiver to acknowledge requested features before
+// assuming that it only understands the legacy protocol
+const int NegotiationTimeout = 2000;
+
+// Upper limit on the number of streams used by a single transfer
+const int MaxStreams = 16;
+
+// Bundles at least this large are sent on a connection of their own rather
+// than one shared with other transfers
+const qint64 DedicatedTransportSize = 16777216;
+
+// Feature names used during negotiation
+const QString StreamsFeature = "streams";
+const QString StripesFeature = "stripes";
+const QString ResumeFeature = "resume";
+const QString DeltaFeature = "delta";
+const QString CompressionFeature = "compression";
+const QString BatchFeature = "batch";
+const QString CborFeature = "cbor";
+const QString DigestFeature = "digest";
+
+// Number of blocks sent uncompressed after a block fails to shrink
+const int CompressionBackoff = 16;
+
+// Minimum number of small items in a bundle for batches to be worthwhile
+const int MinBatchItems = 16;
+
+// Limits on the number of items and amount of content in a single batch
+const int MaxBatchItems = 1024;
+const int MaxBatchSize = 1048576;
+
+// Number of items ahead of the one being sent that are opened in advance
+const int PrefetchItems = 16;
+
+// Amount of file data sent in each packet when it is not copied
+const qint64 SendFileBlockSize = 1048576;
+
+// Smallest packet size limit that may be set - the largest chunks and
+// batches sent by this code must always fit
+const qint64 MinMaxPacketSize = 4194304;
+
+// Minimum number of items in a bundle for binary headers to be worthwhile
+const int MinCborItems = 64;
+
+// Transfers no larger than this are given priority over the others
+const qint64 InteractiveSize = 1048576;
+
+PendingStream::PendingStream(Transport *transport)
+    : QObject(transport)
+{
+    connect(transport, &Transport::packetReceived, this, [this](const Packet &packet) {
+        packets.append(packet);
+    });
+}
+
+qint64 TransferPrivate::Stripe::addRange(qint64 offset, qint64 length)
+{
+    if (length <= 0) {
+        return 0;
+    }
+
+    // Merge the new range with any that it overlaps or touches, subtracting
+    // the bytes that were already received
+    qint64 start = offset;
+    qint64 end = offset + length;
+    qint64 bytesAdded = length;
+    auto i = ranges.upperBound(offset);
+    if (i != ranges.begin() && (i - 1).value() >= offset) {
+        --i;
+    }
+    while (i != ranges.end() && i.key() <= offset + length) {
+        bytesAdded -= qMax<qint64>(0, qMin(i.value(), offset + length) - qMax(i.key(), offset));
+        start = qMin(start, i.key());
+        end = qMax(end, i.value());
+        i = ranges.erase(i);
+    }
+    ranges.insert(start, end);
+
+    bytesTransferred += bytesAdded;
+    return bytesAdded;
+}
+
+TransferPrivate::Stream::Stream(Transport *transport)
+    : transport(transport),
+      protocolState(TransferHeader),
+      currentItem(nullptr),
+      currentItemIndex(-1),
+      currentItemBytesTransferred(0),
+      currentItemBytesTotal(0),
+      stripeIndex(-1),
+      deltaEncoder(nullptr),
+      compressionBackoff(0),
+      digest(nullptr),
+      receivingFile(false)
+{
+}
+
+TransferPrivate::Stream::~Stream()
+{
+    delete deltaEncoder;
+    delete digest;
+}
+
 TransferPrivate::TransferPrivate(Transfer *transfer,
                                  Application *application,
                                  Device *device,
                                  Transport *transport,
                                  Bundle *bundle)
-    : QObject(transfer),
-      q(transfer),
+    : q(transfer),
       mApplication(application),
-      mTransport(transport),
+      mModel(application->transferModel()->d),
+      mPool(&application->transferModel()->d->workerPool),
+      mGovernor(&application->transferModel()->d->governor),
+      mMainThread(QThread::currentThread()),
+      mStatusPending(false),
+      mDevice(device),
+      mDeviceUuid(device ? device->uuid() : QString()),
+      mPriority(bundle && bundle->totalSize() <= InteractiveSize ?
+          Transfer::Interactive : Transfer::Normal),
+      mStarted(false),
       mBundle(bundle),
-      mProtocolState(TransferHeader),
+      mStreamCount(1),
+      mNegotiationTimer(this),
+      mActiveStripe(-1),
+      mStripeThreshold(application->settingsRegistry()->value(
+          Application::TransferStripeThresholdSettingName).toLongLong()),
+      mJournal(nullptr),
+      mResumeThreshold(application->settingsRegistry()->value(
+          Application::TransferResumeThresholdSettingName).toLongLong()),
+      mDeltaThreshold(application->settingsRegistry()->value(
+          Application::TransferDeltaThresholdSettingName).toLongLong()),
+      mCompressionEnabled(application->settingsRegistry()->value(
+          Application::TransferCompressionSettingName).toBool()),
+      mCompression(Compression::None),
+      mBatchThreshold(application->settingsRegistry()->value(
+          Application::TransferBatchThresholdSettingName).toLongLong()),
+      mDigest(device ? Digest::fromName(application->settingsRegistry()->value(
+          Application::TransferDigestSettingName).toString()) : Digest::None),
+      mZeroCopy(application->settingsRegistry()->value(
+          Application::TransferZeroCopySettingName).toBool()),
+      mMaxPacketSize(qMax(MinMaxPacketSize, application->settingsRegistry()->value(
+          Application::TransferMaxPacketSizeSettingName).toLongLong())),
+      mPeerMaxPacketSize(0),
       mDirection(device ? Transfer::Send : Transfer::Receive),
-      mState(device ? Transfer::Connecting : Transfer::InProgress),
+      mState(device ? Transfer::Queued : Transfer::InProgress),
+      mPausedState(mState),
       mProgress(0),
       mDeviceName(device ? device->name() : tr("[unknown]")),
       mItemIndex(0),
       mItemCount(bundle ? bundle->rowCount() : 0),
       mBytesTransferred(0),
       mBytesTotal(bundle ? bundle->totalSize() : 0),
-      mCurrentItem(nullptr),
-      mCurrentItemBytesTransferred(0),
-      mCurrentItemBytesTotal(0),
+      mHighWatermark(application->settingsRegistry()->value(
+          Application::TransferHighWatermarkSettingName).toLongLong()),
+      mLowWatermark(application->settingsRegistry()->value(
+          Application::TransferLowWatermarkSettingName).toLongLong()),
+      mLimitKey(mDeviceUuid),
+      mThrottleTimer(this),
+      mReadAhead(nullptr),
+      mPrefetchIndex(0),
+      mWriteBehind(nullptr),
+      mStats(),
       mSpeed(0),
+      mSpeedTimer(this),
       mLastInterval(QDateTime::currentMSecsSinceEpoch()),
       mLastIntervalBytesTransferred(0)
 {
+    qRegisterMetaType<Message*>("Message*");
+    qRegisterMetaType<Packet>("Packet");
+    qRegisterMetaType<Transport*>("Transport*");
+
+    mStatus = mPublished = currentStatus();
+
+    // Changes made on the worker thread are published on the main thread
+    connect(this, &TransferPrivate::statusChanged, q, [this]() {
+        publishStatus();
+    }, Qt::QueuedConnection);
+
+    // Transports are created and streams matched to transfers on the main
+    // thread since the registries and the model live there
+    connect(this, &TransferPrivate::streamsRequested, q, [this](int count) {
+        openStreams(count);
+    });
+    connect(this, &TransferPrivate::streamReceived, q, [this](const QString &id, Transport *transport) {
+        mApplication->transferModel()->d->joinStream(id, transport, q);
+    });
+
     connect(&mSpeedTimer, &QTimer::timeout, this, &TransferPrivate::onTimeout);
 
-    if (mDirection == Transfer::Send) {
+    SettingsRegistry *registry = application->settingsRegistry();
+    mThrottleTimer.setSingleShot(true);
+    connect(&mThrottleTimer, &QTimer::timeout, this, &TransferPrivate::onThrottleTimeout);
 
-        // Use the device to attempt to create a transport
-        mTransport = application->transportServerRegistry()->createTransport(device);
-        if (!mTransport) {
-            setError(tr("unable to create \"%1\" transport").arg(device->transportName()));
-            return;
-        }
-        connect(mTransport, &Transport::connected, this, &TransferPrivate::onConnected);
+    // Items being sent are opened and read ahead on a separate thread so
+    // that the disk and the network are kept busy at the same time
+    qint64 readAhead = registry->value(Application::TransferReadAheadSettingName).toLongLong();
+    if (mDirection == Transfer::Send && readAhead > 0) {
+        mReadAhead = new ReadAhead(readAhead);
+    }
+
+    // Received data is written on a separate thread so that reading from the
+    // network and writing to disk overlap
+    qint64 writeBuffer = registry->value(Application::TransferWriteBufferSettingName).toLongLong();
+    if (mDirection == Transfer::Receive && writeBuffer > 0) {
+        mWriteBehind = new WriteBehind(writeBuffer);
+        connect(mWriteBehind, &WriteBehind::itemsClosed, this, &TransferPrivate::onItemsClosed);
+        connect(mWriteBehind, &WriteBehind::drained, this, &TransferPrivate::onWritesDrained);
+        connect(mWriteBehind, &WriteBehind::seekFailed, this, [this](const QString &name) {
+            if (isFinished()) {
+                return;
+            }
+            setError(tr("unable to seek in \"%1\"").arg(name), true);
+        });
+    }
+
+    mNegotiationTimer.setSingleShot(true);
+    mNegotiationTimer.setInterval(NegotiationTimeout);
+    connect(&mNegotiationTimer, &QTimer::timeout, this, &TransferPrivate::onNegotiationTimeout);
+
+    if (mDirection == Transfer::Send) {
 
         // Ensure the bundle is freed when the transfer is destroyed
         mBundle->setParent(this);
+
+        // The receiver uses the ID to match additional streams to the transfer
+        mId = QUuid::createUuid().toString();
+        mStreamCount = qBound(1, application->settingsRegistry()->value(
+            Application::TransferStreamsSettingName).toInt(), MaxStreams);
     } else {
         mSpeedTimer.start(SpeedInterval);
+        addStream(transport);
+    }
+
+    // Move the transfer (along with its transport, bundle, and timers) to
+    // one of the worker threads if they are enabled
+    QThread *thread = mPool->acquire(application->settingsRegistry()->value(
+        Application::TransferWorkerThreadsSettingName).toInt());
+    if (thread) {
+        moveToThread(thread);
+    }
+
+    // Unless the number of active transfers is limited, there is no need to
+    // wait for the model to start the transfer
+    if (mDirection == Transfer::Send && !mModel->isQueueing()) {
+        start();
+    }
+}
+
+TransferPrivate::~TransferPrivate()
+{
+    // Stop reading ahead and finish any outstanding writes before the items
+    // are freed
+    delete mReadAhead;
+    if (mWriteBehind) {
+        delete mWriteBehind;
+        qDeleteAll(mClosingItems.keys());
+    }
+
+    // The transports are children of this object and freed with it
+    qDeleteAll(mStreams);
+    delete mJournal;
+
+    if (thread() != mMainThread) {
+        mPool->release(thread());
+    }
+}
+
+TransferPrivate::Stream *TransferPrivate::addStream(Transport *transport)
+{
+    Stream *stream = new Stream(transport);
+    mStreams.append(stream);
+
+    // Ensure the transport is freed when the transfer is destroyed
+    transport->setParent(this);
+    transport->setMaxPacketSize(mMaxPacketSize);
+
+    connect(transport, &Transport::connected, this, [this, stream]() {
+        onConnected(stream);
+    });
+    connect(transport, &Transport::packetReceived, this, [this, stream](const Packet &packet) {
+        qint64 bytesTransferred = mLastIntervalBytesTransferred;
+        onPacketReceived(stream, packet);
+        throttleReceive(mLastIntervalBytesTransferred - bytesTransferred);
+    });
+    connect(transport, &Transport::fileReceived, this, [this, stream](qint64 length) {
+        qint64 bytesTransferred = mLastIntervalBytesTransferred;
+        onFileReceived(stream, length);
+        throttleReceive(mLastIntervalBytesTransferred - bytesTransferred);
+    });
+    connect(transport, &Transport::packetSent, this, [this, stream]() {
+        onPacketSent(stream);
+    });
+    connect(transport, &Transport::error, this, [this, stream](const QString &message) {
+        onError(stream, message);
+    });
+
+    return stream;
+}
+
+void TransferPrivate::removeStream(Stream *stream)
+{
+    // The caller becomes responsible for the transport
+    disconnect(stream->transport, nullptr, this, nullptr);
+    mStreams.removeOne(stream);
+    delete stream;
+}
+
+void TransferPrivate::openStreams(int count)
+{
+    // The device may have disappeared since the transfer was started, in
+    // which case the transfer simply continues with a single stream
+    if (!mDevice) {
+        return;
+    }
+
+    // Additional streams are only useful if they do not share a connection
+    for (int i = 1; i < count; ++i) {
+        Transport *transport = mApplication->transportServerRegistry()->createDedicatedTransport(mDevice);
+        if (!transport) {
+            break;
+        }
+        transport->moveToThread(thread());
+        QMetaObject::invokeMethod(this, "onStreamOpened", Q_ARG(Transport*, transport));
+    }
+}
+
+void TransferPrivate::start()
+{
+    mStarted = true;
+
+    // Use the device to attempt to create a transport
+    Transport *transport = nullptr;
+    if (mDevice) {
+        TransportServerRegistry *registry = mApplication->transportServerRegistry();
+        transport = mBundle->totalSize() >= DedicatedTransportSize ?
+            registry->createDedicatedTransport(mDevice) : registry->createTransport(mDevice);
+        if (!transport) {
+            QMetaObject::invokeMethod(this, "onStartFailed", Q_ARG(QString,
+                tr("unable to create \"%1\" transport").arg(mDevice->transportName())));
+            return;
+        }
+    } else {
+        QMetaObject::invokeMethod(this, "onStartFailed", Q_ARG(QString, tr("device is no longer available")));
+        return;
+    }
+
+    transport->moveToThread(thread());
+    QMetaObject::invokeMethod(this, "onStarted", Q_ARG(Transport*, transport));
+}
+
+void TransferPrivate::handOver(Transport *transport, const char *method)
+{
+    transport->moveToThread(thread());
+    QMetaObject::invokeMethod(this, method, Q_ARG(Transport*, transport));
+}
+
+bool TransferPrivate::isFinished() const
+{
+    return mState == Transfer::Failed || mState == Transfer::Succeeded;
+}
+
+bool TransferPrivate::acceptsStream(const QString &id)
+{
+    QMutexLocker locker(&mStatusMutex);
+    return !mStatus.streamId.isEmpty() && mStatus.streamId == id &&
+            mStatus.state != Transfer::Failed && mStatus.state != Transfer::Succeeded;
+}
+
+TransferPrivate::Status TransferPrivate::currentStatus() const
+{
+    return {
+        mState,
+        mProgress,
+        mSpeed,
+        mBytesTotal - mBytesTransferred,
+        mDeviceName,
+        mError,
+        mFeatures.contains(StreamsFeature) ? mId : QString(),
+        writeStats()
+    };
+}
+
+TransferPrivate::Stats TransferPrivate::writeStats() const
+{
+    // Writes performed on the disk thread are counted there
+    Stats stats = mStats;
+    if (mWriteBehind) {
+        mWriteBehind->addStats(stats.writeTime, stats.writeBytes, stats.writeCount);
+    }
+    return stats;
+}
+
+void TransferPrivate::notify()
+{
+    {
+        QMutexLocker locker(&mStatusMutex);
+        mStatus = currentStatus();
+
+        // A flush is already on its way to the main thread and will pick up
+        // this change as well
+        if (mStatusPending) {
+            return;
+        }
+        mStatusPending = true;
+    }
+
+    if (QThread::currentThread() == mMainThread) {
+        publishStatus();
+    } else {
+        emit statusChanged();
+    }
+}
+
+void TransferPrivate::publishStatus()
+{
+    Status oldStatus = mPublished;
+    {
+        QMutexLocker locker(&mStatusMutex);
+        mPublished = mStatus;
+        mStatusPending = false;
+    }
+
+    // Signals are only emitted for properties that actually changed, with
+    // the state last so that observers see the final values of the others
+    if (mPublished.deviceName != oldStatus.deviceName) {
+        emit q->deviceNameChanged(mPublished.deviceName);
+    }
+    if (mPublished.progress != oldStatus.progress) {
+        emit q->progressChanged(mPublished.progress);
+    }
+    if (mPublished.speed != oldStatus.speed) {
+        emit q->speedChanged(mPublished.speed);
+    }
+    if (mPublished.error != oldStatus.error) {
+        emit q->errorChanged(mPublished.error);
+    }
+    if (mPublished.state != oldStatus.state) {
+        emit q->stateChanged(mPublished.state);
+    }
+}
+
+void TransferPrivate::log(Message::Type type, const QString &message)
+{
+    // The logger lives on the main thread and takes ownership of the message
+    Logger *logger = mApplication->logger();
+    Message *object = new Message(type, MessageTag, message);
+    object->moveToThread(logger->thread());
+    QMetaObject::invokeMethod(logger, "log", Q_ARG(Message*, object));
+}
+
+QString TransferPrivate::resumeKey() const
+{
+    // The key identifies the bundle - if any of the items change, the
+    // receiver will not find a journal and the transfer starts over
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(mApplication->deviceUuid().toUtf8());
+    for (int i = 0; i < mItemCount; ++i) {
+        Item *item = mBundle->index(i, 0).data(Qt::UserRole).value<Item*>();
+        hash.addData(QJsonDocument(JsonUtil::objectToJson(item)).toJson(QJsonDocument::Compact));
+    }
+    return hash.result().toHex();
+}
+
+void TransferPrivate::skipItems()
+{
+    // Items the receiver already has from a previous attempt are not sent
+    while (mItemIndex < mItemCount && mResumeCompleted.contains(mItemIndex)) {
+        ++mItemIndex;
+    }
+}
+
+bool TransferPrivate::isDeltaItem(Item *item) const
+{
+    return mFeatures.contains(DeltaFeature) && item->size() >= mDeltaThreshold;
+}
+
+bool TransferPrivate::isBatchItem(Item *item, qint32 index) const
+{
+    return mFeatures.contains(BatchFeature) &&
+            item->size() <= qMin<qint64>(mBatchThreshold, MaxBatchSize) &&
+            !mResumeOffsets.contains(index) && !isDeltaItem(item);
+}
+
+QByteArray TransferPrivate::encodeHeader(const QVariantMap &header) const
+{
+    if (mFeatures.contains(CborFeature)) {
+        return CborUtil::encode(header);
+    }
+
+    // JSON numbers cannot hold every 64-bit integer, so strings are used
+    QJsonObject object;
+    for (auto i = header.constBegin(); i != header.constEnd(); ++i) {
+        if (i.value().type() == QVariant::LongLong) {
+            object.insert(i.key(), QString::number(i.value().toLongLong()));
+        } else {
+            object.insert(i.key(), QJsonValue::fromVariant(i.value()));
+        }
+    }
+    return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+bool TransferPrivate::decodeHeader(const QByteArray &data, bool cbor, QVariantMap &header)
+{
+    // Binary headers decode directly into the map used to create items
+    if (cbor) {
+        bool ok = false;
+        QVariant value = CborUtil::decode(data, &ok);
+        if (!ok || value.type() != QVariant::Map) {
+            setError(tr("protocol error - invalid item header"), true);
+            return false;
+        }
+        header = value.toMap();
+        return true;
+    }
+
+    QJsonParseError error;
+    QJsonObject object = QJsonDocument::fromJson(data, &error).object();
+    if (error.error != QJsonParseError::NoError) {
+        setError(QString("item header: %1").arg(error.errorString()), true);
+        return false;
+    }
+    header = object.toVariantMap();
+    return true;
+}
+
+bool TransferPrivate::checkSpace()
+{
+    // Items without a type are files, which is where nearly all of the data
+    // in a transfer ends up - reject the transfer now rather than partway
+    Handler *handler = mApplication->handlerRegistry()->find("file");
+    qint64 bytesAvailable = handler ? handler->bytesAvailable() : -1;
+    qint64 bytesRequired = mBytesTotal - mBytesTransferred;
+    if (bytesAvailable >= 0 && bytesRequired > bytesAvailable) {
+        setError(tr("not enough space to receive %1 bytes (%2 available)")
+            .arg(bytesRequired).arg(bytesAvailable), true);
+        return false;
+    }
+    return true;
+}
+
+Item *TransferPrivate::createItem(const QVariantMap &header)
+{
+    // In order to maintain compatibility with legacy versions (which is very
+    // desirable), if "type" is not in the object, assume "file" unless
+    // "directory" is present (in which case, use that)
+    QString type;
+    if (header.contains("type")) {
+        type = header.value("type").toString();
+    } else {
+        if (header.contains("directory")) {
+            type = "directory";
+        } else {
+            type = "file";
+        }
+    }
+
+    // Attempt to locate a handler for the type
+    Handler *handler = mApplication->handlerRegistry()->find(type);
+    if (!handler) {
+        setError(tr("unrecognized item type \"%1\"").arg(type), true);
+        return nullptr;
+    }
+
+    // Use the handler to create the item
+    Item *item = handler->createItem(type, header);
+    item->setParent(this);
+    return item;
+}
+
+bool TransferPrivate::canSendFile(Stream *stream) const
+{
+    // The content has to pass through memory in order to compress it or to
+    // compute its digest
+    return mZeroCopy && mCompression == Compression::None &&
+            !mFeatures.contains(DigestFeature) && stream->transport->canSendFile();
+}
+
+bool TransferPrivate::sendFileBlock(Stream *stream, Item *item, Packet::Type type,
+                                    const QByteArray &prefix, qint64 offset, qint64 length)
+{
+    if (!canSendFile(stream) || item->handle() == -1) {
+        return false;
+    }
+
+    length = qMin(length, SendFileBlockSize);
+    stream->transport->sendFile(type, prefix, item->handle(), offset, length);
+
+    mBytesTransferred += length;
+    stream->currentItemBytesTransferred += length;
+    mLastIntervalBytesTransferred += length;
+    return true;
+}
+
+void TransferPrivate::prefetchItems()
+{
+    if (!mReadAhead) {
+        return;
+    }
+
+    // Items resumed at an offset or sent as a delta are not read in order
+    // from the start, so they are left to be opened when they are sent
+    mPrefetchIndex = qMax(mPrefetchIndex, mItemIndex);
+    while (mPrefetchIndex < mItemCount && mPrefetchIndex < mItemIndex + PrefetchItems) {
+        Item *item = mBundle->index(mPrefetchIndex, 0).data(Qt::UserRole).value<Item*>();
+        if (!mResumeCompleted.contains(mPrefetchIndex) &&
+                !mResumeOffsets.contains(mPrefetchIndex) && !isDeltaItem(item)) {
+            mReadAhead->prefetch(item, !canSendFile(mStreams.first()));
+        }
+        ++mPrefetchIndex;
+    }
+}
+
+bool TransferPrivate::openItem(Item *item)
+{
+    if (mReadAhead && mReadAhead->contains(item)) {
+        return mReadAhead->open(item);
+    }
+    return item->open(Item::Read);
+}
+
+bool TransferPrivate::rewindItem(Item *item)
+{
+    // Items read ahead were already rewound when they were opened
+    if (mReadAhead && mReadAhead->contains(item)) {
+        return mReadAhead->isSeekable(item);
+    }
+    return item->seek(0);
+}
+
+QByteArray TransferPrivate::readItem(Item *item)
+{
+    PhaseTimer timer(mStats.readTime);
+    QByteArray data = mReadAhead && mReadAhead->contains(item) ?
+            mReadAhead->read(item) : item->read();
+    mStats.readBytes += data.size();
+    ++mStats.readCount;
+    return data;
+}
+
+void TransferPrivate::closeItem(Item *item)
+{
+    if (mReadAhead && mReadAhead->contains(item)) {
+        mReadAhead->close(item);
+    } else {
+        item->close();
+    }
+}
+
+void TransferPrivate::writeItem(Item *item, const QByteArray &data)
+{
+    PhaseTimer timer(mStats.writeTime);
+    item->write(data);
+    mStats.writeBytes += data.size();
+    ++mStats.writeCount;
+}
+
+void TransferPrivate::writeItemLater(Item *item, qint64 offset, const QByteArray &data, bool seek)
+{
+    mWriteBehind->write(item, offset, data, seek);
+
+    // Stop reading from the peer until the disk catches up
+    if (mWriteBehind->isFull()) {
+        foreach (Stream *stream, mStreams) {
+            stream->transport->setReadPaused(true);
+        }
+    }
+}
+
+void TransferPrivate::finishItem(Item *item, qint32 index, qint64 size)
+{
+    // The item is closed on the disk thread once its data is written and
+    // only recorded as complete after that
+    if (mWriteBehind) {
+        mClosingItems.insert(item, qMakePair(index, size));
+        mWriteBehind->close(item);
+        return;
+    }
+
+    item->close();
+    delete item;
+
+    if (mJournal && index != -1) {
+        mJournal->setCompleted(index, size);
+    }
+}
+
+void TransferPrivate::flushWrites()
+{
+    if (mWriteBehind) {
+        mWriteBehind->flush();
+        onItemsClosed();
     }
+}
+
+bool TransferPrivate::isReadBlocked() const
+{
+    return mThrottleTimer.isActive() || (mWriteBehind && mWriteBehind->isFull());
+}
+
+void TransferPrivate::updateJournal()
+{
+    // Record how much of each partially received item was written
+    foreach (Stream *stream, mStreams) {
+        if (stream->currentItem && stream->stripeIndex == -1 &&
+                stream->currentItemIndex != -1 && stream->currentItemBytesTransferred) {
+            qint64 bytesWritten = stream->currentItemBytesTransferred;
+            if (mWriteBehind) {
+                bytesWritten -= mWriteBehind->pendingBytes(stream->currentItem);
+            }
+            mJournal->setPartial(stream->currentItemIndex, bytesWritten);
+        }
+    }
+    mJournal->save();
+}
+
+void TransferPrivate::sendPackets(Stream *stream)
+{
+    // The window has drained since it last filled up
+    if (stream->blockedTimer.isValid()) {
+        mStats.blockedTime += stream->blockedTimer.nsecsElapsed() / 1000;
+        stream->blockedTimer.invalidate();
+    }
+
+    // Transports that cannot report pending data get one packet at a time
+    bool windowed = stream->transport->bytesToWrite() >= 0;
+
+    // Continue sending packets until the high watermark is reached or there
+    // is nothing left to send - this keeps the transport saturated instead of
+    // waiting for each individual packet to be written
+    while (mState == Transfer::InProgress &&
+            stream->transport->bytesToWrite() < mHighWatermark) {
+
+        // Hold off until the bandwidth limits allow more data to be read
+        qint64 delay = mGovernor->delay(mDirection, mLimitKey, this);
+        if (delay > 0) {
+            if (!mThrottleTimer.isActive()) {
+                mThrottleTimer.start(delay);
+            }
+            return;
+        }
+
+        qint64 bytesTransferred = mLastIntervalBytesTransferred;
+        switch (stream->protocolState) {
+        case ItemHeader:
+            sendItemHeader(stream);
+            break;
+        case ItemContent:
+            sendItemContent(stream);
+            break;
+        default:
+            return;
+        }
+        mGovernor->consume(mDirection, mLimitKey, this, mLastIntervalBytesTransferred - bytesTransferred);
 
-    // Transport should always be valid at this point - ensure it is freed
-    mTransport->setParent(this);
+        if (!windowed) {
+            return;
+        }
+    }
 
-    connect(mTransport, &Transport::packetReceived, this, &TransferPrivate::onPacketReceived);
-    connect(mTransport, &Transport::packetSent, this, &TransferPrivate::onPacketSent);
-    connect(mTransport, &Transport::error, this, &TransferPrivate::onError);
+    // Track how long the transport holds up the transfer
+    if (mState == Transfer::InProgress && stream->transport->bytesToWrite() >= mHighWatermark) {
+        stream->blockedTimer.start();
+        ++mStats.blockedCount;
+    }
 }
 
-void TransferPrivate::sendTransferHeader()
+void TransferPrivate::sendTransferHeader(Stream *stream)
 {
     QJsonObject object{
         { "name", mApplication->deviceName() },
+        { "uuid", mApplication->deviceUuid() },
         { "count", QString::number(mBundle->rowCount(QModelIndex())) },
         { "size", QString::number(mBundle->totalSize()) }
     };
 
-    Packet packet(Packet::Json, QJsonDocument(object).toJson());
-    mTransport->sendPacket(&packet);
+    // Optional features are only requested when they would be used since
+    // the sender must wait for the receiver to acknowledge them
+    QStringList features;
+    if (mStreamCount > 1) {
+        features.append(StreamsFeature);
+        features.append(StripesFeature);
+        object.insert("streams", mStreamCount);
+    }
+    if (mResumeThreshold > 0 && mBytesTotal >= mResumeThreshold) {
+        features.append(ResumeFeature);
+        object.insert("resume", resumeKey());
+    }
+    if (mDeltaThreshold > 0 && mBytesTotal >= mDeltaThreshold) {
+        features.append(DeltaFeature);
+    }
+    if (mCompressionEnabled) {
+        features.append(CompressionFeature);
+        object.insert("compression", QJsonArray::fromStringList(Compression::supportedMethods()));
+    }
+    if (mBatchThreshold > 0) {
+        int smallItems = 0;
+        for (int i = 0; i < mItemCount && smallItems < MinBatchItems; ++i) {
+            if (mBundle->index(i, 0).data(Qt::UserRole).value<Item*>()->size() <= mBatchThreshold) {
+                ++smallItems;
+            }
+        }
+        if (smallItems >= MinBatchItems) {
+            features.append(BatchFeature);
+        }
+    }
+    if (mItemCount >= MinCborItems) {
+        features.append(CborFeature);
+    }
+    if (mDigest != Digest::None) {
+        features.append(DigestFeature);
+        object.insert("digest", Digest::name(mDigest));
+    }
+
+    // Transports only list features when they need to find out whether the
+    // receiver supports them
+    features.append(stream->transport->features());
+    if (features.count()) {
+        object.insert("id", mId);
+        object.insert("features", QJsonArray::fromStringList(features));
+        object.insert("maxPacketSize", QString::number(mMaxPacketSize));
+    }
+
+    Packet packet(Packet::Json, QJsonDocument(object).toJson(QJsonDocument::Compact));
+    stream->transport->sendPacket(packet);
+
+    // Either wait for the acknowledgement or move directly to the first item
+    if (features.count()) {
+        stream->protocolState = Negotiating;
+        mNegotiationTimer.start();
+    } else {
+        stream->protocolState = ItemHeader;
+    }
+}
+
+void TransferPrivate::sendStreamHeader(Stream *stream)
+{
+    QJsonObject object{
+        { "id", mId },
+        { "stream", mStreams.indexOf(stream) }
+    };
+
+    Packet packet(Packet::Json, QJsonDocument(object).toJson(QJsonDocument::Compact));
+    stream->transport->sendPacket(packet);
+
+    // The stream immediately begins claiming items
+    stream->protocolState = ItemHeader;
+}
+
+void TransferPrivate::sendItemHeader(Stream *stream)
+{
+    PhaseTimer timer(mStats.headerTime);
+
+    stream->stripeIndex = -1;
+
+    if (mStripes.contains(mActiveStripe)) {
+
+        // Join the item being striped across streams since it has chunks left
+        stream->currentItem = mStripes.value(mActiveStripe).item;
+        stream->currentItemIndex = stream->stripeIndex = mActiveStripe;
+
+    } else {
+
+        skipItems();
+
+        // If the other streams have claimed all of the remaining items, there
+        // is nothing left for this one to do
+        if (mItemIndex >= mItemCount) {
+            stream->protocolState = Finished;
+            return;
+        }
+
+        prefetchItems();
+
+        // Small items are packed together instead of being sent one by one
+        if (sendBatch(stream)) {
+            return;
+        }
+
+        // Claim the next item and attempt to open it
+        stream->currentItem = mBundle->index(mItemIndex, 0).data(Qt::UserRole).value<Item*>();
+        if (!openItem(stream->currentItem)) {
+            setError(tr("unable to open \"%1\" for reading").arg(stream->currentItem->name()), true);
+            return;
+        }
+
+        stream->currentItemIndex = mItemIndex;
+
+        // Split large items into chunks if the receiver supports it (items
+        // sent as a delta must be sent in order over a single stream)
+        if (!mResumeOffsets.contains(mItemIndex) &&
+                !isDeltaItem(stream->currentItem) &&
+                mFeatures.contains(StripesFeature) &&
+                stream->currentItem->size() >= mStripeThreshold &&
+                rewindItem(stream->currentItem)) {
+            stream->stripeIndex = mActiveStripe = mItemIndex;
+            mStripes.insert(mActiveStripe, { stream->currentItem, 0, stream->currentItem->size(), {} });
+        }
+
+        ++mItemIndex;
+    }
+
+    // Reset transfer stats
+    stream->currentItemBytesTransferred = 0;
+    stream->currentItemBytesTotal = stream->currentItem->size();
+    stream->compressionBackoff = 0;
+
+    // Build a header with all of the properties - streams sending chunks of
+    // the same item all send the header so the receiver can match them
+    QVariantMap header = QtUtil::properties(stream->currentItem);
+    if (stream->stripeIndex != -1) {
+        header.insert("stripe", static_cast<qint64>(stream->stripeIndex));
+    }
+
+    // The receiver journals items by index in order to resume them later
+    if (mFeatures.contains(ResumeFeature)) {
+        header.insert("index", static_cast<qint64>(stream->currentItemIndex));
+
+        // Continue a partially received item where the receiver left off
+        qint64 offset = mResumeOffsets.take(stream->currentItemIndex);
+        if (offset > 0 && offset < stream->currentItemBytesTotal &&
+                stream->stripeIndex == -1 && stream->currentItem->seek(offset)) {
+            header.insert("offset", offset);
+            stream->currentItemBytesTransferred = offset;
+            mBytesTransferred += offset;
+        }
+    }
+
+    // Ask the receiver for the checksums of its copy of large items
+    bool delta = stream->stripeIndex == -1 && !header.contains("offset") &&
+            isDeltaItem(stream->currentItem);
+    if (delta) {
+        header.insert("delta", true);
+    }
+
+    // Content sent in order over a single stream is followed by its digest
+    // (which is computed from the blocks as they are read)
+    delete stream->digest;
+    stream->digest = nullptr;
+    if (mFeatures.contains(DigestFeature) && stream->stripeIndex == -1 &&
+            !header.contains("offset") && !delta && stream->currentItemBytesTotal) {
+        header.insert("digest", true);
+        stream->digest = new Digest(mDigest);
+    }
+
+    // Send the item header
+    ++mStats.headerCount;
+    Packet packet(mFeatures.contains(CborFeature) ? Packet::Cbor : Packet::Json, encodeHeader(header));
+    stream->transport->sendPacket(packet);
+
+    // If the item has a size, switch states; otherwise send the next item
+    if (delta) {
+        stream->protocolState = ItemSignature;
+    } else if (stream->currentItemBytesTotal) {
+        stream->protocolState = ItemContent;
+    } else {
+        sendNext(stream);
+    }
+}
+
+void TransferPrivate::sendItemContent(Stream *stream)
+{
+    if (stream->stripeIndex != -1) {
+        sendItemChunk(stream);
+        return;
+    }
+    if (stream->deltaEncoder) {
+        sendItemDelta(stream);
+        return;
+    }
+
+    // Send the content straight from the file if possible
+    if (sendFileBlock(stream, stream->currentItem, Packet::Binary, QByteArray(),
+            stream->currentItemBytesTransferred,
+            stream->currentItemBytesTotal - stream->currentItemBytesTransferred)) {
+        updateProgress();
+        if (stream->currentItemBytesTransferred >= stream->currentItemBytesTotal) {
+            sendNext(stream);
+        }
+        return;
+    }
+
+    QByteArray data = readItem(stream->currentItem);
+    if (data.isEmpty()) {
+        setError(tr("unable to read from \"%1\"").arg(stream->currentItem->name()), true);
+        return;
+    }
+
+    if (stream->digest) {
+        stream->digest->addData(data);
+    }
+
+    // Compress the block unless a recent block in the item did not shrink
+    // by at least an eighth (already-compressed media, archives, etc.)
+    QByteArray compressed;
+    if (mCompression != Compression::None) {
+        if (stream->compressionBackoff) {
+            --stream->compressionBackoff;
+        } else {
+            compressed = Compression::compress(mCompression, data);
+            if (compressed.isEmpty() || compressed.size() > data.size() - data.size() / 8) {
+                compressed.clear();
+                stream->compressionBackoff = CompressionBackoff;
+            }
+        }
+    }
+
+    if (compressed.isEmpty()) {
+        Packet packet(Packet::Binary, data);
+        stream->transport->sendPacket(packet);
+    } else {
+        Packet packet(Packet::Compressed, QByteArray(1, static_cast<char>(mCompression)) + compressed);
+        stream->transport->sendPacket(packet);
+    }
+
+    // Increment the number of bytes written to the socket
+    mBytesTransferred += data.length();
+    stream->currentItemBytesTransferred += data.length();
+    mLastIntervalBytesTransferred += data.length();
+
+    updateProgress();
+
+    // If the item completed, send its digest and then the next one
+    if (stream->currentItemBytesTransferred >= stream->currentItemBytesTotal) {
+        if (stream->digest) {
+            Packet packet(Packet::Digest, stream->digest->result());
+            stream->transport->sendPacket(packet);
+            delete stream->digest;
+            stream->digest = nullptr;
+        }
+        sendNext(stream);
+    }
+}
+
+void TransferPrivate::sendItemChunk(Stream *stream)
+{
+    // Another stream may have sent the last chunk of the item
+    if (!mStripes.contains(stream->stripeIndex)) {
+        sendNext(stream);
+        return;
+    }
+
+    // Chunks are claimed in order, so the item is still read sequentially
+    Stripe &stripe = mStripes[stream->stripeIndex];
+    qint64 offset = stripe.bytesTransferred;
+
+    // Prefix the data with its offset in the item
+    QByteArray prefix(sizeof(qint64), 0);
+    qToLittleEndian<qint64>(offset, reinterpret_cast<uchar*>(prefix.data()));
+
+    // Send the chunk straight from the file if possible
+    qint64 bytesTransferred = stream->currentItemBytesTransferred;
+    if (sendFileBlock(stream, stripe.item, Packet::Chunk, prefix, offset, stripe.bytesTotal - offset)) {
+        stripe.bytesTransferred += stream->currentItemBytesTransferred - bytesTransferred;
+        updateProgress();
+        if (stripe.bytesTransferred >= stripe.bytesTotal) {
+            sendNext(stream);
+        }
+        return;
+    }
+
+    QByteArray data = readItem(stripe.item);
+    if (data.isEmpty()) {
+        setError(tr("unable to read from \"%1\"").arg(stripe.item->name()), true);
+        return;
+    }
+
+    QByteArray content = prefix;
+    content.append(data);
+
+    Packet packet(Packet::Chunk, content);
+    stream->transport->sendPacket(packet);
+
+    // Increment the number of bytes written to the socket
+    mBytesTransferred += data.length();
+    stripe.bytesTransferred += data.length();
+    stream->currentItemBytesTransferred += data.length();
+    mLastIntervalBytesTransferred += data.length();
+
+    updateProgress();
+
+    // If the item completed, send the next one
+    if (stripe.bytesTransferred >= stripe.bytesTotal) {
+        sendNext(stream);
+    }
+}
+
+void TransferPrivate::sendItemDelta(Stream *stream)
+{
+    qint64 bytesEncoded = 0;
+    QByteArray ops = stream->deltaEncoder->next(stream->currentItem, bytesEncoded);
+    if (ops.isEmpty() && !stream->deltaEncoder->atEnd()) {
+        setError(tr("unable to read from \"%1\"").arg(stream->currentItem->name()), true);
+        return;
+    }
+
+    if (!ops.isEmpty()) {
+        Packet packet(Packet::Delta, ops);
+        stream->transport->sendPacket(packet);
+    }
+
+    // Progress is based on the size of the item rather than the (hopefully
+    // much smaller) amount of data sent
+    mBytesTransferred += bytesEncoded;
+    stream->currentItemBytesTransferred += bytesEncoded;
+    mLastIntervalBytesTransferred += bytesEncoded;
+
+    updateProgress();
+
+    if (stream->deltaEncoder->atEnd()) {
+        delete stream->deltaEncoder;
+        stream->deltaEncoder = nullptr;
+        sendNext(stream);
+    }
+}
+
+bool TransferPrivate::sendBatch(Stream *stream)
+{
+    // Each item is added as [header length (32-bit)][header][content] - the
+    // size in the header indicates how much content follows it and the
+    // headers use the negotiated encoding
+    QByteArray content;
+    int count = 0;
+    while (mItemIndex < mItemCount && count < MaxBatchItems && content.size() < MaxBatchSize) {
+        Item *item = mBundle->index(mItemIndex, 0).data(Qt::UserRole).value<Item*>();
+        if (!isBatchItem(item, mItemIndex)) {
+            break;
+        }
+
+        if (!openItem(item)) {
+            setError(tr("unable to open \"%1\" for reading").arg(item->name()), true);
+            return true;
+        }
+        QByteArray data;
+        while (data.size() < item->size()) {
+            QByteArray block = readItem(item);
+            if (block.isEmpty()) {
+                break;
+            }
+            data.append(block);
+        }
+        closeItem(item);
+        if (data.size() < item->size()) {
+            setError(tr("unable to read from \"%1\"").arg(item->name()), true);
+            return true;
+        }
+        data.truncate(static_cast<int>(item->size()));
+
+        QVariantMap properties = QtUtil::properties(item);
+        if (mFeatures.contains(ResumeFeature)) {
+            properties.insert("index", static_cast<qint64>(mItemIndex));
+        }
+
+        // The content is already in memory, so its digest goes in the header
+        if (mFeatures.contains(DigestFeature) && data.size()) {
+            Digest digest(mDigest);
+            digest.addData(data);
+            properties.insert("digest", QString(digest.result().toHex()));
+        }
+        QByteArray header = encodeHeader(properties);
+
+        QByteArray headerLength(sizeof(qint32), 0);
+        qToLittleEndian<qint32>(header.size(), reinterpret_cast<uchar*>(headerLength.data()));
+        content.append(headerLength);
+        content.append(header);
+        content.append(data);
+
+        // Increment the number of bytes written to the socket
+        mBytesTransferred += data.length();
+        mLastIntervalBytesTransferred += data.length();
+
+        ++mItemIndex;
+        ++count;
+        skipItems();
+        prefetchItems();
+    }
+
+    if (!count) {
+        return false;
+    }
+
+    Packet packet(Packet::Batch, content);
+    stream->transport->sendPacket(packet);
+
+    updateProgress();
+
+    // Either prepare to send the next item or wait for the success packet
+    if (mItemIndex >= mItemCount && mStripes.isEmpty()) {
+        stream->protocolState = Finished;
+    } else {
+        stream->protocolState = ItemHeader;
+    }
+    return true;
+}
+
+void TransferPrivate::sendNext(Stream *stream)
+{
+    // Close the current item - for striped items, the first stream to
+    // finish with the item closes it and the others simply move on
+    if (stream->stripeIndex == -1) {
+        closeItem(stream->currentItem);
+    } else if (mStripes.contains(stream->stripeIndex)) {
+        closeItem(mStripes.take(stream->stripeIndex).item);
+    }
+    stream->currentItem = nullptr;
+    stream->currentItemIndex = -1;
+    stream->stripeIndex = -1;
+
+    skipItems();
+
+    // If all items have been claimed, move to the finished state and wait
+    // for the success packet; otherwise, prepare to send the next item
+    if (mItemIndex >= mItemCount && mStripes.isEmpty()) {
+        stream->protocolState = Finished;
+    } else {
+        stream->protocolState = ItemHeader;
+    }
+}
+
+void TransferPrivate::processNegotiation(Stream *stream, const Packet &packet)
+{
+    mNegotiationTimer.stop();
+
+    QJsonParseError error;
+    QJsonObject object = QJsonDocument::fromJson(packet.content(), &error).object();
+    if (error.error != QJsonParseError::NoError) {
+        setError(QString("negotiation: %1").arg(error.errorString()), true);
+        return;
+    }
+
+    // Only the features acknowledged by the receiver may be used
+    foreach (const QJsonValue &value, object.value("features").toArray()) {
+        mFeatures.append(value.toString());
+    }
+
+    // Let the transport know which of its own features were acknowledged
+    QStringList transportFeatures;
+    foreach (const QString &feature, stream->transport->features()) {
+        if (mFeatures.contains(feature)) {
+            transportFeatures.append(feature);
+        }
+    }
+    stream->transport->setPeerFeatures(transportFeatures);
+
+    // Receivers that do not announce a limit accept packets of any size
+    mPeerMaxPacketSize = object.value("maxPacketSize").toString().toLongLong();
+
+    stream->protocolState = ItemHeader;
+
+    // Skip the items that the receiver already has and note where partial
+    // items should continue
+    if (mFeatures.contains(ResumeFeature)) {
+        QJsonObject resume = object.value("resume").toObject();
+        foreach (const QJsonValue &value, resume.value("completed").toArray()) {
+            qint32 index = value.toString().toInt();
+            if (index >= 0 && index < mItemCount && !mResumeCompleted.contains(index)) {
+                mResumeCompleted.insert(index);
+                mBytesTransferred += mBundle->index(index, 0).data(Qt::UserRole).value<Item*>()->size();
+            }
+        }
+        QJsonObject offsets = resume.value("offsets").toObject();
+        for (auto i = offsets.constBegin(); i != offsets.constEnd(); ++i) {
+            mResumeOffsets.insert(i.key().toInt(), i.value().toString().toLongLong());
+        }
+        updateProgress();
+    }
+
+    if (mFeatures.contains(CompressionFeature)) {
+        mCompression = Compression::fromName(object.value("compression").toString());
+    }
+
+    // Open the additional streams (the receiver may ask for fewer)
+    if (mFeatures.contains(StreamsFeature)) {
+        emit streamsRequested(qMin(mStreamCount, object.value("streams").toInt()));
+    }
+
+    sendPackets(stream);
+}
+
+void TransferPrivate::processTransferHeader(Stream *stream, const Packet &packet)
+{
+    QJsonParseError error;
+    QJsonObject object = QJsonDocument::fromJson(packet.content(), &error).object();
+    if (error.error != QJsonParseError::NoError) {
+        setError(QString("transfer header: %1").arg(error.errorString()), true);
+        return;
+    }
+
+    // Additional streams belonging to an existing transfer identify
+    // themselves instead of sending a full transfer header
+    if (object.contains("stream")) {
+        processStreamHeader(stream, object);
+        return;
+    }
+
+    // If the device name was provided, use it
+    mDeviceName = object.value("name").toString();
+    mLimitKey = object.value("uuid").toString();
+    notify();
+
+    // Strings must be used for 64-bit numbers
+    mItemCount = object.value("count").toString().toInt();
+    mBytesTotal = object.value("size").toString().toLongLong();
+
+    // Legacy senders never request features and do not expect a reply
+    if (object.contains("features")) {
+        mId = object.value("id").toString();
+
+        QJsonObject reply;
+        QStringList features = object.value("features").toVariant().toStringList();
+
+        // Exchange limits on the size of packets with senders that have one
+        if (object.contains("maxPacketSize")) {
+            mPeerMaxPacketSize = object.value("maxPacketSize").toString().toLongLong();
+            reply.insert("maxPacketSize", QString::number(mMaxPacketSize));
+        }
+        if (features.contains(StreamsFeature) && !mId.isEmpty()) {
+            mFeatures.append(StreamsFeature);
+            reply.insert("streams", qBound(1, object.value("streams").toInt(), MaxStreams));
+
+            // Chunks are only useful when there are multiple streams
+            if (features.contains(StripesFeature)) {
+                mFeatures.append(StripesFeature);
+            }
+        }
+
+        if (features.contains(DeltaFeature)) {
+            mFeatures.append(DeltaFeature);
+        }
+
+        if (features.contains(BatchFeature)) {
+            mFeatures.append(BatchFeature);
+        }
+
+        if (features.contains(CborFeature)) {
+            mFeatures.append(CborFeature);
+        }
+
+        // Features of the transport itself are acknowledged if it has them
+        foreach (const QString &feature, stream->transport->features()) {
+            if (features.contains(feature)) {
+                mFeatures.append(feature);
+            }
+        }
+
+        // Verify items with the digest chosen by the sender if it is known
+        Digest::Method digest = Digest::fromName(object.value("digest").toString());
+        if (features.contains(DigestFeature) && digest != Digest::None) {
+            mFeatures.append(DigestFeature);
+            mDigest = digest;
+        }
+
+        // Use the first compression method (in the sender's order of
+        // preference) that is also supported here
+        if (features.contains(CompressionFeature)) {
+            QStringList supportedMethods = Compression::supportedMethods();
+            foreach (const QJsonValue &value, object.value("compression").toArray()) {
+                if (supportedMethods.contains(value.toString())) {
+                    mFeatures.append(CompressionFeature);
+                    reply.insert("compression", value.toString());
+                    break;
+                }
+            }
+        }
+
+        // Look for a journal from a previous attempt at the same transfer
+        QString key = object.value("resume").toString();
+        if (features.contains(ResumeFeature) && TransferJournal::isValidKey(key)) {
+            mFeatures.append(ResumeFeature);
+            mJournal = new TransferJournal(key);
+            reply.insert("resume", mJournal->toJson());
+
+            mItemIndex = mJournal->completedCount();
+            mBytesTransferred = mJournal->completedBytes();
+            updateProgress();
+        }
+        reply.insert("features", QJsonArray::fromStringList(mFeatures));
+
+        if (!checkSpace()) {
+            return;
+        }
+
+        // Additional streams may arrive as soon as the sender sees the reply
+        // so they must be able to find this transfer by then
+        notify();
+
+        Packet packet(Packet::Json, QJsonDocument(reply).toJson(QJsonDocument::Compact));
+        stream->transport->sendPacket(packet);
+    } else if (!checkSpace()) {
+        return;
+    }
+
+    // Prepare to receive the first item (unless there are none left)
+    stream->protocolState = ItemHeader;
+    if (mItemIndex >= mItemCount) {
+        setSuccess(true);
+    }
+}
+
+void TransferPrivate::processStreamHeader(Stream *stream, const QJsonObject &object)
+{
+    // Hand the transport over to the transfer it belongs to (by way of the
+    // main thread, which finds it) - this one only existed to read the
+    // stream header and is no longer needed
+    Transport *transport = stream->transport;
+    removeStream(stream);
+    mSpeedTimer.stop();
+
+    // Packets that follow the header are kept until the other transfer
+    // takes over the transport
+    new PendingStream(transport);
+
+    transport->setParent(nullptr);
+    transport->moveToThread(mMainThread);
+    emit streamReceived(object.value("id").toString(), transport);
+}
+
+void TransferPrivate::processItemHeader(Stream *stream, const Packet &packet)
+{
+    PhaseTimer timer(mStats.headerTime);
+    ++mStats.headerCount;
+
+    QVariantMap header;
+    if (!decodeHeader(packet.content(), packet.type() == Packet::Cbor, header)) {
+        return;
+    }
+
+    // The index is only provided when the receiver keeps a journal
+    stream->currentItemIndex = header.value("index", -1).toInt();
+
+    // If another stream already created the striped item, share it
+    stream->stripeIndex = -1;
+    if (header.contains("stripe")) {
+        qint32 stripeIndex = header.value("stripe").toInt();
+        if (mStripes.contains(stripeIndex)) {
+            stream->currentItem = mStripes.value(stripeIndex).item;
+            stream->currentItemIndex = stream->stripeIndex = stripeIndex;
+
+            // The item may already be complete if this stream sent no chunks
+            stream->protocolState = stream->currentItem ? ItemContent : ItemHeader;
+            return;
+        }
+    }
+
+    // Use the handler for the type to create an item and open it
+    stream->currentItem = createItem(header);
+    if (!stream->currentItem) {
+        return;
+    }
+    if (!stream->currentItem->open(Item::Write)) {
+        setError(tr("unable to open \"%1\" for writing").arg(stream->currentItem->name()), true);
+        return;
+    }
+
+    // Reset transfer stats
+    stream->currentItemBytesTransferred = 0;
+    stream->currentItemBytesTotal = stream->currentItem->size();
+
+    // Continue a partially received item from a previous attempt - only the
+    // offset journalled here is accepted (the digest is not checked for these
+    // items) and the content before it must still exist
+    if (header.contains("offset")) {
+        qint64 offset = header.value("offset").toLongLong();
+        if (!mJournal || stream->currentItemIndex == -1 ||
+                offset != mJournal->partialOffset(stream->currentItemIndex)) {
+            setError(tr("protocol error - invalid offset"), true);
+            return;
+        }
+        qint64 existingSize = stream->currentItem->existingSize();
+        if (existingSize != -1 && offset > existingSize) {
+            // The sender has already skipped the content, so forget the
+            // partial item in order for the next attempt to start over
+            mJournal->removePartial(stream->currentItemIndex);
+            setError(tr("partially received \"%1\" is missing").arg(stream->currentItem->name()), true);
+            return;
+        }
+        if (!stream->currentItem->seek(offset)) {
+            setError(tr("unable to seek in \"%1\"").arg(stream->currentItem->name()), true);
+            return;
+        }
+        stream->currentItemBytesTransferred = offset;
+        mBytesTransferred += offset;
+        updateProgress();
+    }
+
+    // Send the checksums of the existing copy so that only the changes are
+    // sent - the item is rebuilt in place as the delta arrives
+    if (header.value("delta").toBool() && mFeatures.contains(DeltaFeature) &&
+            stream->currentItemBytesTotal) {
+        QByteArray signature = DeltaUtil::signature(
+            stream->currentItem, DeltaUtil::blockSize(stream->currentItemBytesTotal));
+
+        // Signatures of very large items may not fit in a packet the sender
+        // accepts - without any blocks, the whole item is sent as literals
+        if (mPeerMaxPacketSize && signature.size() > mPeerMaxPacketSize) {
+            signature.truncate(sizeof(qint32));
+        }
+        Packet packet(Packet::Signature, signature);
+        stream->transport->sendPacket(packet);
+        stream->protocolState = ItemContent;
+        return;
+    }
+
+    // Chunks of striped items are written at their offset
+    if (header.contains("stripe") && stream->currentItemBytesTotal) {
+        if (!stream->currentItem->seek(0)) {
+            setError(tr("unable to seek in \"%1\"").arg(stream->currentItem->name()), true);
+            return;
+        }
+        stream->stripeIndex = header.value("stripe").toInt();
+        mStripes.insert(stream->stripeIndex, { stream->currentItem, 0, stream->currentItemBytesTotal, {} });
+    }
+
+    // Content sent in order is followed by its digest
+    delete stream->digest;
+    stream->digest = nullptr;
+    if (header.value("digest").toBool() && mFeatures.contains(DigestFeature) &&
+            stream->stripeIndex == -1 && !header.contains("offset") &&
+            stream->currentItemBytesTransferred < stream->currentItemBytesTotal) {
+        stream->digest = new Digest(mDigest);
+    }
+
+    // Have the transport write the content directly to the file if it can
+    // (the content never reaches memory, so it cannot be decompressed or
+    // checked against a digest)
+    if (mZeroCopy && stream->stripeIndex == -1 && !stream->digest &&
+            !mFeatures.contains(CompressionFeature) &&
+            stream->currentItemBytesTransferred < stream->currentItemBytesTotal &&
+            stream->currentItem->handle() != -1 && stream->transport->canReceiveFile()) {
+        stream->transport->receiveFile(stream->currentItem->handle(),
+                                       stream->currentItemBytesTransferred);
+        stream->receivingFile = true;
+    }
+
+    // If the item has data left, switch states; otherwise receive the next item
+    if (stream->currentItemBytesTransferred < stream->currentItemBytesTotal) {
+        stream->protocolState = ItemContent;
+    } else {
+        processNext(stream);
+    }
+}
+
+void TransferPrivate::processItemContent(Stream *stream, const Packet &packet)
+{
+    QByteArray data = packet.content();
+
+    // Compressed blocks indicate which method was used to compress them
+    if (packet.type() == Packet::Compressed) {
+        if (!data.isEmpty()) {
+            data = Compression::decompress(
+                static_cast<Compression::Method>(static_cast<uchar>(data.at(0))), data.mid(1));
+        }
+        if (data.isEmpty()) {
+            setError(tr("unable to decompress data for \"%1\"").arg(stream->currentItem->name()), true);
+            return;
+        }
+    }
+
+    if (mWriteBehind) {
+        writeItemLater(stream->currentItem, stream->currentItemBytesTransferred, data, false);
+    } else {
+        writeItem(stream->currentItem, data);
+    }
+    if (stream->digest) {
+        stream->digest->addData(data);
+    }
+
+    // Add the number of bytes to the global & current item totals
+    mBytesTransferred += data.size();
+    stream->currentItemBytesTransferred += data.size();
+    mLastIntervalBytesTransferred += data.size();
+
+    updateProgress();
 
-    // The next packet will be an item header
-    mProtocolState = ItemHeader;
+    // If the current item is complete, wait for its digest (if any) and
+    // then advance to the next item or finish
+    if (stream->currentItemBytesTransferred >= stream->currentItemBytesTotal) {
+        if (stream->digest) {
+            stream->protocolState = ItemDigest;
+        } else {
+            processNext(stream);
+        }
+    }
 }
 
-void TransferPrivate::sendItemHeader()
+void TransferPrivate::processItemChunk(Stream *stream, const Packet &packet)
 {
-    // Grab the next item and attempt to open it
-    mCurrentItem = mBundle->index(mItemIndex, 0).data(Qt::UserRole).value<Item*>();
-    if (!mCurrentItem->open(Item::Read)) {
-        setError(tr("unable to open \"%1\" for reading").arg(mCurrentItem->name()), true);
+    if (stream->stripeIndex == -1 || !stream->currentItem ||
+            packet.content().size() < static_cast<int>(sizeof(qint64))) {
+        setError(tr("protocol error - unexpected chunk"), true);
         return;
     }
 
-    // Reset transfer stats
-    mCurrentItemBytesTransferred = 0;
-    mCurrentItemBytesTotal = mCurrentItem->size();
-
-    // Build a JSON object with all of the properties
-    QJsonObject object = JsonUtil::objectToJson(mCurrentItem);
+    // Write the data at the offset specified in the chunk
+    Stripe &stripe = mStripes[stream->stripeIndex];
+    qint64 offset = qFromLittleEndian<qint64>(
+        reinterpret_cast<const uchar*>(packet.content().constData()));
+    QByteArray data = QByteArray::fromRawData(packet.content().constData() + sizeof(qint64),
+        packet.content().size() - static_cast<int>(sizeof(qint64)));
 
-    // Send the item header
-    Packet packet(Packet::Json, QJsonDocument(object).toJson());
-    mTransport->sendPacket(&packet);
+    // The chunk must lie within the item
+    if (offset < 0 || offset > stripe.bytesTotal - data.size()) {
+        setError(tr("protocol error - chunk outside of \"%1\"").arg(stripe.item->name()), true);
+        return;
+    }
 
-    // If the item has a size, switch states; otherwise send the next item
-    if (mCurrentItemBytesTotal) {
-        mProtocolState = ItemContent;
+    if (mWriteBehind) {
+        writeItemLater(stripe.item, offset, data, true);
     } else {
-        sendNext();
+        if (!stripe.item->seek(offset)) {
+            setError(tr("unable to seek in \"%1\"").arg(stripe.item->name()), true);
+            return;
+        }
+        writeItem(stripe.item, data);
     }
-}
-
-void TransferPrivate::sendItemContent()
-{
-    QByteArray data = mCurrentItem->read();
-    Packet packet(Packet::Binary, data);
-    mTransport->sendPacket(&packet);
 
-    // Increment the number of bytes written to the socket
-    mBytesTransferred += data.length();
-    mCurrentItemBytesTransferred += data.length();
-    mLastIntervalBytesTransferred += data.length();
+    // Add the number of bytes to the global & striped item totals - only
+    // bytes that were not already received count towards completion
+    mBytesTransferred += stripe.addRange(offset, data.size());
+    stream->currentItemBytesTransferred += data.size();
+    mLastIntervalBytesTransferred += data.size();
 
     updateProgress();
 
-    // If the item completed, send the next one
-    if (mCurrentItemBytesTransferred >= mCurrentItemBytesTotal) {
-        sendNext();
-    }
-}
+    if (stripe.bytesTransferred >= stripe.bytesTotal) {
+
+        // Release the item from every stream that was receiving chunks of it;
+        // the stripe is kept so that late headers for it can be recognized
+        qint32 stripeIndex = stream->stripeIndex;
+        Item *item = stripe.item;
+        stripe.item = nullptr;
+        foreach (Stream *other, mStreams) {
+            if (other->currentItem == item) {
+                other->currentItem = nullptr;
+                other->stripeIndex = -1;
+                other->protocolState = ItemHeader;
+            }
+        }
 
-void TransferPrivate::sendNext()
-{
-    // Close the current item and increment the index
-    mCurrentItem->close();
-    ++mItemIndex;
+        finishItem(item, stripeIndex, stripe.bytesTotal);
 
-    // If all items have been sent, move to the finished state and wait for
-    // the success packet; otherwise, prepare to send the next item
-    if (mItemIndex == mItemCount) {
-        mProtocolState = Finished;
-    } else {
-        mProtocolState = ItemHeader;
+        // If there are no more items, send the success packet
+        if (++mItemIndex >= mItemCount) {
+            setSuccess(true);
+        }
     }
 }
 
-void TransferPrivate::processTransferHeader(Packet *packet)
+void TransferPrivate::processItemSignature(Stream *stream, const Packet &packet)
 {
-    QJsonParseError error;
-    QJsonObject object = QJsonDocument::fromJson(packet->content(), &error).object();
-    if (error.error != QJsonParseError::NoError) {
-        setError(QString("transfer header: %1").arg(error.errorString()), true);
+    stream->deltaEncoder = new DeltaEncoder(packet.content(), stream->currentItemBytesTotal);
+    if (!stream->deltaEncoder->isValid()) {
+        setError(tr("invalid signature for \"%1\"").arg(stream->currentItem->name()), true);
         return;
     }
 
-    // If the device name was provided, use it
-    mDeviceName = object.value("name").toString();
-    if (!mDeviceName.isEmpty()) {
-        emit q->deviceNameChanged(mDeviceName);
-    }
-
-    // Strings must be used for 64-bit numbers
-    mItemCount = object.value("count").toString().toInt();
-    mBytesTotal = object.value("size").toString().toLongLong();
-
-    // Prepare to receive the first item
-    mProtocolState = ItemHeader;
+    stream->protocolState = ItemContent;
+    sendPackets(stream);
 }
 
-void TransferPrivate::processItemHeader(Packet *packet)
+void TransferPrivate::processItemDelta(Stream *stream, const Packet &packet)
 {
-    QJsonParseError error;
-    QJsonObject object = QJsonDocument::fromJson(packet->content(), &error).object();
-    if (error.error != QJsonParseError::NoError) {
-        setError(QString("item header: %1").arg(error.errorString()), true);
-        return;
-    }
+    const QByteArray content = packet.content();
+    const uchar *data = reinterpret_cast<const uchar*>(content.constData());
+
+    qint64 bytesTransferred = 0;
+    for (int pos = 0; pos < content.size();) {
+        int remaining = content.size() - pos - 1;
+        int operation = data[pos++];
+        qint64 bytesLeft = stream->currentItemBytesTotal - stream->currentItemBytesTransferred;
+
+        if (operation == DeltaEncoder::Literal && remaining >= static_cast<int>(sizeof(qint32))) {
+
+            // Literal runs are written at the current position and must fit
+            // within both the packet and the item
+            qint32 length = qFromLittleEndian<qint32>(data + pos);
+            pos += sizeof(qint32);
+            if (length < 0 || length > content.size() - pos || length > bytesLeft) {
+                setError(tr("protocol error - invalid delta"), true);
+                return;
+            }
+            QByteArray literal = QByteArray::fromRawData(content.constData() + pos, length);
+            if (mWriteBehind) {
+                writeItemLater(stream->currentItem, stream->currentItemBytesTransferred, literal, true);
+            } else {
+                if (!stream->currentItem->seek(stream->currentItemBytesTransferred)) {
+                    setError(tr("unable to seek in \"%1\"").arg(stream->currentItem->name()), true);
+                    return;
+                }
+                writeItem(stream->currentItem, literal);
+            }
+            pos += length;
+            stream->currentItemBytesTransferred += length;
+            bytesTransferred += length;
+
+        } else if (operation == DeltaEncoder::Copy && remaining >= static_cast<int>(sizeof(qint64) * 2)) {
+
+            // Blocks that are already in place do not need to be copied - the
+            // others are copied here once the queued writes are on disk so
+            // that only one thread uses the item at a time
+            qint64 offset = qFromLittleEndian<qint64>(data + pos);
+            qint64 length = qFromLittleEndian<qint64>(data + pos + sizeof(qint64));
+            pos += sizeof(qint64) * 2;
+
+            // The source must lie at or after the destination (which is what
+            // copyItemData() relies on) and within the item
+            if (length < 0 || offset < stream->currentItemBytesTransferred ||
+                    offset > stream->currentItemBytesTotal ||
+                    length > stream->currentItemBytesTotal - offset) {
+                setError(tr("protocol error - invalid delta"), true);
+                return;
+            }
+            if (offset != stream->currentItemBytesTransferred && mWriteBehind) {
+                mWriteBehind->flush();
+            }
+            if (offset != stream->currentItemBytesTransferred && !copyItemData(
+                    stream->currentItem, offset, stream->currentItemBytesTransferred, length)) {
+                setError(tr("unable to copy existing data in \"%1\"").arg(stream->currentItem->name()), true);
+                return;
+            }
+            stream->currentItemBytesTransferred += length;
+            bytesTransferred += length;
 
-    // In order to maintain compatibility with legacy versions (which is very
-    // desirable), if "type" is not in the object, assume "file" unless
-    // "directory" is present (in which case, use that)
-    QString type;
-    if (object.contains("type")) {
-        type = object.value("type").toString();
-    } else {
-        if (object.contains("directory")) {
-            type = "directory";
         } else {
-            type = "file";
+            setError(tr("protocol error - invalid delta"), true);
+            return;
         }
     }
 
-    // Attempt to locate a handler for the type
-    Handler *handler = mApplication->handlerRegistry()->find(type);
-    if (!handler) {
-        setError(tr("unrecognized item type \"%1\"").arg(type), true);
-        return;
+    // Add the number of bytes to the global totals
+    mBytesTransferred += bytesTransferred;
+    mLastIntervalBytesTransferred += bytesTransferred;
+
+    updateProgress();
+
+    // If the current item is complete, advance to the next item or finish
+    if (stream->currentItemBytesTransferred >= stream->currentItemBytesTotal) {
+        processNext(stream);
     }
+}
 
-    // Use the handler to create an item and open it
-    mCurrentItem = handler->createItem(type, object.toVariantMap());
-    mCurrentItem->setParent(this);
-    if (!mCurrentItem->open(Item::Write)) {
-        setError(tr("unable to open \"%1\" for writing").arg(mCurrentItem->name()), true);
+void TransferPrivate::processItemDigest(Stream *stream, const Packet &packet)
+{
+    QByteArray digest = stream->digest->result();
+    delete stream->digest;
+    stream->digest = nullptr;
+
+    // The content that was written cannot be trusted, so it must not be
+    // journalled as a partial item either
+    if (packet.content() != digest) {
+        stream->currentItemBytesTransferred = 0;
+        setError(tr("content of \"%1\" does not match its digest").arg(stream->currentItem->name()), true);
         return;
     }
 
-    // Reset transfer stats
-    mCurrentItemBytesTransferred = 0;
-    mCurrentItemBytesTotal = mCurrentItem->size();
+    processNext(stream);
+}
 
-    // If the item has a size, switch states; otherwise receive the next item
-    if (mCurrentItemBytesTotal) {
-        mProtocolState = ItemContent;
-    } else {
-        processNext();
+bool TransferPrivate::copyItemData(Item *item, qint64 from, qint64 to, qint64 length)
+{
+    // The source is always after the destination, so copying forward in
+    // pieces never overwrites data that has yet to be copied
+    while (length > 0) {
+        if (!item->seek(from)) {
+            return false;
+        }
+        QByteArray data = readItem(item);
+        if (data.isEmpty()) {
+            return false;
+        }
+        data.truncate(static_cast<int>(qMin<qint64>(data.size(), length)));
+        if (!item->seek(to)) {
+            return false;
+        }
+        writeItem(item, data);
+
+        from += data.size();
+        to += data.size();
+        length -= data.size();
     }
+    return true;
 }
 
-void TransferPrivate::processItemContent(Packet *packet)
+void TransferPrivate::processBatch(Stream *stream, const Packet &packet)
 {
-    mCurrentItem->write(packet->content());
+    const QByteArray content = packet.content();
+    const uchar *data = reinterpret_cast<const uchar*>(content.constData());
+
+    // A stream that sent its last chunk of a striped item may move directly
+    // to a batch - the item remains with the stripe
+    stream->currentItem = nullptr;
+    stream->currentItemIndex = -1;
+    stream->stripeIndex = -1;
+
+    // Each item is created, written, and closed in a single pass
+    qint64 bytesTransferred = 0;
+    for (int pos = 0; pos < content.size();) {
+        qint32 headerLength = -1;
+        if (content.size() - pos >= static_cast<int>(sizeof(qint32))) {
+            headerLength = qFromLittleEndian<qint32>(data + pos);
+            pos += sizeof(qint32);
+        }
+        if (headerLength < 0 || headerLength > content.size() - pos) {
+            setError(tr("protocol error - invalid batch"), true);
+            return;
+        }
 
-    // Add the number of bytes to the global & current item totals
-    mBytesTransferred += packet->content().size();
-    mCurrentItemBytesTransferred += packet->content().size();
-    mLastIntervalBytesTransferred += packet->content().size();
+        QVariantMap header;
+        QByteArray headerData = QByteArray::fromRawData(content.constData() + pos, headerLength);
+        if (!decodeHeader(headerData, mFeatures.contains(CborFeature), header)) {
+            return;
+        }
+        pos += headerLength;
+
+        Item *item = createItem(header);
+        if (!item) {
+            return;
+        }
+
+        qint64 size = item->size();
+        if (size < 0 || size > content.size() - pos) {
+            delete item;
+            setError(tr("protocol error - invalid batch"), true);
+            return;
+        }
+        if (header.contains("digest") && mFeatures.contains(DigestFeature)) {
+            Digest digest(mDigest);
+            digest.addData(QByteArray::fromRawData(content.constData() + pos, static_cast<int>(size)));
+            if (digest.result().toHex() != header.value("digest").toString().toLatin1()) {
+                setError(tr("content of \"%1\" does not match its digest").arg(item->name()), true);
+                delete item;
+                return;
+            }
+        }
+        if (!item->open(Item::Write)) {
+            setError(tr("unable to open \"%1\" for writing").arg(item->name()), true);
+            delete item;
+            return;
+        }
+        if (size) {
+            QByteArray itemData = QByteArray::fromRawData(content.constData() + pos, static_cast<int>(size));
+            if (mWriteBehind) {
+                writeItemLater(item, 0, itemData, false);
+            } else {
+                writeItem(item, itemData);
+            }
+        }
+        finishItem(item, header.contains("index") ? header.value("index").toInt() : -1, size);
+        pos += size;
+
+        bytesTransferred += size;
+        ++mItemIndex;
+    }
+
+    // Add the number of bytes to the global totals
+    mBytesTransferred += bytesTransferred;
+    mLastIntervalBytesTransferred += bytesTransferred;
 
     updateProgress();
 
-    // If the current item is complete, advance to the next item or finish
-    if (mCurrentItemBytesTransferred >= mCurrentItemBytesTotal) {
-        processNext();
+    // If there are no more items, send the success packet
+    if (mItemIndex >= mItemCount) {
+        setSuccess(true);
+    } else {
+        stream->protocolState = ItemHeader;
     }
 }
 
-void TransferPrivate::processNext()
+void TransferPrivate::processNext(Stream *stream)
 {
-    // Close & free the current item and increment the index
-    mCurrentItem->close();
-    delete mCurrentItem;
+    if (stream->receivingFile) {
+        stream->transport->receiveFile(-1, 0);
+        stream->receivingFile = false;
+    }
+
+    // Close & free the current item and increment the number received
+    finishItem(stream->currentItem, stream->currentItemIndex, stream->currentItemBytesTotal);
+    stream->currentItem = nullptr;
     ++mItemIndex;
 
-    // If there are no more items, send the success packet
-    if (mItemIndex == mItemCount) {
+    // Once every stream has delivered its items, send the success packet
+    if (mItemIndex >= mItemCount) {
         setSuccess(true);
     } else {
-        mProtocolState = ItemHeader;
+        stream->protocolState = ItemHeader;
     }
 }
 
@@ -297,93 +1967,229 @@ void TransferPrivate::updateProgress()
 
     // Only update progress if it has actually changed
     if (newProgress != mProgress) {
-        emit q->progressChanged(mProgress = newProgress);
+        mProgress = newProgress;
+        notify();
+    }
+}
+
+void TransferPrivate::throttleReceive(qint64 bytes)
+{
+    if (mDirection != Transfer::Receive || !bytes || isFinished()) {
+        return;
+    }
+
+    // Stop reading from the peer until the limits allow more data through
+    mGovernor->consume(mDirection, mLimitKey, this, bytes);
+    qint64 delay = mGovernor->delay(mDirection, mLimitKey, this);
+    if (delay > 0 && !mThrottleTimer.isActive()) {
+        foreach (Stream *stream, mStreams) {
+            stream->transport->setReadPaused(true);
+        }
+        mThrottleTimer.start(delay);
     }
 }
 
 void TransferPrivate::setSuccess(bool send)
 {
-    if (send) {
-        Packet packet(Packet::Success);
-        mTransport->sendPacket(&packet);
+    // Everything must be on disk before the sender is told it arrived
+    flushWrites();
+
+    foreach (Stream *stream, mStreams) {
+        if (send) {
+            Packet packet(Packet::Success);
+            stream->transport->sendPacket(packet);
+        }
+        stream->protocolState = Finished;
+    }
+
+    // The journal is no longer needed once everything has been received
+    if (mJournal) {
+        mJournal->remove();
     }
 
-    emit q->stateChanged(mState = Transfer::Succeeded);
+    mState = Transfer::Succeeded;
+    notify();
 
-    // Stop the speed timer
+    // Stop the timers
     mSpeedTimer.stop();
+    mNegotiationTimer.stop();
+    mThrottleTimer.stop();
 
     // Both peers should be aware that the transfer succeeded at this point
-    mTransport->close();
+    foreach (Stream *stream, mStreams) {
+        stream->transport->close();
+    }
 }
 
 void TransferPrivate::setError(const QString &message, bool send)
 {
-    mApplication->logger()->log(new Message(
-        Message::Error,
-        MessageTag,
-        message
-    ));
+    log(Message::Error, message);
+
+    // Record the progress so that a retry can continue from here
+    flushWrites();
+    if (mJournal) {
+        updateJournal();
+    }
 
-    if (send) {
-        Packet packet(Packet::Error, message.toUtf8());
-        mTransport->sendPacket(&packet);
+    foreach (Stream *stream, mStreams) {
+        if (send) {
+            Packet packet(Packet::Error, message.toUtf8());
+            stream->transport->sendPacket(packet);
+        }
+
+        // The protocol dictates that the transfer is now "finished"
+        stream->protocolState = Finished;
     }
 
-    emit q->errorChanged(mError = message);
-    emit q->stateChanged(mState = Transfer::Failed);
+    mError = message;
+    mState = Transfer::Failed;
+    notify();
 
-    // Stop the speed timer
+    // Stop the timers
     mSpeedTimer.stop();
+    mNegotiationTimer.stop();
+    mThrottleTimer.stop();
+
+    // An error on either end necessitates the transports be closed
+    foreach (Stream *stream, mStreams) {
+        stream->transport->close();
+    }
+}
 
-    // An error on either end necessitates the transport be closed
-    if (mTransport) {
-        mTransport->close();
+void TransferPrivate::onConnected(Stream *stream)
+{
+    // Incoming transports may also indicate that they are connected
+    if (mDirection == Transfer::Receive || isFinished()) {
+        return;
     }
 
-    // The protocol dictates that the transfer is now "finished"
-    mProtocolState = Finished;
+    // The first stream carries the transfer header; the others only need to
+    // identify the transfer before they start claiming items
+    if (stream == mStreams.first()) {
+        if (mState == Transfer::Paused) {
+            mPausedState = Transfer::InProgress;
+        } else {
+            mState = Transfer::InProgress;
+        }
+        notify();
+        sendTransferHeader(stream);
+
+        // Start the speed timer
+        mSpeedTimer.start(SpeedInterval);
+    } else {
+        sendStreamHeader(stream);
+        sendPackets(stream);
+    }
 }
 
-void TransferPrivate::onConnected()
+void TransferPrivate::onFileReceived(Stream *stream, qint64 length)
 {
-    emit q->stateChanged(mState = Transfer::InProgress);
-    sendTransferHeader();
+    if (isFinished()) {
+        return;
+    }
+
+    if (!stream->receivingFile || stream->protocolState != ItemContent) {
+        setError(tr("protocol error - unexpected content"), true);
+        return;
+    }
+
+    // The transport has already written the data to the item
+    mStats.writeBytes += length;
+    ++mStats.writeCount;
+
+    mBytesTransferred += length;
+    stream->currentItemBytesTransferred += length;
+    mLastIntervalBytesTransferred += length;
 
-    // Start the speed timer
-    mSpeedTimer.start(SpeedInterval);
+    updateProgress();
+
+    if (stream->currentItemBytesTransferred >= stream->currentItemBytesTotal) {
+        processNext(stream);
+    }
 }
 
-void TransferPrivate::onPacketReceived(Packet *packet)
+void TransferPrivate::onPacketReceived(Stream *stream, const Packet &packet)
 {
+    // Once the transfer has finished, any packets still in flight on other
+    // streams can be ignored
+    if (isFinished()) {
+        return;
+    }
+
     // If an error packet is received, set the error and quit
-    if (packet->type() == Packet::Error) {
-        setError(packet->content());
+    if (packet.type() == Packet::Error) {
+        setError(packet.content());
         return;
     }
 
     if (mDirection == Transfer::Send) {
 
-        // The only packet expected when sending items is the success packet
-        // which indicates the receiver got all of the files
-        if (mProtocolState == Finished && packet->type() == Packet::Success) {
+        // The first stream may receive the acknowledgement of the requested
+        // features - if it arrives after the timeout, it is ignored
+        if (packet.type() == Packet::Json && stream == mStreams.first()) {
+            if (stream->protocolState == Negotiating) {
+                processNegotiation(stream, packet);
+            }
+            return;
+        }
+
+        // Signatures are sent in reply to item headers requesting them
+        if (packet.type() == Packet::Signature && stream->protocolState == ItemSignature) {
+            processItemSignature(stream, packet);
+            return;
+        }
+
+        // The only other packet expected when sending items is the success
+        // packet which indicates the receiver got all of the files
+        if (mItemIndex >= mItemCount && packet.type() == Packet::Success) {
             setSuccess();
             return;
         }
 
     } else {
 
+        // Chunks may arrive on any stream sharing the striped item
+        if (packet.type() == Packet::Chunk) {
+            processItemChunk(stream, packet);
+            return;
+        }
+
+        // Batches take the place of an item header (which may follow the last
+        // chunk that a stream sent of a striped item)
+        if (packet.type() == Packet::Batch && (stream->protocolState == ItemHeader ||
+                (stream->protocolState == ItemContent && stream->stripeIndex != -1))) {
+            processBatch(stream, packet);
+            return;
+        }
+
         // Dispatch the packet to the appropriate method based on state
-        switch (mProtocolState) {
+        switch (stream->protocolState) {
         case TransferHeader:
-            processTransferHeader(packet);
+            processTransferHeader(stream, packet);
             return;
         case ItemHeader:
-            processItemHeader(packet);
+            processItemHeader(stream, packet);
             return;
         case ItemContent:
-            processItemContent(packet);
+
+            // Once a stream has sent its last chunk of a striped item, the
+            // next item header may arrive before the item is complete
+            if (stream->stripeIndex != -1) {
+                processItemHeader(stream, packet);
+            } else if (packet.type() == Packet::Delta) {
+                processItemDelta(stream, packet);
+            } else {
+                processItemContent(stream, packet);
+            }
             return;
+        case ItemDigest:
+            if (packet.type() == Packet::Digest) {
+                processItemDigest(stream, packet);
+                return;
+            }
+            break;
+        case Negotiating:
+        case ItemSignature:
         case Finished:
             return;
         }
@@ -393,33 +2199,87 @@ void TransferPrivate::onPacketReceived(Packet *packet)
     setError(tr("protocol error - unexpected packet"), true);
 }
 
-void TransferPrivate::onPacketSent()
+void TransferPrivate::onPacketSent(Stream *stream)
 {
     // We don't care about sent packets when receiving data
     if (mDirection == Transfer::Receive) {
         return;
     }
 
-    switch (mProtocolState) {
-    case TransferHeader:
-        sendTransferHeader();
-        break;
-    case ItemHeader:
-        sendItemHeader();
-        break;
-    case ItemContent:
-        sendItemContent();
-        break;
-    case Finished:
-        break;
+    // Refill the window once enough of it has drained
+    if (stream->transport->bytesToWrite() <= mLowWatermark) {
+        sendPackets(stream);
     }
 }
 
-void TransferPrivate::onError(const QString &message)
+void TransferPrivate::onError(Stream *stream, const QString &message)
 {
+    // An additional stream that failed to connect is not fatal since the
+    // items it would have carried are picked up by the other streams
+    if (mDirection == Transfer::Send && stream != mStreams.first() &&
+            stream->protocolState == TransferHeader) {
+        log(Message::Warning, QString("unable to open additional stream: %1").arg(message));
+        Transport *transport = stream->transport;
+        removeStream(stream);
+        transport->deleteLater();
+        return;
+    }
+
     setError(message, true);
 }
 
+void TransferPrivate::onNegotiationTimeout()
+{
+    Stream *stream = mStreams.first();
+    if (stream->protocolState != Negotiating) {
+        return;
+    }
+
+    log(Message::Info, "receiver did not acknowledge features; using legacy protocol");
+
+    stream->transport->setPeerFeatures(QStringList());
+    stream->protocolState = ItemHeader;
+    sendPackets(stream);
+}
+
+void TransferPrivate::onThrottleTimeout()
+{
+    if (mState != Transfer::InProgress) {
+        return;
+    }
+
+    foreach (Stream *stream, mStreams) {
+        if (mDirection == Transfer::Send) {
+            sendPackets(stream);
+        } else if (!isReadBlocked()) {
+            stream->transport->setReadPaused(false);
+        }
+    }
+}
+
+void TransferPrivate::onItemsClosed()
+{
+    foreach (Item *item, mWriteBehind->takeClosed()) {
+        QPair<qint32, qint64> completed = mClosingItems.take(item);
+        delete item;
+
+        if (mJournal && completed.first != -1) {
+            mJournal->setCompleted(completed.first, completed.second);
+        }
+    }
+}
+
+void TransferPrivate::onWritesDrained()
+{
+    if (mState != Transfer::InProgress || isReadBlocked()) {
+        return;
+    }
+
+    foreach (Stream *stream, mStreams) {
+        stream->transport->setReadPaused(false);
+    }
+}
+
 void TransferPrivate::onTimeout()
 {
     auto curMs = QDateTime::currentMSecsSinceEpoch();
@@ -430,14 +2290,121 @@ void TransferPrivate::onTimeout()
         (static_cast<double>(curMs - mLastInterval) / 1000)
     );
 
-    // If the speed differs from the previous value, emit a signal
-    if (newSpeed != mSpeed) {
-        emit q->speedChanged(mSpeed = newSpeed);
-    }
+    // Publish the speed (only signalled if it changed) along with the stats
+    mSpeed = newSpeed;
+    notify();
 
     // Reset the calculation variables
     mLastInterval = curMs;
     mLastIntervalBytesTransferred = 0;
+
+    // Periodically record progress in case the application exits abruptly
+    if (mJournal) {
+        updateJournal();
+    }
+}
+
+void TransferPrivate::cancel()
+{
+    if (!isFinished()) {
+        setError(tr("transfer cancelled"), true);
+    }
+}
+
+void TransferPrivate::pause()
+{
+    if (mState != Transfer::Queued && mState != Transfer::Connecting &&
+            mState != Transfer::InProgress) {
+        return;
+    }
+
+    // Packets are no longer sent or read while paused - those in flight are
+    // still processed
+    mPausedState = mState;
+    mState = Transfer::Paused;
+    if (mDirection == Transfer::Receive) {
+        foreach (Stream *stream, mStreams) {
+            stream->transport->setReadPaused(true);
+        }
+    }
+    notify();
+}
+
+void TransferPrivate::resume()
+{
+    if (mState != Transfer::Paused) {
+        return;
+    }
+
+    mState = mPausedState;
+    notify();
+
+    if (mState == Transfer::InProgress) {
+        foreach (Stream *stream, mStreams) {
+            if (mDirection == Transfer::Send) {
+                sendPackets(stream);
+            } else if (!isReadBlocked()) {
+                stream->transport->setReadPaused(false);
+            }
+        }
+    }
+}
+
+void TransferPrivate::onStarted(Transport *transport)
+{
+    // The transfer may have been cancelled before it started
+    if (isFinished()) {
+        delete transport;
+        return;
+    }
+
+    addStream(transport);
+    if (mState == Transfer::Paused) {
+        mPausedState = Transfer::Connecting;
+    } else {
+        mState = Transfer::Connecting;
+    }
+    notify();
+}
+
+void TransferPrivate::onStartFailed(const QString &message)
+{
+    if (!isFinished()) {
+        setError(message);
+    }
+}
+
+void TransferPrivate::onStreamOpened(Transport *transport)
+{
+    addStream(transport);
+}
+
+void TransferPrivate::onStreamJoined(Transport *transport)
+{
+    PendingStream *pending = transport->findChild<PendingStream*>();
+    QList<Packet> packets = pending->packets;
+    delete pending;
+
+    // The transfer header has already been received on the new stream
+    Stream *stream = addStream(transport);
+    stream->protocolState = ItemHeader;
+
+    foreach (const Packet &packet, packets) {
+        onPacketReceived(stream, packet);
+    }
+}
+
+void TransferPrivate::onStreamRejected(Transport *transport)
+{
+    delete transport->findChild<PendingStream*>();
+
+    addStream(transport);
+    setError(tr("stream for unknown transfer"), true);
+}
+
+void TransferPrivate::onStreamHandedOver()
+{
+    setSuccess();
 }
 
 Transfer::Transfer(Application *application, Device *device, Bundle *bundle, QObject *parent)
@@ -452,6 +2419,16 @@ Transfer::Transfer(Application *application, Transport *transport, QObject *pare
 {
 }
 
+Transfer::~Transfer()
+{
+    // The worker thread may be in the middle of processing a packet
+    if (d->thread() == QThread::currentThread()) {
+        delete d;
+    } else {
+        d->deleteLater();
+    }
+}
+
 Transfer::Direction Transfer::direction() const
 {
     return d->mDirection;
@@ -459,40 +2436,78 @@ Transfer::Direction Transfer::direction() const
 
 Transfer::State Transfer::state() const
 {
-    return d->mState;
+    return d->mPublished.state;
+}
+
+Transfer::Priority Transfer::priority() const
+{
+    return d->mPriority;
+}
+
+void Transfer::setPriority(Priority priority)
+{
+    d->mPriority = priority;
+    d->mModel->scheduleLater();
 }
 
 int Transfer::progress() const
 {
-    return d->mProgress;
+    return d->mPublished.progress;
 }
 
 qint64 Transfer::speed() const
 {
-    return d->mSpeed;
+    return d->mPublished.speed;
 }
 
 qint64 Transfer::bytesRemaining() const
 {
-    return d->mBytesTotal - d->mBytesTransferred;
+    return d->mPublished.bytesRemaining;
+}
+
+QVariantMap Transfer::stats() const
+{
+    const TransferPrivate::Stats &stats = d->mPublished.stats;
+    return QVariantMap{
+        { "readTime", stats.readTime },
+        { "readBytes", stats.readBytes },
+        { "readCount", stats.readCount },
+        { "writeTime", stats.writeTime },
+        { "writeBytes", stats.writeBytes },
+        { "writeCount", stats.writeCount },
+        { "headerTime", stats.headerTime },
+        { "headerCount", stats.headerCount },
+        { "blockedTime", stats.blockedTime },
+        { "blockedCount", stats.blockedCount }
+    };
 }
 
 QString Transfer::deviceName() const
 {
-    return d->mDeviceName;
+    return d->mPublished.deviceName;
 }
 
 QString Transfer::error() const
 {
-    return d->mError;
+    return d->mPublished.error;
 }
 
 bool Transfer::isFinished() const
 {
-    return d->mState == Failed || d->mState == Succeeded;
+    return d->mPublished.state == Failed || d->mPublished.state == Succeeded;
 }
 
 void Transfer::cancel()
 {
-    d->setError(tr("transfer cancelled"), true);
+    QMetaObject::invokeMethod(d, "cancel");
+}
+
+void Transfer::pause()
+{
+    QMetaObject::invokeMethod(d, "pause");
+}
+
+void Transfer::resume()
+{
+    QMetaObject::invokeMethod(d, "resume");
 }
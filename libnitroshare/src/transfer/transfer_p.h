@@ -25,17 +25,56 @@
 #ifndef LIBNITROSHARE_TRANSFER_P_H
 #define LIBNITROSHARE_TRANSFER_P_H
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QMap>
+#include <QMutex>
 #include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QSet>
+#include <QStringList>
 #include <QTimer>
+#include <QVariantMap>
 
+#include <nitroshare/device.h>
 #include <nitroshare/transfer.h>
 
+#include <nitroshare/message.h>
+#include <nitroshare/packet.h>
+
+#include "compression_p.h"
+#include "digest_p.h"
+
 class Application;
+class BandwidthGovernor;
 class Bundle;
-class Device;
+class DeltaEncoder;
 class Item;
-class Packet;
+class QThread;
+class TransferJournal;
+class TransferModelPrivate;
+class TransferWorkerPool;
 class Transport;
+class ReadAhead;
+class WriteBehind;
+
+/*
+ * Packets that arrive on a stream while it is being handed over to another
+ * transfer - the object is a child of the transport so it moves with it
+ */
+class PendingStream : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit PendingStream(Transport *transport);
+
+    QList<Packet> packets;
+};
 
 class TransferPrivate : public QObject
 {
@@ -43,23 +82,174 @@ class TransferPrivate : public QObject
 
 public:
 
+    enum ProtocolState {
+        TransferHeader,
+        Negotiating,
+        ItemHeader,
+        ItemSignature,
+        ItemContent,
+        ItemDigest,
+        Finished
+    };
+
+    /*
+     * A transfer consists of one or more streams, each with its own transport
+     * and protocol state; items are spread across the streams and all of the
+     * counters below are shared between them
+     */
+    struct Stream
+    {
+        explicit Stream(Transport *transport);
+        ~Stream();
+
+        Transport *transport;
+        ProtocolState protocolState;
+
+        Item *currentItem;
+        qint32 currentItemIndex;
+        qint64 currentItemBytesTransferred;
+        qint64 currentItemBytesTotal;
+
+        qint32 stripeIndex;
+        DeltaEncoder *deltaEncoder;
+        int compressionBackoff;
+        Digest *digest;
+
+        // Content is written to the item by the transport
+        bool receivingFile;
+
+        // Started when the send window fills up
+        QElapsedTimer blockedTimer;
+    };
+
+    /*
+     * Large items are split into chunks that may be sent over any stream; the
+     * receiver writes each chunk at its offset so the order does not matter
+     * and keeps track of the ranges received so far so that chunks that are
+     * repeated or overlap are only counted once
+     */
+    struct Stripe
+    {
+        qint64 addRange(qint64 offset, qint64 length);
+
+        Item *item;
+        qint64 bytesTransferred;
+        qint64 bytesTotal;
+
+        // Start of each received range mapped to its end
+        QMap<qint64, qint64> ranges;
+    };
+
+    /*
+     * Time (in microseconds) and data spent in each phase of the transfer -
+     * blocked time is summed over all streams and may exceed the wall time
+     */
+    struct Stats
+    {
+        qint64 readTime;
+        qint64 readBytes;
+        qint64 readCount;
+        qint64 writeTime;
+        qint64 writeBytes;
+        qint64 writeCount;
+        qint64 headerTime;
+        qint64 headerCount;
+        qint64 blockedTime;
+        qint64 blockedCount;
+    };
+
+    /*
+     * Properties of the transfer visible to the main thread - the worker
+     * thread fills in a snapshot and the main thread publishes it
+     */
+    struct Status
+    {
+        Transfer::State state;
+        int progress;
+        qint64 speed;
+        qint64 bytesRemaining;
+        QString deviceName;
+        QString error;
+        QString streamId;
+        Stats stats;
+    };
+
     TransferPrivate(Transfer *transfer,
                     Application *mApplication,
                     Device *device,
                     Transport *mTransport,
                     Bundle *mBundle);
+    virtual ~TransferPrivate();
 
-    void sendTransferHeader();
-    void sendItemHeader();
-    void sendItemContent();
-    void sendNext();
+    Stream *addStream(Transport *transport);
+    void removeStream(Stream *stream);
+    void openStreams(int count);
+    void handOver(Transport *transport, const char *method);
+    void start();
 
-    void processTransferHeader(Packet *packet);
-    void processItemHeader(Packet *packet);
-    void processItemContent(Packet *packet);
-    void processNext();
+    bool isFinished() const;
+    bool acceptsStream(const QString &id);
+    Status currentStatus() const;
+    void notify();
+    void publishStatus();
+    void log(Message::Type type, const QString &message);
+
+    QString resumeKey() const;
+    void skipItems();
+    bool isDeltaItem(Item *item) const;
+    bool isBatchItem(Item *item, qint32 index) const;
+    QByteArray encodeHeader(const QVariantMap &header) const;
+    bool decodeHeader(const QByteArray &data, bool cbor, QVariantMap &header);
+    bool checkSpace();
+    Item *createItem(const QVariantMap &header);
+    bool canSendFile(Stream *stream) const;
+    bool sendFileBlock(Stream *stream, Item *item, Packet::Type type,
+                       const QByteArray &prefix, qint64 offset, qint64 length);
+    void prefetchItems();
+    bool openItem(Item *item);
+    bool rewindItem(Item *item);
+    QByteArray readItem(Item *item);
+    void closeItem(Item *item);
+    void writeItem(Item *item, const QByteArray &data);
+    void writeItemLater(Item *item, qint64 offset, const QByteArray &data, bool seek);
+    void finishItem(Item *item, qint32 index, qint64 size);
+    void flushWrites();
+    bool isReadBlocked() const;
+    Stats writeStats() const;
+    void updateJournal();
+
+    void sendPackets(Stream *stream);
+    void sendTransferHeader(Stream *stream);
+    void sendStreamHeader(Stream *stream);
+    void sendItemHeader(Stream *stream);
+    void sendItemContent(Stream *stream);
+    void sendItemChunk(Stream *stream);
+    void sendItemDelta(Stream *stream);
+    bool sendBatch(Stream *stream);
+    void sendNext(Stream *stream);
+
+    void processNegotiation(Stream *stream, const Packet &packet);
+
+    void processTransferHeader(Stream *stream, const Packet &packet);
+    void processStreamHeader(Stream *stream, const QJsonObject &object);
+    void processItemHeader(Stream *stream, const Packet &packet);
+    void processItemContent(Stream *stream, const Packet &packet);
+    void processItemChunk(Stream *stream, const Packet &packet);
+    void processItemSignature(Stream *stream, const Packet &packet);
+    void processItemDelta(Stream *stream, const Packet &packet);
+    void processItemDigest(Stream *stream, const Packet &packet);
+    bool copyItemData(Item *item, qint64 from, qint64 to, qint64 length);
+    void processBatch(Stream *stream, const Packet &packet);
+    void processNext(Stream *stream);
 
     void updateProgress();
+    void throttleReceive(qint64 bytes);
+
+    void onConnected(Stream *stream);
+    void onPacketReceived(Stream *stream, const Packet &packet);
+    void onFileReceived(Stream *stream, qint64 length);
+    void onPacketSent(Stream *stream);
+    void onError(Stream *stream, const QString &message);
 
     void setSuccess(bool send = false);
     void setError(const QString &message, bool send = false);
@@ -67,18 +257,56 @@ public:
     Transfer *const q;
 
     Application *mApplication;
-    Transport *mTransport;
+    TransferModelPrivate *mModel;
+    TransferWorkerPool *mPool;
+    BandwidthGovernor *mGovernor;
+    QThread *mMainThread;
+
+    QMutex mStatusMutex;
+    Status mStatus;
+    bool mStatusPending;
+    Status mPublished;
+
+    QPointer<Device> mDevice;
+
+    // Only used by the scheduler on the main thread
+    QString mDeviceUuid;
+    Transfer::Priority mPriority;
+    bool mStarted;
     Bundle *mBundle;
 
-    enum {
-        TransferHeader,
-        ItemHeader,
-        ItemContent,
-        Finished
-    } mProtocolState;
+    QList<Stream*> mStreams;
+    QString mId;
+    QStringList mFeatures;
+    int mStreamCount;
+    QTimer mNegotiationTimer;
+
+    QHash<qint32, Stripe> mStripes;
+    qint32 mActiveStripe;
+    qint64 mStripeThreshold;
+
+    TransferJournal *mJournal;
+    QSet<qint32> mResumeCompleted;
+    QHash<qint32, qint64> mResumeOffsets;
+    qint64 mResumeThreshold;
+
+    qint64 mDeltaThreshold;
+
+    bool mCompressionEnabled;
+    Compression::Method mCompression;
+
+    qint64 mBatchThreshold;
+
+    Digest::Method mDigest;
+
+    bool mZeroCopy;
+
+    qint64 mMaxPacketSize;
+    qint64 mPeerMaxPacketSize;
 
     Transfer::Direction mDirection;
     Transfer::State mState;
+    Transfer::State mPausedState;
     int mProgress;
     QString mDeviceName;
     QString mError;
@@ -88,21 +316,50 @@ public:
     qint64 mBytesTransferred;
     qint64 mBytesTotal;
 
-    Item *mCurrentItem;
-    qint64 mCurrentItemBytesTransferred;
-    qint64 mCurrentItemBytesTotal;
+    qint64 mHighWatermark;
+    qint64 mLowWatermark;
+
+    // Device limits apply per UUID - senders that do not identify themselves
+    // share a single limit
+    QString mLimitKey;
+    QTimer mThrottleTimer;
+
+    ReadAhead *mReadAhead;
+    qint32 mPrefetchIndex;
+
+    WriteBehind *mWriteBehind;
+    QHash<Item*, QPair<qint32, qint64>> mClosingItems;
+
+    Stats mStats;
 
     qint64 mSpeed;
     QTimer mSpeedTimer;
     qint64 mLastInterval;
     qint64 mLastIntervalBytesTransferred;
 
+Q_SIGNALS:
+
+    void statusChanged();
+    void streamsRequested(int count);
+    void streamReceived(const QString &id, Transport *transport);
+
 public Q_SLOTS:
 
-    void onConnected();
-    void onPacketReceived(Packet *packet);
-    void onPacketSent();
-    void onError(const QString &message);
+    void cancel();
+    void pause();
+    void resume();
+
+    void onStarted(Transport *transport);
+    void onStartFailed(const QString &message);
+    void onStreamOpened(Transport *transport);
+    void onStreamJoined(Transport *transport);
+    void onStreamRejected(Transport *transport);
+    void onStreamHandedOver();
+
+    void onNegotiationTimeout();
+    void onThrottleTimeout();
+    void onItemsClosed();
+    void onWritesDrained();
     void onTimeout();
 };
 
@@ -0,0 +1,157 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRegExp>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "transferjournal_p.h"
+
+TransferJournal::TransferJournal(const QString &key)
+    : mFilename(QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation))
+          .absoluteFilePath(QString("journal/%1.json").arg(key))),
+      mModified(false)
+{
+    QFile file(mFilename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    // Strings must be used for 64-bit numbers
+    QJsonObject object = QJsonDocument::fromJson(file.readAll()).object();
+    QJsonObject completed = object.value("completed").toObject();
+    for (auto i = completed.constBegin(); i != completed.constEnd(); ++i) {
+        mCompleted.insert(i.key().toInt(), i.value().toString().toLongLong());
+    }
+    QJsonObject partial = object.value("partial").toObject();
+    for (auto i = partial.constBegin(); i != partial.constEnd(); ++i) {
+        mPartial.insert(i.key().toInt(), i.value().toString().toLongLong());
+    }
+}
+
+bool TransferJournal::isValidKey(const QString &key)
+{
+    // The key is used as a filename and must not contain anything else
+    return QRegExp("[0-9a-f]{40}").exactMatch(key);
+}
+
+int TransferJournal::completedCount() const
+{
+    return mCompleted.count();
+}
+
+qint64 TransferJournal::completedBytes() const
+{
+    qint64 completedBytes = 0;
+    foreach (qint64 size, mCompleted) {
+        completedBytes += size;
+    }
+    return completedBytes;
+}
+
+QJsonObject TransferJournal::toJson() const
+{
+    QJsonArray completed;
+    foreach (qint32 index, mCompleted.keys()) {
+        completed.append(QString::number(index));
+    }
+
+    QJsonObject offsets;
+    for (auto i = mPartial.constBegin(); i != mPartial.constEnd(); ++i) {
+        offsets.insert(QString::number(i.key()), QString::number(i.value()));
+    }
+
+    return QJsonObject{
+        { "completed", completed },
+        { "offsets", offsets }
+    };
+}
+
+void TransferJournal::setCompleted(qint32 index, qint64 size)
+{
+    mPartial.remove(index);
+    mCompleted.insert(index, size);
+    mModified = true;
+}
+
+qint64 TransferJournal::partialOffset(qint32 index) const
+{
+    return mPartial.value(index, -1);
+}
+
+void TransferJournal::setPartial(qint32 index, qint64 offset)
+{
+    if (mPartial.value(index) != offset) {
+        mPartial.insert(index, offset);
+        mModified = true;
+    }
+}
+
+void TransferJournal::removePartial(qint32 index)
+{
+    if (mPartial.remove(index)) {
+        mModified = true;
+    }
+}
+
+void TransferJournal::save()
+{
+    if (!mModified) {
+        return;
+    }
+
+    QJsonObject completed;
+    for (auto i = mCompleted.constBegin(); i != mCompleted.constEnd(); ++i) {
+        completed.insert(QString::number(i.key()), QString::number(i.value()));
+    }
+
+    QJsonObject partial;
+    for (auto i = mPartial.constBegin(); i != mPartial.constEnd(); ++i) {
+        partial.insert(QString::number(i.key()), QString::number(i.value()));
+    }
+
+    // Write the journal atomically so that it is never left half-written
+    QDir().mkpath(QFileInfo(mFilename).absolutePath());
+    QSaveFile file(mFilename);
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write(QJsonDocument(QJsonObject{
+            { "completed", completed },
+            { "partial", partial }
+        }).toJson(QJsonDocument::Compact));
+        if (file.commit()) {
+            mModified = false;
+        }
+    }
+}
+
+void TransferJournal::remove()
+{
+    QFile::remove(mFilename);
+    mModified = false;
+}
@@ -0,0 +1,67 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_TRANSFERJOURNAL_P_H
+#define LIBNITROSHARE_TRANSFERJOURNAL_P_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QString>
+
+/*
+ * Record of the items received during an interrupted transfer, stored on disk
+ * under a key provided by the sender; when the sender retries the transfer,
+ * it indicates which items can be skipped and where partial items continue
+ */
+class TransferJournal
+{
+public:
+
+    explicit TransferJournal(const QString &key);
+
+    static bool isValidKey(const QString &key);
+
+    int completedCount() const;
+    qint64 completedBytes() const;
+
+    QJsonObject toJson() const;
+
+    void setCompleted(qint32 index, qint64 size);
+    qint64 partialOffset(qint32 index) const;
+    void setPartial(qint32 index, qint64 offset);
+    void removePartial(qint32 index);
+
+    void save();
+    void remove();
+
+private:
+
+    QString mFilename;
+    bool mModified;
+
+    QHash<qint32, qint64> mCompleted;
+    QHash<qint32, qint64> mPartial;
+};
+
+#endif // LIBNITROSHARE_TRANSFERJOURNAL_P_H
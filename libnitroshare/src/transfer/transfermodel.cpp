@@ -22,14 +22,28 @@
  * IN THE SOFTWARE.
  */
 
+#include <algorithm>
+
+#include <QHash>
+#include <QMetaObject>
+
+#include <nitroshare/application.h>
+#include <nitroshare/settingsregistry.h>
 #include <nitroshare/transfer.h>
 #include <nitroshare/transfermodel.h>
+#include <nitroshare/transportserverregistry.h>
 
+#include "transfer_p.h"
 #include "transfermodel_p.h"
 
 TransferModelPrivate::TransferModelPrivate(TransferModel *model)
     : QObject(model),
-      q(model)
+      q(model),
+      settingsRegistry(nullptr),
+      transportServerRegistry(nullptr),
+      maxActive(0),
+      maxActivePerDevice(0),
+      schedulePending(false)
 {
 }
 
@@ -40,12 +54,197 @@ TransferModelPrivate::~TransferModelPrivate()
     qDeleteAll(transfers);
 }
 
+Transfer *TransferModelPrivate::findStreamTransfer(const QString &id) const
+{
+    foreach (Transfer *transfer, transfers) {
+        if (transfer->direction() == Transfer::Receive && transfer->d->acceptsStream(id)) {
+            return transfer;
+        }
+    }
+    return nullptr;
+}
+
+void TransferModelPrivate::joinStream(const QString &id, Transport *transport, Transfer *placeholder)
+{
+    // Find the transfer that the stream belongs to - if there is none, the
+    // placeholder takes the transport back in order to report the error
+    Transfer *transfer = findStreamTransfer(id);
+    if (!transfer) {
+        placeholder->d->handOver(transport, "onStreamRejected");
+        return;
+    }
+    transfer->d->handOver(transport, "onStreamJoined");
+
+    // The placeholder transfer that received the stream is no longer needed
+    int index = transfers.indexOf(placeholder);
+    if (index != -1) {
+        q->beginRemoveRows(QModelIndex(), index, index);
+        transfers.removeAt(index);
+        q->endRemoveRows();
+        placeholder->deleteLater();
+    } else {
+        QMetaObject::invokeMethod(placeholder->d, "onStreamHandedOver");
+    }
+}
+
+void TransferModelPrivate::setRegistries(SettingsRegistry *newSettingsRegistry,
+                                         TransportServerRegistry *newTransportServerRegistry)
+{
+    settingsRegistry = newSettingsRegistry;
+    transportServerRegistry = newTransportServerRegistry;
+
+    // The limits are shared by all transfers, so they are applied here once
+    // and again whenever they change instead of by each transfer
+    connect(settingsRegistry, &SettingsRegistry::settingsChanged,
+            this, &TransferModelPrivate::onSettingsChanged);
+    onSettingsChanged({
+        Application::TransferUploadLimitSettingName,
+        Application::TransferMaxActiveSettingName,
+        Application::TransferReceiveBudgetSettingName
+    });
+}
+
+void TransferModelPrivate::configure(int newMaxActive, int newMaxActivePerDevice)
+{
+    if (newMaxActive != maxActive || newMaxActivePerDevice != maxActivePerDevice) {
+        maxActive = newMaxActive;
+        maxActivePerDevice = newMaxActivePerDevice;
+        scheduleLater();
+    }
+}
+
+bool TransferModelPrivate::isQueueing() const
+{
+    return maxActive > 0 || maxActivePerDevice > 0;
+}
+
+void TransferModelPrivate::scheduleLater()
+{
+    // Scheduling is triggered by state changes, which may be emitted while
+    // a transfer is being started, so it always runs from the event loop
+    if (!schedulePending) {
+        schedulePending = true;
+        QMetaObject::invokeMethod(this, "schedule", Qt::QueuedConnection);
+    }
+}
+
+void TransferModelPrivate::onSettingsChanged(const QStringList &names)
+{
+    if (names.contains(Application::TransferUploadLimitSettingName) ||
+            names.contains(Application::TransferDownloadLimitSettingName) ||
+            names.contains(Application::TransferDeviceLimitSettingName) ||
+            names.contains(Application::TransferLimitScheduleSettingName)) {
+        governor.configure(
+            settingsRegistry->value(Application::TransferUploadLimitSettingName).toLongLong() * 1024,
+            settingsRegistry->value(Application::TransferDownloadLimitSettingName).toLongLong() * 1024,
+            settingsRegistry->value(Application::TransferDeviceLimitSettingName).toLongLong() * 1024,
+            settingsRegistry->value(Application::TransferLimitScheduleSettingName).toString()
+        );
+    }
+
+    if (names.contains(Application::TransferMaxActiveSettingName) ||
+            names.contains(Application::TransferMaxActivePerDeviceSettingName)) {
+        configure(
+            settingsRegistry->value(Application::TransferMaxActiveSettingName).toInt(),
+            settingsRegistry->value(Application::TransferMaxActivePerDeviceSettingName).toInt()
+        );
+    }
+
+    if (names.contains(Application::TransferReceiveBudgetSettingName)) {
+        transportServerRegistry->setReceiveBudget(
+            settingsRegistry->value(Application::TransferReceiveBudgetSettingName).toLongLong()
+        );
+    }
+}
+
 void TransferModelPrivate::sendDataChanged()
 {
     int row = transfers.indexOf(qobject_cast<Transfer*>(sender()));
     emit q->dataChanged(q->index(row, 0), q->index(row, 0));
 }
 
+void TransferModelPrivate::schedule()
+{
+    schedulePending = false;
+
+    // Find the transfers sending items that are running and those waiting
+    // to start (transfers preempted earlier are waiting to be resumed)
+    QList<Transfer*> active;
+    QList<Transfer*> waiting;
+    foreach (Transfer *transfer, transfers) {
+        if (transfer->direction() != Transfer::Send || transfer->isFinished()) {
+            continue;
+        }
+        if (preempted.contains(transfer)) {
+            waiting.append(transfer);
+        } else if (!transfer->d->mStarted) {
+            if (transfer->state() == Transfer::Queued) {
+                waiting.append(transfer);
+            }
+        } else if (transfer->state() != Transfer::Paused) {
+            active.append(transfer);
+        }
+    }
+    for (auto i = preempted.begin(); i != preempted.end();) {
+        if (waiting.contains(*i)) {
+            ++i;
+        } else {
+            i = preempted.erase(i);
+        }
+    }
+
+    QHash<QString, int> activePerDevice;
+    foreach (Transfer *transfer, active) {
+        ++activePerDevice[transfer->d->mDeviceUuid];
+    }
+    auto hasRoom = [&](const QString &uuid) {
+        return (!maxActive || active.count() < maxActive) &&
+                (!maxActivePerDevice || activePerDevice.value(uuid) < maxActivePerDevice);
+    };
+
+    // Start (or resume) the waiting transfers in order of priority, with
+    // earlier transfers going first among those with the same priority
+    std::stable_sort(waiting.begin(), waiting.end(), [](Transfer *a, Transfer *b) {
+        return a->priority() > b->priority();
+    });
+    foreach (Transfer *transfer, waiting) {
+        QString uuid = transfer->d->mDeviceUuid;
+
+        // Make room by pausing the active transfer with the lowest priority
+        // (and the latest to start) if it is lower than this one - when it
+        // is the device limit that applies, it must be for the same device
+        if (!hasRoom(uuid)) {
+            bool sameDevice = maxActivePerDevice && activePerDevice.value(uuid) >= maxActivePerDevice;
+            Transfer *victim = nullptr;
+            foreach (Transfer *candidate, active) {
+                if (candidate->priority() < transfer->priority() &&
+                        (!sameDevice || candidate->d->mDeviceUuid == uuid) &&
+                        (!victim || candidate->priority() <= victim->priority())) {
+                    victim = candidate;
+                }
+            }
+            if (!victim) {
+                continue;
+            }
+            victim->pause();
+            preempted.append(victim);
+            active.removeOne(victim);
+            --activePerDevice[victim->d->mDeviceUuid];
+            if (!hasRoom(uuid)) {
+                continue;
+            }
+        }
+
+        if (preempted.removeOne(transfer)) {
+            transfer->resume();
+        } else {
+            transfer->d->start();
+        }
+        active.append(transfer);
+        ++activePerDevice[uuid];
+    }
+}
+
 TransferModel::TransferModel(QObject *parent)
     : QAbstractListModel(parent),
       d(new TransferModelPrivate(this))
@@ -58,10 +257,14 @@ void TransferModel::add(Transfer *transfer)
     connect(transfer, &Transfer::progressChanged, d, &TransferModelPrivate::sendDataChanged);
     connect(transfer, &Transfer::deviceNameChanged, d, &TransferModelPrivate::sendDataChanged);
     connect(transfer, &Transfer::errorChanged, d, &TransferModelPrivate::sendDataChanged);
+    connect(transfer, &Transfer::stateChanged, d, &TransferModelPrivate::scheduleLater);
 
     beginInsertRows(QModelIndex(), d->transfers.count(), d->transfers.count());
     d->transfers.append(transfer);
     endInsertRows();
+
+    // Queued transfers are started once control returns to the event loop
+    d->scheduleLater();
 }
 
 void TransferModel::dismiss(int index)
@@ -72,6 +275,7 @@ void TransferModel::dismiss(int index)
             beginRemoveRows(QModelIndex(), index, index);
             d->transfers.removeAt(index);
             endRemoveRows();
+            d->preempted.removeOne(transfer);
             delete transfer;
         }
     }
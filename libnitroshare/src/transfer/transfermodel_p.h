@@ -28,8 +28,14 @@
 #include <QList>
 #include <QObject>
 
+#include "bandwidthgovernor_p.h"
+#include "transferworkerpool_p.h"
+
+class SettingsRegistry;
 class Transfer;
 class TransferModel;
+class Transport;
+class TransportServerRegistry;
 
 class TransferModelPrivate : public QObject
 {
@@ -40,13 +46,35 @@ public:
     explicit TransferModelPrivate(TransferModel *model);
     virtual ~TransferModelPrivate();
 
+    Transfer *findStreamTransfer(const QString &id) const;
+    void joinStream(const QString &id, Transport *transport, Transfer *placeholder);
+
+    void setRegistries(SettingsRegistry *newSettingsRegistry,
+                       TransportServerRegistry *newTransportServerRegistry);
+    void configure(int newMaxActive, int newMaxActivePerDevice);
+    bool isQueueing() const;
+    void scheduleLater();
+
     TransferModel *const q;
 
     QList<Transfer*> transfers;
 
+    SettingsRegistry *settingsRegistry;
+    TransportServerRegistry *transportServerRegistry;
+
+    int maxActive;
+    int maxActivePerDevice;
+    bool schedulePending;
+    QList<Transfer*> preempted;
+    // The governor must outlive the transfers on the worker threads
+    BandwidthGovernor governor;
+    TransferWorkerPool workerPool;
+
 public Q_SLOTS:
 
     void sendDataChanged();
+    void onSettingsChanged(const QStringList &names);
+    void schedule();
 };
 
 #endif // LIBNITROSHARE_TRANSFERMODEL_P_H
@@ -0,0 +1,75 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QMutexLocker>
+#include <QThread>
+
+#include "transferworkerpool_p.h"
+
+TransferWorkerPool::~TransferWorkerPool()
+{
+    // Transfers still on the threads are destroyed as each thread finishes,
+    // which requires the lock, so it must not be held here
+    foreach (QThread *thread, mThreads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
+
+QThread *TransferWorkerPool::acquire(int maxThreads)
+{
+    if (maxThreads <= 0) {
+        return nullptr;
+    }
+
+    QMutexLocker locker(&mMutex);
+
+    // Find the thread with the fewest transfers
+    QThread *thread = nullptr;
+    foreach (QThread *candidate, mThreads) {
+        if (!thread || mLoads.value(candidate) < mLoads.value(thread)) {
+            thread = candidate;
+        }
+    }
+
+    // Start another thread if all of the existing ones are busy
+    if (!thread || (mLoads.value(thread) && mThreads.count() < maxThreads)) {
+        thread = new QThread;
+        thread->setObjectName(QString("transfer-%1").arg(mThreads.count()));
+        thread->start();
+        mThreads.append(thread);
+    }
+
+    ++mLoads[thread];
+    return thread;
+}
+
+void TransferWorkerPool::release(QThread *thread)
+{
+    QMutexLocker locker(&mMutex);
+    if (mLoads.contains(thread)) {
+        --mLoads[thread];
+    }
+}
@@ -0,0 +1,220 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+#include <nitroshare/item.h>
+
+#include "writebehind_p.h"
+
+// Upper limit on the size of a single coalesced write - writes are also cut
+// at multiples of this size in the item so that they are aligned
+const int CoalesceSize = 1048576;
+
+WriteBehind::WriteBehind(qint64 capacity)
+    : mCapacity(capacity),
+      mBytesPending(0),
+      mFull(false),
+      mBusy(false),
+      mFlushing(false),
+      mStopping(false),
+      mWriteTime(0),
+      mWriteBytes(0),
+      mWriteCount(0)
+{
+    start();
+}
+
+WriteBehind::~WriteBehind()
+{
+    // Everything still in the queue is written before the thread exits
+    {
+        QMutexLocker locker(&mMutex);
+        mStopping = true;
+        mQueued.wakeOne();
+    }
+    wait();
+}
+
+void WriteBehind::write(Item *item, qint64 offset, const QByteArray &data, bool seek)
+{
+    QMutexLocker locker(&mMutex);
+
+    mBytesPending += data.size();
+    mPending[item] += data.size();
+    if (mBytesPending >= mCapacity) {
+        mFull = true;
+    }
+
+    // Append the data to the last write if it continues where that one ends
+    // without crossing a boundary; the rest starts a new write (the data may
+    // refer to a packet that is about to be freed, so it is always copied)
+    for (int pos = 0; pos < data.size();) {
+        qint64 position = offset + pos;
+        int length = static_cast<int>(qMin<qint64>(data.size() - pos,
+            CoalesceSize - position % CoalesceSize));
+        if (!mQueue.isEmpty() && position % CoalesceSize &&
+                !mQueue.last().close && mQueue.last().item == item &&
+                mQueue.last().offset + mQueue.last().data.size() == position) {
+            mQueue.last().data.append(data.constData() + pos, length);
+        } else {
+            mQueue.enqueue({ item, position, QByteArray(data.constData() + pos, length), seek && !pos, false });
+        }
+        pos += length;
+    }
+    mQueued.wakeOne();
+}
+
+void WriteBehind::close(Item *item)
+{
+    QMutexLocker locker(&mMutex);
+    mQueue.enqueue({ item, -1, QByteArray(), false, true });
+    mQueued.wakeOne();
+}
+
+void WriteBehind::flush()
+{
+    QMutexLocker locker(&mMutex);
+    mFlushing = true;
+    mQueued.wakeOne();
+    while (!mQueue.isEmpty() || mBusy) {
+        mIdle.wait(&mMutex);
+    }
+    mFlushing = false;
+}
+
+bool WriteBehind::isFull()
+{
+    QMutexLocker locker(&mMutex);
+    return mFull;
+}
+
+qint64 WriteBehind::pendingBytes(Item *item)
+{
+    QMutexLocker locker(&mMutex);
+    return mPending.value(item);
+}
+
+QList<Item*> WriteBehind::takeClosed()
+{
+    QMutexLocker locker(&mMutex);
+    QList<Item*> closed = mClosed;
+    mClosed.clear();
+    return closed;
+}
+
+void WriteBehind::addStats(qint64 &time, qint64 &bytes, qint64 &count)
+{
+    QMutexLocker locker(&mMutex);
+    time += mWriteTime;
+    bytes += mWriteBytes;
+    count += mWriteCount;
+}
+
+bool WriteBehind::isReady() const
+{
+    // A write that stops short of a boundary is held back while more data
+    // may still be appended to it, unless the data is needed on disk now
+    if (mQueue.isEmpty()) {
+        return false;
+    }
+    const Operation &operation = mQueue.head();
+    return mQueue.count() > 1 || operation.close || mFlushing || mFull ||
+            (operation.offset + operation.data.size()) % CoalesceSize == 0;
+}
+
+void WriteBehind::run()
+{
+    forever {
+        Operation operation;
+        {
+            QMutexLocker locker(&mMutex);
+            while (!isReady() && !mStopping) {
+                mQueued.wait(&mMutex);
+            }
+            if (mQueue.isEmpty()) {
+                return;
+            }
+            operation = mQueue.dequeue();
+            mBusy = true;
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        bool seeked = true;
+        if (operation.close) {
+            operation.item->close();
+        } else {
+            if (operation.seek) {
+                seeked = operation.item->seek(operation.offset);
+            }
+            if (seeked) {
+                operation.item->write(operation.data);
+            }
+        }
+
+        bool resume = false;
+        {
+            QMutexLocker locker(&mMutex);
+            mBusy = false;
+
+            if (operation.close) {
+                mClosed.append(operation.item);
+            } else {
+                mWriteTime += timer.nsecsElapsed() / 1000;
+                mWriteBytes += operation.data.size();
+                ++mWriteCount;
+
+                mBytesPending -= operation.data.size();
+                qint64 &pending = mPending[operation.item];
+                pending -= operation.data.size();
+                if (!pending) {
+                    mPending.remove(operation.item);
+                }
+
+                // Wait until half of the queue is free before reading resumes
+                if (mFull && mBytesPending < mCapacity / 2) {
+                    mFull = false;
+                    resume = true;
+                }
+            }
+
+            if (mQueue.isEmpty()) {
+                mIdle.wakeAll();
+            }
+        }
+
+        if (operation.close) {
+            emit itemsClosed();
+        }
+        if (resume) {
+            emit drained();
+        }
+        if (!seeked) {
+            emit seekFailed(operation.item->name());
+        }
+    }
+}
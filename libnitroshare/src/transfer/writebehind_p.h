@@ -0,0 +1,107 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LIBNITROSHARE_WRITEBEHIND_P_H
+#define LIBNITROSHARE_WRITEBEHIND_P_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+class Item;
+
+/*
+ * Bounded queue of writes to received items that runs on its own thread so
+ * that a slow disk does not hold up reading from the network - consecutive
+ * blocks for an item are coalesced into larger writes that are aligned to
+ * the offset in the item and items are closed in order once their data is
+ * written
+ */
+class WriteBehind : public QThread
+{
+    Q_OBJECT
+
+public:
+
+    explicit WriteBehind(qint64 capacity);
+    virtual ~WriteBehind();
+
+    void write(Item *item, qint64 offset, const QByteArray &data, bool seek);
+    void close(Item *item);
+    void flush();
+
+    bool isFull();
+    qint64 pendingBytes(Item *item);
+    QList<Item*> takeClosed();
+    void addStats(qint64 &time, qint64 &bytes, qint64 &count);
+
+Q_SIGNALS:
+
+    void itemsClosed();
+    void drained();
+    void seekFailed(const QString &name);
+
+protected:
+
+    virtual void run();
+
+private:
+
+    struct Operation
+    {
+        Item *item;
+        qint64 offset;
+        QByteArray data;
+        bool seek;
+        bool close;
+    };
+
+    bool isReady() const;
+
+    qint64 mCapacity;
+
+    QMutex mMutex;
+    QWaitCondition mQueued;
+    QWaitCondition mIdle;
+
+    QQueue<Operation> mQueue;
+    QHash<Item*, qint64> mPending;
+    qint64 mBytesPending;
+    bool mFull;
+    bool mBusy;
+    bool mFlushing;
+    bool mStopping;
+
+    QList<Item*> mClosed;
+
+    qint64 mWriteTime;
+    qint64 mWriteBytes;
+    qint64 mWriteCount;
+};
+
+#endif // LIBNITROSHARE_WRITEBEHIND_P_H
@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <nitroshare/transport.h>
+
+qint64 Transport::bytesToWrite() const
+{
+    return -1;
+}
+
+void Transport::setReadPaused(bool)
+{
+}
+
+bool Transport::canSendFile() const
+{
+    return false;
+}
+
+void Transport::sendFile(Packet::Type, const QByteArray &, int, qint64, qint64)
+{
+}
+
+bool Transport::canReceiveFile() const
+{
+    return false;
+}
+
+void Transport::receiveFile(int, qint64)
+{
+}
+
+void Transport::setMaxPacketSize(qint64)
+{
+}
+
+QStringList Transport::features() const
+{
+    return QStringList();
+}
+
+void Transport::setPeerFeatures(const QStringList &)
+{
+}
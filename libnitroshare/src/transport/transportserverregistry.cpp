@@ -22,6 +22,8 @@
  * IN THE SOFTWARE.
  */
 
+#include <QMutexLocker>
+
 #include <nitroshare/device.h>
 #include <nitroshare/transport.h>
 #include <nitroshare/transportserver.h>
@@ -30,7 +32,10 @@
 #include "transportserverregistry_p.h"
 
 TransportServerRegistryPrivate::TransportServerRegistryPrivate(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      receiveBudget(0),
+      receiveMemoryUsed(0),
+      receiveRefused(false)
 {
 }
 
@@ -60,3 +65,58 @@ Transport *TransportServerRegistry::createTransport(Device *device)
     }
     return transportServer->createTransport(device);
 }
+
+Transport *TransportServerRegistry::createDedicatedTransport(Device *device)
+{
+    TransportServer *transportServer = d->transportServers.value(device->transportName());
+    if (!transportServer) {
+        return nullptr;
+    }
+    return transportServer->createDedicatedTransport(device);
+}
+
+void TransportServerRegistry::setReceiveBudget(qint64 bytes)
+{
+    QMutexLocker locker(&d->receiveMutex);
+    d->receiveBudget = bytes;
+}
+
+qint64 TransportServerRegistry::receiveBudget() const
+{
+    QMutexLocker locker(&d->receiveMutex);
+    return d->receiveBudget;
+}
+
+qint64 TransportServerRegistry::receiveMemoryUsed() const
+{
+    QMutexLocker locker(&d->receiveMutex);
+    return d->receiveMemoryUsed;
+}
+
+bool TransportServerRegistry::reserveReceiveMemory(qint64 bytes)
+{
+    QMutexLocker locker(&d->receiveMutex);
+    if (d->receiveBudget > 0 && d->receiveMemoryUsed &&
+            d->receiveMemoryUsed + bytes > d->receiveBudget) {
+        d->receiveRefused = true;
+        return false;
+    }
+    d->receiveMemoryUsed += bytes;
+    return true;
+}
+
+void TransportServerRegistry::releaseReceiveMemory(qint64 bytes)
+{
+    bool refused;
+    {
+        QMutexLocker locker(&d->receiveMutex);
+        d->receiveMemoryUsed -= bytes;
+        refused = d->receiveRefused;
+        d->receiveRefused = false;
+    }
+
+    // Only transports that were refused are waiting for the memory
+    if (refused) {
+        emit receiveMemoryReleased();
+    }
+}
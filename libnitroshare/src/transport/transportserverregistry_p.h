@@ -26,6 +26,7 @@
 #define LIBNITROSHARE_TRANSPORTSERVERREGISTRY_P_H
 
 #include <QHash>
+#include <QMutex>
 #include <QObject>
 
 class TransportServer;
@@ -39,6 +40,12 @@ public:
     explicit TransportServerRegistryPrivate(QObject *parent);
 
     QHash<QString, TransportServer*> transportServers;
+
+    /* Transports read on worker threads, so the budget is guarded */
+    QMutex receiveMutex;
+    qint64 receiveBudget;
+    qint64 receiveMemoryUsed;
+    bool receiveRefused;
 };
 
 #endif // LIBNITROSHARE_TRANSPORTSERVERREGISTRY_P_H
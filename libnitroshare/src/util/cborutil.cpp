@@ -0,0 +1,331 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <QStringList>
+#include <QVariantList>
+#include <QVariantMap>
+#include <QtEndian>
+
+#include <nitroshare/cborutil.h>
+#include <nitroshare/qtutil.h>
+
+// Major types (the upper three bits of the initial byte)
+enum MajorType {
+    UnsignedInteger = 0,
+    NegativeInteger,
+    ByteString,
+    TextString,
+    Array,
+    Map,
+    Tag,
+    Simple
+};
+
+// Simple values and floating-point numbers (major type 7)
+const uchar SimpleFalse = 0xf4;
+const uchar SimpleTrue = 0xf5;
+const uchar SimpleNull = 0xf6;
+const uchar SimpleDouble = 0xfb;
+
+// Nesting limit for arrays and maps to guard against malicious input
+const int MaxDepth = 32;
+
+void writeHead(QByteArray &out, int major, quint64 value)
+{
+    uchar buffer[9];
+    int length;
+    buffer[0] = static_cast<uchar>(major << 5);
+    if (value < 24) {
+        buffer[0] |= static_cast<uchar>(value);
+        length = 1;
+    } else if (value <= std::numeric_limits<quint8>::max()) {
+        buffer[0] |= 24;
+        buffer[1] = static_cast<uchar>(value);
+        length = 2;
+    } else if (value <= std::numeric_limits<quint16>::max()) {
+        buffer[0] |= 25;
+        qToBigEndian<quint16>(static_cast<quint16>(value), buffer + 1);
+        length = 3;
+    } else if (value <= std::numeric_limits<quint32>::max()) {
+        buffer[0] |= 26;
+        qToBigEndian<quint32>(static_cast<quint32>(value), buffer + 1);
+        length = 5;
+    } else {
+        buffer[0] |= 27;
+        qToBigEndian<quint64>(value, buffer + 1);
+        length = 9;
+    }
+    out.append(reinterpret_cast<const char*>(buffer), length);
+}
+
+void writeValue(QByteArray &out, const QVariant &value)
+{
+    switch (value.userType()) {
+    case QMetaType::UnknownType:
+        out.append(static_cast<char>(SimpleNull));
+        break;
+    case QMetaType::Bool:
+        out.append(static_cast<char>(value.toBool() ? SimpleTrue : SimpleFalse));
+        break;
+    case QMetaType::Int:
+    case QMetaType::LongLong:
+    {
+        qint64 integer = value.toLongLong();
+        if (integer >= 0) {
+            writeHead(out, UnsignedInteger, static_cast<quint64>(integer));
+        } else {
+            writeHead(out, NegativeInteger, static_cast<quint64>(-(integer + 1)));
+        }
+        break;
+    }
+    case QMetaType::UInt:
+    case QMetaType::ULongLong:
+        writeHead(out, UnsignedInteger, value.toULongLong());
+        break;
+    case QMetaType::Float:
+    case QMetaType::Double:
+    {
+        double number = value.toDouble();
+        quint64 bits;
+        std::memcpy(&bits, &number, sizeof(bits));
+        uchar buffer[9];
+        buffer[0] = SimpleDouble;
+        qToBigEndian<quint64>(bits, buffer + 1);
+        out.append(reinterpret_cast<const char*>(buffer), sizeof(buffer));
+        break;
+    }
+    case QMetaType::QByteArray:
+    {
+        QByteArray data = value.toByteArray();
+        writeHead(out, ByteString, data.size());
+        out.append(data);
+        break;
+    }
+    case QMetaType::QVariantList:
+    case QMetaType::QStringList:
+    {
+        QVariantList list = value.toList();
+        writeHead(out, Array, list.count());
+        foreach (const QVariant &item, list) {
+            writeValue(out, item);
+        }
+        break;
+    }
+    case QMetaType::QVariantMap:
+    {
+        QVariantMap map = value.toMap();
+        writeHead(out, Map, map.count());
+        for (auto i = map.constBegin(); i != map.constEnd(); ++i) {
+            writeValue(out, i.key());
+            writeValue(out, i.value());
+        }
+        break;
+    }
+    default:
+    {
+        QByteArray text = value.toString().toUtf8();
+        writeHead(out, TextString, text.size());
+        out.append(text);
+        break;
+    }
+    }
+}
+
+bool readHead(const uchar *&pos, const uchar *end, int &major, int &info, quint64 &value)
+{
+    if (pos >= end) {
+        return false;
+    }
+    major = *pos >> 5;
+    info = *pos & 0x1f;
+    ++pos;
+
+    // Indefinite lengths (31) and the reserved values are not supported
+    if (info < 24) {
+        value = info;
+    } else if (info <= 27) {
+        int length = 1 << (info - 24);
+        if (end - pos < length) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < length; ++i) {
+            value = (value << 8) | pos[i];
+        }
+        pos += length;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double halfToDouble(quint16 half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double number;
+    if (exponent == 0) {
+        number = std::ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        number = std::ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        number = mantissa ? std::numeric_limits<double>::quiet_NaN() :
+                            std::numeric_limits<double>::infinity();
+    }
+    return half & 0x8000 ? -number : number;
+}
+
+QVariant readValue(const uchar *&pos, const uchar *end, int depth, bool &ok)
+{
+    int major, info;
+    quint64 value;
+    if (depth > MaxDepth || !readHead(pos, end, major, info, value)) {
+        ok = false;
+        return QVariant();
+    }
+
+    // Every element of an array or map occupies at least one byte, which
+    // prevents huge lengths from causing huge allocations
+    quint64 remaining = static_cast<quint64>(end - pos);
+
+    switch (major) {
+    case UnsignedInteger:
+        if (value <= static_cast<quint64>(std::numeric_limits<qint64>::max())) {
+            return static_cast<qint64>(value);
+        }
+        return value;
+    case NegativeInteger:
+        if (value <= static_cast<quint64>(std::numeric_limits<qint64>::max())) {
+            return -1 - static_cast<qint64>(value);
+        }
+        break;
+    case ByteString:
+    case TextString:
+    {
+        if (value > remaining) {
+            break;
+        }
+        const char *data = reinterpret_cast<const char*>(pos);
+        pos += value;
+        if (major == ByteString) {
+            return QByteArray(data, static_cast<int>(value));
+        }
+        return QString::fromUtf8(data, static_cast<int>(value));
+    }
+    case Array:
+    {
+        if (value > remaining) {
+            break;
+        }
+        QVariantList list;
+        list.reserve(static_cast<int>(value));
+        for (quint64 i = 0; i < value && ok; ++i) {
+            list.append(readValue(pos, end, depth + 1, ok));
+        }
+        return list;
+    }
+    case Map:
+    {
+        if (value > remaining / 2) {
+            break;
+        }
+        QVariantMap map;
+        for (quint64 i = 0; i < value && ok; ++i) {
+            QVariant key = readValue(pos, end, depth + 1, ok);
+            if (key.userType() != QMetaType::QString) {
+                ok = false;
+                break;
+            }
+            map.insert(key.toString(), readValue(pos, end, depth + 1, ok));
+        }
+        return map;
+    }
+    case Tag:
+
+        // Tags only provide a hint about the value that follows
+        return readValue(pos, end, depth + 1, ok);
+    case Simple:
+        switch (info) {
+        case 20:
+            return false;
+        case 21:
+            return true;
+        case 22:
+        case 23:
+            return QVariant();
+        case 25:
+            return halfToDouble(static_cast<quint16>(value));
+        case 26:
+        {
+            quint32 bits = static_cast<quint32>(value);
+            float number;
+            std::memcpy(&number, &bits, sizeof(number));
+            return static_cast<double>(number);
+        }
+        case 27:
+        {
+            double number;
+            std::memcpy(&number, &value, sizeof(number));
+            return number;
+        }
+        }
+        break;
+    }
+
+    ok = false;
+    return QVariant();
+}
+
+QByteArray CborUtil::objectToCbor(QObject *object)
+{
+    return encode(QtUtil::properties(object));
+}
+
+QByteArray CborUtil::encode(const QVariant &value)
+{
+    QByteArray data;
+    writeValue(data, value);
+    return data;
+}
+
+QVariant CborUtil::decode(const QByteArray &data, bool *ok)
+{
+    const uchar *pos = reinterpret_cast<const uchar*>(data.constData());
+    const uchar *end = pos + data.size();
+
+    // The data must consist of exactly one value
+    bool valid = true;
+    QVariant value = readValue(pos, end, 0, valid);
+    if (pos != end) {
+        valid = false;
+    }
+    if (ok) {
+        *ok = valid;
+    }
+    return valid ? value : QVariant();
+}
@@ -0,0 +1,117 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <cmath>
+
+#include <QCryptographicHash>
+#include <QtEndian>
+
+#include <nitroshare/deltautil.h>
+#include <nitroshare/item.h>
+
+// Blocks smaller than this produce unreasonably large signatures and blocks
+// larger than this rarely match
+const int MinBlockSize = 1024;
+const int MaxBlockSize = 131072;
+
+const int StrongChecksumSize = 8;
+
+const int DeltaUtil::SignatureEntrySize = sizeof(quint32) + StrongChecksumSize;
+
+quint32 DeltaUtil::checksum(const char *data, int length)
+{
+    const uchar *p = reinterpret_cast<const uchar*>(data);
+
+    // The two sums have no dependencies between iterations other than the
+    // accumulators themselves, which allows the compiler to vectorize the loop
+    quint32 a = 0;
+    quint32 b = 0;
+    for (int i = 0; i < length; ++i) {
+        a += p[i];
+        b += static_cast<quint32>(length - i) * p[i];
+    }
+
+    return (a & 0xffff) | (b << 16);
+}
+
+quint32 DeltaUtil::roll(quint32 checksum, uchar removed, uchar added, int length)
+{
+    quint32 a = (checksum & 0xffff) - removed + added;
+    quint32 b = (checksum >> 16) - static_cast<quint32>(length) * removed + a;
+
+    return (a & 0xffff) | (b << 16);
+}
+
+QByteArray DeltaUtil::strongChecksum(const char *data, int length)
+{
+    return QCryptographicHash::hash(
+        QByteArray::fromRawData(data, length),
+        QCryptographicHash::Md5
+    ).left(StrongChecksumSize);
+}
+
+int DeltaUtil::blockSize(qint64 size)
+{
+    // Using the square root balances the size of the signature against the
+    // amount of data that must be resent when a block changes
+    int blockSize = static_cast<int>(std::sqrt(static_cast<double>(size))) & ~7;
+    return qBound(MinBlockSize, blockSize, MaxBlockSize);
+}
+
+QByteArray DeltaUtil::signature(Item *item, int blockSize)
+{
+    QByteArray signature(sizeof(qint32), 0);
+    qToLittleEndian<qint32>(blockSize, reinterpret_cast<uchar*>(signature.data()));
+
+    if (!item->seek(0)) {
+        return signature;
+    }
+
+    // Items return data in whatever amounts they choose, so buffer it until
+    // there is enough for a complete block - a partial block at the end is
+    // never matched and therefore not included
+    QByteArray buffer;
+    forever {
+        QByteArray data = item->read();
+        if (data.isEmpty()) {
+            break;
+        }
+        buffer.append(data);
+
+        int pos = 0;
+        for (; buffer.size() - pos >= blockSize; pos += blockSize) {
+            char weak[sizeof(quint32)];
+            qToLittleEndian<quint32>(
+                checksum(buffer.constData() + pos, blockSize),
+                reinterpret_cast<uchar*>(weak)
+            );
+            signature.append(weak, sizeof(weak));
+            signature.append(strongChecksum(buffer.constData() + pos, blockSize));
+        }
+        buffer.remove(0, pos);
+    }
+
+    item->seek(0);
+    return signature;
+}
@@ -0,0 +1,230 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+
+
+/*
+ * Packet framing benchmark
+ *
+ * A stream of packets is fed to the original LAN transport parser (which
+ * removed each packet from the front of its buffer) and to PacketFramer in
+ * the same chunks that a socket would return them. Results are written as
+ * JSON in packets per second.
+ */
+
+#include <cstring>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+#include <nitroshare/packet.h>
+
+#include "packetframer.h"
+
+const int DefaultCount = 1000000;
+const int DefaultChunkSize = 65536;
+
+// Upper limit on the size of the generated stream
+const qint64 MaxStreamSize = 268435456;
+
+/*
+ * Parser used by LanTransport before PacketFramer
+ */
+class LegacyFramer
+{
+public:
+
+    LegacyFramer() : mBufferSize(0) {}
+
+    int feed(const QByteArray &chunk)
+    {
+        int count = 0;
+        mBuffer.append(chunk);
+        while (mBuffer.size()) {
+            if (mBufferSize) {
+                if (mBuffer.size() < mBufferSize) {
+                    break;
+                }
+                const char type = mBuffer.at(0);
+                QByteArray data = mBuffer.mid(1, mBufferSize - 1);
+                mBuffer.remove(0, mBufferSize);
+                Packet packet(static_cast<Packet::Type>(type), data);
+                Q_UNUSED(packet)
+                ++count;
+                mBufferSize = 0;
+            } else {
+                if (mBuffer.size() < static_cast<int>(sizeof(mBufferSize))) {
+                    break;
+                }
+                memcpy(&mBufferSize, mBuffer.constData(), sizeof(mBufferSize));
+                mBufferSize = qFromLittleEndian(mBufferSize);
+                mBuffer.remove(0, sizeof(mBufferSize));
+            }
+        }
+        return count;
+    }
+
+private:
+
+    QByteArray mBuffer;
+    qint32 mBufferSize;
+};
+
+/*
+ * Parser used by LanTransport now
+ */
+class CurrentFramer
+{
+public:
+
+    int feed(const QByteArray &chunk)
+    {
+        int count = 0;
+        mFramer.append(chunk);
+        while (mFramer.hasPacket()) {
+            Packet packet = mFramer.takePacket();
+            Q_UNUSED(packet)
+            ++count;
+        }
+        return count;
+    }
+
+private:
+
+    PacketFramer mFramer;
+};
+
+/*
+ * Split a stream of packets of the specified size into chunks
+ */
+QList<QByteArray> createChunks(int count, int size, int chunkSize)
+{
+    QByteArray packet(PacketFramer::HeaderSize, 0);
+    qToLittleEndian<qint32>(size + 1, reinterpret_cast<uchar*>(packet.data()));
+    packet[PacketFramer::HeaderSize - 1] = static_cast<char>(Packet::Binary);
+    packet.append(QByteArray(size, 'x'));
+
+    QByteArray stream;
+    stream.reserve(packet.size() * count);
+    for (int i = 0; i < count; ++i) {
+        stream.append(packet);
+    }
+
+    QList<QByteArray> chunks;
+    for (int pos = 0; pos < stream.size(); pos += chunkSize) {
+        chunks.append(stream.mid(pos, chunkSize));
+    }
+    return chunks;
+}
+
+/*
+ * Feed the chunks to a parser and measure how quickly it emits packets
+ */
+template<typename Framer>
+QJsonObject run(const QString &name, const QList<QByteArray> &chunks, int count, int size)
+{
+    Framer framer;
+    int parsed = 0;
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    foreach (const QByteArray &chunk, chunks) {
+        parsed += framer.feed(chunk);
+    }
+    double seconds = elapsed.nsecsElapsed() / 1e9;
+
+    return QJsonObject{
+        { "framer", name },
+        { "size", size },
+        { "packets", parsed },
+        { "seconds", seconds },
+        { "packetsPerSecond", parsed / seconds },
+        { "succeeded", parsed == count }
+    };
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measure how quickly received packets are parsed.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("count",
+        "Number of packets in the stream.", "count", QString::number(DefaultCount)));
+    parser.addOption(QCommandLineOption("size",
+        "Size of the packet content in bytes - may be repeated.", "size"));
+    parser.addOption(QCommandLineOption("chunk-size",
+        "Amount of data made available at once in bytes.", "size",
+        QString::number(DefaultChunkSize)));
+    parser.addOption(QCommandLineOption("output",
+        "Write the results to a file instead of stdout.", "filename"));
+    parser.process(app);
+
+    int count = parser.value("count").toInt();
+    int chunkSize = parser.value("chunk-size").toInt();
+    QStringList sizes = parser.values("size");
+    if (sizes.isEmpty()) {
+        sizes = QStringList{ "0", "64", "1024", "65536" };
+    }
+    if (count <= 0 || chunkSize <= 0) {
+        qCritical("count and chunk size must be positive");
+        return 1;
+    }
+
+    QJsonArray results;
+    foreach (const QString &sizeValue, sizes) {
+        int size = sizeValue.toInt();
+
+        // Keep the stream to a reasonable size for large packets
+        int sizeCount = static_cast<int>(qMin<qint64>(count, MaxStreamSize / (size + PacketFramer::HeaderSize)));
+        QList<QByteArray> chunks = createChunks(sizeCount, size, chunkSize);
+
+        results.append(run<LegacyFramer>("legacy", chunks, sizeCount, size));
+        results.append(run<CurrentFramer>("current", chunks, sizeCount, size));
+    }
+
+    QByteArray json = QJsonDocument(QJsonObject{
+        { "chunkSize", chunkSize },
+        { "results", results }
+    }).toJson();
+
+    QFile file;
+    if (parser.isSet("output")) {
+        file.setFileName(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCritical("unable to open %s", qPrintable(file.fileName()));
+            return 1;
+        }
+    } else {
+        file.open(stdout, QIODevice::WriteOnly);
+    }
+    file.write(json);
+
+    return 0;
+}
@@ -0,0 +1,636 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+
+/*
+ * Loopback throughput benchmark
+ *
+ * Two applications in the same process exchange generated workloads over an
+ * in-process transport and a LAN transport connected to 127.0.0.1. Results
+ * are written as JSON so that they can be compared from build to build.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QHostAddress>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPointer>
+#include <QQueue>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryFile>
+#include <QTimer>
+
+#if defined(Q_OS_WIN)
+#  include <windows.h>
+#  include <psapi.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+#include <nitroshare/application.h>
+#include <nitroshare/bundle.h>
+#include <nitroshare/device.h>
+#include <nitroshare/handler.h>
+#include <nitroshare/handlerregistry.h>
+#include <nitroshare/item.h>
+#include <nitroshare/packet.h>
+#include <nitroshare/settingsregistry.h>
+#include <nitroshare/transfer.h>
+#include <nitroshare/transfermodel.h>
+#include <nitroshare/transport.h>
+#include <nitroshare/transportserver.h>
+#include <nitroshare/transportserverregistry.h>
+
+#include "lantransport.h"
+#include "server.h"
+
+const QString ItemType = "benchmark";
+
+const QString LoopbackName = "loopback";
+const QString LanName = "lan";
+
+const QString HugeWorkload = "huge";
+const QString TinyWorkload = "tiny";
+const QString MixedWorkload = "mixed";
+
+// Default size of the single item in the huge workload (in MiB)
+const int DefaultHugeSize = 2048;
+
+// Number of items in the tiny workload and upper limit on their size
+const int TinyItemCount = 100000;
+const int TinyMaxSize = 1024;
+
+// Number of items in the mixed workload - mostly small files with a few
+// medium and large ones spread across a directory tree
+const int MixedItemCount = 1000;
+const int MixedSmallMaxSize = 65536;
+const qint64 MixedMediumSize = 1048576;
+const qint64 MixedLargeSize = 33554432;
+
+// Upper limit on the time taken by a single run
+const int RunTimeout = 3600000;
+
+// Content returned when reading items (shared by all of them)
+const int BlockSize = 65536;
+const QByteArray Block(BlockSize, 'x');
+
+/*
+ * Item that generates its content from a shared block
+ */
+class GeneratedItem : public Item
+{
+    Q_OBJECT
+
+public:
+
+    GeneratedItem(const QString &name, qint64 size) : mName(name), mSize(size), mPosition(0) {}
+
+    virtual QString type() const { return ItemType; }
+    virtual QString name() const { return mName; }
+    virtual qint64 size() const { return mSize; }
+
+    virtual bool open(OpenMode)
+    {
+        mPosition = 0;
+        return true;
+    }
+
+    virtual QByteArray read()
+    {
+        int length = static_cast<int>(qMin<qint64>(BlockSize, mSize - mPosition));
+        mPosition += length;
+        return Block.left(length);
+    }
+
+    virtual bool seek(qint64 offset)
+    {
+        mPosition = offset;
+        return true;
+    }
+
+private:
+
+    QString mName;
+    qint64 mSize;
+    qint64 mPosition;
+};
+
+/*
+ * Item that discards everything written to it
+ */
+class SinkItem : public Item
+{
+    Q_OBJECT
+
+public:
+
+    explicit SinkItem(const QVariantMap &properties)
+        : mName(properties.value("name").toString()),
+          mSize(properties.value("size").toLongLong()) {}
+
+    virtual QString type() const { return ItemType; }
+    virtual QString name() const { return mName; }
+    virtual qint64 size() const { return mSize; }
+
+    virtual bool open(OpenMode) { return true; }
+    virtual void write(const QByteArray &) {}
+    virtual bool seek(qint64) { return true; }
+
+private:
+
+    QString mName;
+    qint64 mSize;
+};
+
+class SinkHandler : public Handler
+{
+    Q_OBJECT
+
+public:
+
+    virtual QString name() const { return ItemType; }
+
+    virtual Item *createItem(const QString &, const QVariantMap &properties)
+    {
+        return new SinkItem(properties);
+    }
+};
+
+/*
+ * Device representing the receiving application
+ */
+class BenchmarkDevice : public Device
+{
+    Q_OBJECT
+
+public:
+
+    explicit BenchmarkDevice(const QString &transportName) : mTransportName(transportName) {}
+
+    virtual QString uuid() const { return "benchmark-receiver"; }
+    virtual QString name() const { return "benchmark-receiver"; }
+    virtual QString transportName() const { return mTransportName; }
+
+private:
+
+    QString mTransportName;
+};
+
+/*
+ * Transport that delivers packets to its peer from the event loop
+ */
+class LoopbackTransport : public Transport
+{
+    Q_OBJECT
+
+public:
+
+    LoopbackTransport() : mBytesToWrite(0), mScheduled(false) {}
+
+    void setPeer(LoopbackTransport *peer) { mPeer = peer; }
+
+    virtual void sendPacket(const Packet &packet)
+    {
+        mBytesToWrite += packet.content().size();
+        mPackets.enqueue(packet);
+        if (!mScheduled) {
+            mScheduled = true;
+            QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+        }
+    }
+
+    virtual qint64 bytesToWrite() const { return mBytesToWrite; }
+    virtual void close() {}
+
+private slots:
+
+    void deliver()
+    {
+        mScheduled = false;
+        while (!mPackets.isEmpty()) {
+            Packet packet = mPackets.dequeue();
+            mBytesToWrite -= packet.content().size();
+            if (mPeer) {
+                emit mPeer->packetReceived(packet);
+            }
+        }
+        emit packetSent();
+    }
+
+private:
+
+    QPointer<LoopbackTransport> mPeer;
+    QQueue<Packet> mPackets;
+    qint64 mBytesToWrite;
+    bool mScheduled;
+};
+
+/*
+ * Transport server that connects the sender to the receiver in-process
+ */
+class LoopbackTransportServer : public TransportServer
+{
+    Q_OBJECT
+
+public:
+
+    LoopbackTransportServer() : mPeer(nullptr) {}
+
+    void setPeer(LoopbackTransportServer *peer) { mPeer = peer; }
+
+    virtual QString name() const { return LoopbackName; }
+
+    virtual Transport *createTransport(Device *)
+    {
+        LoopbackTransport *sender = new LoopbackTransport;
+        LoopbackTransport *receiver = new LoopbackTransport;
+        sender->setPeer(receiver);
+        receiver->setPeer(sender);
+        emit mPeer->transportReceived(receiver);
+        QMetaObject::invokeMethod(sender, "connected", Qt::QueuedConnection);
+        return sender;
+    }
+
+private:
+
+    LoopbackTransportServer *mPeer;
+};
+
+/*
+ * Transport server that connects the sender to the receiver over TCP
+ */
+class LanTransportServer : public TransportServer
+{
+    Q_OBJECT
+
+public:
+
+    LanTransportServer() : mPeer(nullptr)
+    {
+        connect(&mServer, &Server::newSocketDescriptor, this, &LanTransportServer::onNewSocketDescriptor);
+    }
+
+    void setPeer(LanTransportServer *peer) { mPeer = peer; }
+    bool listen() { return mServer.listen(QHostAddress::LocalHost); }
+    QString errorString() const { return mServer.errorString(); }
+
+    virtual QString name() const { return LanName; }
+
+    virtual Transport *createTransport(Device *)
+    {
+        return new LanTransport(
+            QHostAddress::LocalHost
+          , mPeer->mServer.serverPort()
+#ifdef ENABLE_TLS
+          , QSslConfiguration()
+#endif
+        );
+    }
+
+private slots:
+
+    void onNewSocketDescriptor(qintptr socketDescriptor)
+    {
+        emit transportReceived(new LanTransport(
+            socketDescriptor
+#ifdef ENABLE_TLS
+          , QSslConfiguration()
+#endif
+        ));
+    }
+
+private:
+
+    LanTransportServer *mPeer;
+    Server mServer;
+};
+
+/*
+ * Application with its own settings and transport servers
+ */
+class BenchmarkApplication
+{
+public:
+
+    BenchmarkApplication()
+        : mSettings(mFile.fileName(), QSettings::IniFormat),
+          mApplication(&mSettings)
+    {
+        mApplication.handlerRegistry()->add(&mHandler);
+        mApplication.transportServerRegistry()->add(&mLoopbackServer);
+        mApplication.transportServerRegistry()->add(&mLanServer);
+    }
+
+    ~BenchmarkApplication()
+    {
+        mApplication.transportServerRegistry()->remove(&mLanServer);
+        mApplication.transportServerRegistry()->remove(&mLoopbackServer);
+        mApplication.handlerRegistry()->remove(&mHandler);
+    }
+
+    void connectTo(BenchmarkApplication *peer)
+    {
+        mLoopbackServer.setPeer(&peer->mLoopbackServer);
+        mLanServer.setPeer(&peer->mLanServer);
+    }
+
+    Application *application() { return &mApplication; }
+    LanTransportServer *lanServer() { return &mLanServer; }
+
+private:
+
+    QTemporaryFile mFile;
+    QSettings mSettings;
+
+    SinkHandler mHandler;
+    LoopbackTransportServer mLoopbackServer;
+    LanTransportServer mLanServer;
+
+    Application mApplication;
+};
+
+/*
+ * Retrieve the CPU time used by the process in seconds
+ */
+double cpuTime()
+{
+#if defined(Q_OS_WIN)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    if (GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime)) {
+        auto toSeconds = [](const FILETIME &time) {
+            return static_cast<double>((static_cast<quint64>(time.dwHighDateTime) << 32) |
+                time.dwLowDateTime) / 1e7;
+        };
+        return toSeconds(kernelTime) + toSeconds(userTime);
+    }
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+/*
+ * Reset the peak resident set size (only possible on Linux - elsewhere the
+ * peak covers the lifetime of the process)
+ */
+void resetPeakResidentSize()
+{
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/self/clear_refs");
+    if (file.open(QIODevice::WriteOnly)) {
+        file.write("5");
+    }
+#endif
+}
+
+/*
+ * Retrieve the peak resident set size of the process in bytes
+ */
+qint64 peakResidentSize()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<qint64>(counters.PeakWorkingSetSize);
+    }
+    return -1;
+#else
+#  if defined(Q_OS_LINUX)
+    QFile file("/proc/self/status");
+    if (file.open(QIODevice::ReadOnly)) {
+        foreach (const QByteArray &line, file.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:")) {
+                return line.mid(6).trimmed().split(' ').first().toLongLong() * 1024;
+            }
+        }
+    }
+#  endif
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) {
+        return -1;
+    }
+#  if defined(Q_OS_MAC)
+    return usage.ru_maxrss;
+#  else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#  endif
+#endif
+}
+
+/*
+ * Create the bundle for a workload
+ */
+Bundle *createBundle(const QString &workload, qint64 hugeSize)
+{
+    Bundle *bundle = new Bundle;
+    if (workload == HugeWorkload) {
+        bundle->add(new GeneratedItem("huge", hugeSize));
+    } else if (workload == TinyWorkload) {
+        for (int i = 0; i < TinyItemCount; ++i) {
+            bundle->add(new GeneratedItem(QString("tiny/%1").arg(i), 1 + i % TinyMaxSize));
+        }
+    } else {
+        for (int i = 0; i < MixedItemCount; ++i) {
+            QString name = QString("mixed/%1/%2/%3").arg(i % 7).arg(i % 31).arg(i);
+            qint64 size;
+            if (i % 100 < 80) {
+                size = 1 + (i * 7919) % MixedSmallMaxSize;
+            } else if (i % 100 < 98) {
+                size = MixedMediumSize + (i % 16) * BlockSize;
+            } else {
+                size = MixedLargeSize;
+            }
+            bundle->add(new GeneratedItem(name, size));
+        }
+    }
+    return bundle;
+}
+
+/*
+ * Send a workload from one application to the other and measure the result
+ */
+QJsonObject run(BenchmarkApplication *sender,
+                BenchmarkApplication *receiver,
+                const QString &transportName,
+                const QString &workload,
+                qint64 hugeSize)
+{
+    Bundle *bundle = createBundle(workload, hugeSize);
+    qint64 bytes = bundle->totalSize();
+    int items = bundle->rowCount();
+
+    TransferModel *senderModel = sender->application()->transferModel();
+    TransferModel *receiverModel = receiver->application()->transferModel();
+
+    // Wait until both ends of the transfer have finished (the receiver may
+    // never see the transfer if the sender fails to connect)
+    QEventLoop loop;
+    QTimer timer;
+    timer.setSingleShot(true);
+    QObject::connect(&timer, &QTimer::timeout, &loop, &QEventLoop::quit);
+    auto firstTransfer = [](TransferModel *model) {
+        return model->rowCount() ?
+            model->data(model->index(0, 0), Qt::UserRole).value<Transfer*>() : nullptr;
+    };
+    auto checkFinished = [&]() {
+        Transfer *senderTransfer = firstTransfer(senderModel);
+        Transfer *receiverTransfer = firstTransfer(receiverModel);
+        if (senderTransfer && senderTransfer->isFinished() &&
+                (senderTransfer->state() == Transfer::Failed ||
+                    (receiverTransfer && receiverTransfer->isFinished()))) {
+            loop.quit();
+        }
+    };
+    QObject::connect(senderModel, &TransferModel::dataChanged, &loop, checkFinished);
+    QObject::connect(receiverModel, &TransferModel::dataChanged, &loop, checkFinished);
+
+    resetPeakResidentSize();
+    double cpuStart = cpuTime();
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    BenchmarkDevice device(transportName);
+    Transfer *transfer = new Transfer(sender->application(), &device, bundle);
+    senderModel->add(transfer);
+    timer.start(RunTimeout);
+    loop.exec();
+
+    double seconds = elapsed.nsecsElapsed() / 1e9;
+    double cpuSeconds = cpuTime() - cpuStart;
+
+    QJsonObject result{
+        { "transport", transportName },
+        { "workload", workload },
+        { "bytes", bytes },
+        { "items", items },
+        { "seconds", seconds },
+        { "mbPerSecond", bytes / 1e6 / seconds },
+        { "itemsPerSecond", items / seconds },
+        { "cpuSeconds", cpuSeconds },
+        { "peakRss", peakResidentSize() },
+        { "succeeded", transfer->state() == Transfer::Succeeded }
+    };
+    if (!transfer->isFinished()) {
+        result.insert("error", "timed out");
+        transfer->cancel();
+        QTimer::singleShot(1000, &loop, &QEventLoop::quit);
+        loop.exec();
+    } else if (transfer->state() == Transfer::Failed) {
+        result.insert("error", transfer->error());
+    }
+
+    senderModel->dismissAll();
+    receiverModel->dismissAll();
+
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    // Keep the transfer journal away from the user's data
+    QStandardPaths::setTestModeEnabled(true);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measure transfer throughput between two applications.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("transport",
+        "Transport to use (loopback, lan) - may be repeated.", "name"));
+    parser.addOption(QCommandLineOption("workload",
+        "Workload to send (huge, tiny, mixed) - may be repeated.", "name"));
+    parser.addOption(QCommandLineOption("huge-size",
+        "Size of the item in the huge workload in MiB.", "size",
+        QString::number(DefaultHugeSize)));
+    parser.addOption(QCommandLineOption("output",
+        "Write the results to a file instead of stdout.", "filename"));
+    parser.process(app);
+
+    QStringList transports = parser.values("transport");
+    if (transports.isEmpty()) {
+        transports = QStringList{ LoopbackName, LanName };
+    }
+    QStringList workloads = parser.values("workload");
+    if (workloads.isEmpty()) {
+        workloads = QStringList{ HugeWorkload, TinyWorkload, MixedWorkload };
+    }
+    qint64 hugeSize = parser.value("huge-size").toLongLong() * 1048576;
+
+    foreach (const QString &transportName, transports) {
+        if (transportName != LoopbackName && transportName != LanName) {
+            qCritical("unknown transport: %s", qPrintable(transportName));
+            return 1;
+        }
+    }
+    foreach (const QString &workload, workloads) {
+        if (workload != HugeWorkload && workload != TinyWorkload && workload != MixedWorkload) {
+            qCritical("unknown workload: %s", qPrintable(workload));
+            return 1;
+        }
+    }
+
+    BenchmarkApplication sender;
+    BenchmarkApplication receiver;
+    sender.connectTo(&receiver);
+    if (transports.contains(LanName) && !receiver.lanServer()->listen()) {
+        qCritical("unable to listen: %s", qPrintable(receiver.lanServer()->errorString()));
+        return 1;
+    }
+
+    QJsonArray results;
+    foreach (const QString &transportName, transports) {
+        foreach (const QString &workload, workloads) {
+            results.append(run(&sender, &receiver, transportName, workload, hugeSize));
+        }
+    }
+
+    QByteArray json = QJsonDocument(QJsonObject{
+        { "results", results }
+    }).toJson();
+
+    QFile file;
+    if (parser.isSet("output")) {
+        file.setFileName(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            qCritical("unable to open %s", qPrintable(file.fileName()));
+            return 1;
+        }
+    } else {
+        file.open(stdout, QIODevice::WriteOnly);
+    }
+    file.write(json);
+
+    return 0;
+}
+
+#include "BenchmarkLoopback.moc"
@@ -0,0 +1,305 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QFile>
+#include <QQueue>
+#include <QScopedPointer>
+#include <QTest>
+#include <QTimer>
+
+#ifdef Q_OS_LINUX
+#  include <unistd.h>
+#endif
+
+#include <nitroshare/application.h>
+#include <nitroshare/bundle.h>
+#include <nitroshare/handlerregistry.h>
+#include <nitroshare/item.h>
+#include <nitroshare/packet.h>
+#include <nitroshare/settingsregistry.h>
+#include <nitroshare/transfer.h>
+#include <nitroshare/transport.h>
+#include <nitroshare/transportserver.h>
+#include <nitroshare/transportserverregistry.h>
+
+#include "mock/mockapplication.h"
+#include "mock/mockdevice.h"
+#include "mock/mockhandler.h"
+#include "mock/mockitem.h"
+#include "mock/mocktransportserver.h"
+
+// Number of small items in the bundle and upper limit on their size
+const int ItemCount = 100000;
+const int MaxItemSize = 4095;
+
+// Number and size of the items used for checking memory usage (10 GiB)
+const int LargeItemCount = 10;
+const qint64 LargeItemSize = Q_INT64_C(1073741824);
+
+// Maximum growth in memory usage once the large transfer is under way
+const qint64 MaxMemoryGrowth = 33554432;
+
+// Generous timeout for transfers that do not use batches
+const int TransferTimeout = 600000;
+
+// Content returned when reading items (shared by all of them)
+const int BlockSize = 65536;
+const QByteArray Block(BlockSize, 'x');
+
+/*
+ * Item that generates its content from a shared block
+ */
+class GeneratedItem : public Item
+{
+    Q_OBJECT
+
+public:
+
+    explicit GeneratedItem(qint64 size) : mSize(size), mPosition(0) {}
+
+    virtual QString type() const { return MockItem::Type; }
+    virtual QString name() const { return MockItem::Name; }
+    virtual qint64 size() const { return mSize; }
+
+    virtual bool open(OpenMode)
+    {
+        mPosition = 0;
+        return true;
+    }
+
+    virtual QByteArray read()
+    {
+        int length = static_cast<int>(qMin<qint64>(BlockSize, mSize - mPosition));
+        mPosition += length;
+        return Block.left(length);
+    }
+
+private:
+
+    qint64 mSize;
+    qint64 mPosition;
+};
+
+/*
+ * Retrieve the resident set size of the process in bytes
+ */
+qint64 residentSize()
+{
+#ifdef Q_OS_LINUX
+    QFile file("/proc/self/statm");
+    if (file.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> fields = file.readAll().split(' ');
+        if (fields.count() > 1) {
+            return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+        }
+    }
+#endif
+    return -1;
+}
+
+/*
+ * Transport that delivers packets to its peer from the event loop
+ */
+class LoopbackTransport : public Transport
+{
+    Q_OBJECT
+
+public:
+
+    LoopbackTransport() : mPeer(nullptr), mBytesToWrite(0), mScheduled(false) {}
+
+    void setPeer(LoopbackTransport *peer) { mPeer = peer; }
+
+    virtual void sendPacket(const Packet &packet)
+    {
+        mBytesToWrite += packet.content().size();
+        mPackets.enqueue(packet);
+        if (!mScheduled) {
+            mScheduled = true;
+            QTimer::singleShot(0, this, &LoopbackTransport::deliver);
+        }
+    }
+
+    virtual qint64 bytesToWrite() const { return mBytesToWrite; }
+    virtual void close() {}
+
+private:
+
+    void deliver()
+    {
+        mScheduled = false;
+        while (!mPackets.isEmpty()) {
+            Packet packet = mPackets.dequeue();
+            mBytesToWrite -= packet.content().size();
+            emit mPeer->packetReceived(packet);
+        }
+        emit packetSent();
+    }
+
+    LoopbackTransport *mPeer;
+    QQueue<Packet> mPackets;
+    qint64 mBytesToWrite;
+    bool mScheduled;
+};
+
+/*
+ * Transport server that creates a receiving transfer for each transport
+ */
+class LoopbackTransportServer : public TransportServer
+{
+    Q_OBJECT
+
+public:
+
+    explicit LoopbackTransportServer(Application *application)
+        : mApplication(application), mReceiver(nullptr) {}
+
+    virtual QString name() const { return MockTransportServer::Name; }
+
+    virtual Transport *createTransport(Device *)
+    {
+        LoopbackTransport *sender = new LoopbackTransport;
+        LoopbackTransport *receiver = new LoopbackTransport;
+        sender->setPeer(receiver);
+        receiver->setPeer(sender);
+        mReceiver = new Transfer(mApplication, receiver);
+        QTimer::singleShot(0, sender, &Transport::connected);
+        return sender;
+    }
+
+    Transfer *takeReceiver()
+    {
+        Transfer *receiver = mReceiver;
+        mReceiver = nullptr;
+        return receiver;
+    }
+
+private:
+
+    Application *mApplication;
+    Transfer *mReceiver;
+};
+
+class BenchmarkTransfer : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    BenchmarkTransfer() : mTransportServer(mApplication.application()) {}
+
+private slots:
+
+    void initTestCase();
+
+    void benchmarkSmallItems_data();
+    void benchmarkSmallItems();
+    void testConstantMemory();
+
+private:
+
+    MockApplication mApplication;
+    MockHandler mHandler;
+    LoopbackTransportServer mTransportServer;
+};
+
+void BenchmarkTransfer::initTestCase()
+{
+    mApplication.application()->handlerRegistry()->add(&mHandler);
+    mApplication.application()->transportServerRegistry()->add(&mTransportServer);
+}
+
+void BenchmarkTransfer::benchmarkSmallItems_data()
+{
+    QTest::addColumn<qint64>("batchThreshold");
+
+    QTest::newRow("individual") << static_cast<qint64>(0);
+    QTest::newRow("batched") << static_cast<qint64>(MaxItemSize);
+}
+
+void BenchmarkTransfer::benchmarkSmallItems()
+{
+    QFETCH(qint64, batchThreshold);
+
+    mApplication.application()->settingsRegistry()->setValue(
+        Application::TransferBatchThresholdSettingName, batchThreshold);
+
+    // Sizes vary from 1 byte to just under 4 KiB
+    Bundle *bundle = new Bundle;
+    for (int i = 0; i < ItemCount; ++i) {
+        bundle->add(new GeneratedItem(1 + i % MaxItemSize));
+    }
+
+    QBENCHMARK_ONCE {
+        MockDevice device;
+        Transfer transfer(mApplication.application(), &device, bundle);
+        QScopedPointer<Transfer> receiver(mTransportServer.takeReceiver());
+        QVERIFY(receiver);
+
+        QTRY_VERIFY_WITH_TIMEOUT(transfer.isFinished() && receiver->isFinished(), TransferTimeout);
+        QCOMPARE(transfer.state(), Transfer::Succeeded);
+        QCOMPARE(receiver->state(), Transfer::Succeeded);
+    }
+}
+
+void BenchmarkTransfer::testConstantMemory()
+{
+    if (residentSize() < 0) {
+        QSKIP("memory usage cannot be determined on this platform");
+    }
+
+    Bundle *bundle = new Bundle;
+    for (int i = 0; i < LargeItemCount; ++i) {
+        bundle->add(new GeneratedItem(LargeItemSize));
+    }
+
+    MockDevice device;
+    Transfer transfer(mApplication.application(), &device, bundle);
+    QScopedPointer<Transfer> receiver(mTransportServer.takeReceiver());
+    QVERIFY(receiver);
+
+    // Measure once the transfer has settled and track the peak after that
+    qint64 baseline = -1;
+    qint64 peak = 0;
+    connect(receiver.data(), &Transfer::progressChanged, [&](int progress) {
+        if (progress >= 5) {
+            qint64 size = residentSize();
+            if (baseline < 0) {
+                baseline = size;
+            }
+            peak = qMax(peak, size);
+        }
+    });
+
+    QTRY_VERIFY_WITH_TIMEOUT(transfer.isFinished() && receiver->isFinished(), TransferTimeout);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+    QCOMPARE(receiver->state(), Transfer::Succeeded);
+
+    QVERIFY(baseline > 0);
+    QVERIFY2(peak - baseline < MaxMemoryGrowth,
+             qPrintable(QString("memory grew by %1 bytes").arg(peak - baseline)));
+}
+
+QTEST_MAIN(BenchmarkTransfer)
+#include "BenchmarkTransfer.moc"
@@ -0,0 +1,148 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QTest>
+#include <QVariant>
+
+#include <nitroshare/cborutil.h>
+
+class Properties : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(QString name READ name)
+    Q_PROPERTY(qint64 size READ size)
+
+public:
+
+    QString name() const { return "name"; }
+    qint64 size() const { return 5000000000; }
+};
+
+class TestCborUtil : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void testEncode_data();
+    void testEncode();
+    void testRoundTrip_data();
+    void testRoundTrip();
+    void testObjectToCbor();
+    void testInvalid_data();
+    void testInvalid();
+};
+
+void TestCborUtil::testEncode_data()
+{
+    QTest::addColumn<QVariant>("value");
+    QTest::addColumn<QByteArray>("data");
+
+    // Examples from appendix A of RFC 7049
+    QTest::newRow("0") << QVariant(0) << QByteArray::fromHex("00");
+    QTest::newRow("23") << QVariant(23) << QByteArray::fromHex("17");
+    QTest::newRow("24") << QVariant(24) << QByteArray::fromHex("1818");
+    QTest::newRow("1000") << QVariant(1000) << QByteArray::fromHex("1903e8");
+    QTest::newRow("1000000") << QVariant(1000000) << QByteArray::fromHex("1a000f4240");
+    QTest::newRow("1000000000000") << QVariant(Q_INT64_C(1000000000000)) << QByteArray::fromHex("1b000000e8d4a51000");
+    QTest::newRow("-1") << QVariant(-1) << QByteArray::fromHex("20");
+    QTest::newRow("-1000") << QVariant(-1000) << QByteArray::fromHex("3903e7");
+    QTest::newRow("1.1") << QVariant(1.1) << QByteArray::fromHex("fb3ff199999999999a");
+    QTest::newRow("false") << QVariant(false) << QByteArray::fromHex("f4");
+    QTest::newRow("true") << QVariant(true) << QByteArray::fromHex("f5");
+    QTest::newRow("null") << QVariant() << QByteArray::fromHex("f6");
+    QTest::newRow("bytes") << QVariant(QByteArray::fromHex("01020304")) << QByteArray::fromHex("4401020304");
+    QTest::newRow("text") << QVariant(QString("IETF")) << QByteArray::fromHex("6449455446");
+    QTest::newRow("array") << QVariant(QVariantList{ 1, 2, 3 }) << QByteArray::fromHex("83010203");
+    QTest::newRow("map") << QVariant(QVariantMap{ { "a", 1 }, { "b", QVariantList{ 2, 3 } } })
+                         << QByteArray::fromHex("a26161016162820203");
+}
+
+void TestCborUtil::testEncode()
+{
+    QFETCH(QVariant, value);
+    QFETCH(QByteArray, data);
+
+    QCOMPARE(CborUtil::encode(value), data);
+}
+
+void TestCborUtil::testRoundTrip_data()
+{
+    QTest::addColumn<QVariant>("value");
+
+    QTest::newRow("integer") << QVariant(Q_INT64_C(-5000000000));
+    QTest::newRow("unsigned") << QVariant(Q_UINT64_C(18446744073709551615));
+    QTest::newRow("double") << QVariant(-4.5);
+    QTest::newRow("text") << QVariant(QString::fromUtf8("\xc3\xbc\xe6\xb0\xb4"));
+    QTest::newRow("nested") << QVariant(QVariantMap{
+        { "list", QVariantList{ QVariant(), true, QByteArray("data") } },
+        { "map", QVariantMap{ { "size", Q_INT64_C(5000000000) } } }
+    });
+}
+
+void TestCborUtil::testRoundTrip()
+{
+    QFETCH(QVariant, value);
+
+    bool ok = false;
+    QCOMPARE(CborUtil::decode(CborUtil::encode(value), &ok), value);
+    QVERIFY(ok);
+}
+
+void TestCborUtil::testObjectToCbor()
+{
+    Properties properties;
+    bool ok = false;
+    QVariantMap map = CborUtil::decode(CborUtil::objectToCbor(&properties), &ok).toMap();
+    QVERIFY(ok);
+
+    // 64-bit integers are not converted to strings
+    QCOMPARE(map.value("name"), QVariant(QString("name")));
+    QCOMPARE(map.value("size"), QVariant(Q_INT64_C(5000000000)));
+}
+
+void TestCborUtil::testInvalid_data()
+{
+    QTest::addColumn<QByteArray>("data");
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("truncated integer") << QByteArray::fromHex("1903");
+    QTest::newRow("truncated text") << QByteArray::fromHex("6449");
+    QTest::newRow("huge array") << QByteArray::fromHex("9bffffffffffffffff");
+    QTest::newRow("indefinite") << QByteArray::fromHex("9f01ff");
+    QTest::newRow("integer key") << QByteArray::fromHex("a10101");
+    QTest::newRow("trailing data") << QByteArray::fromHex("0000");
+}
+
+void TestCborUtil::testInvalid()
+{
+    QFETCH(QByteArray, data);
+
+    bool ok = true;
+    QCOMPARE(CborUtil::decode(data, &ok), QVariant());
+    QVERIFY(!ok);
+}
+
+QTEST_MAIN(TestCborUtil)
+#include "TestCborUtil.moc"
@@ -0,0 +1,141 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QtEndian>
+#include <QTest>
+
+#include <nitroshare/deltautil.h>
+#include <nitroshare/item.h>
+
+// Large enough to exceed typical cache sizes when benchmarking
+const int DataSize = 4194304;
+const int BlockSize = 4096;
+
+class BufferItem : public Item
+{
+    Q_OBJECT
+
+public:
+
+    explicit BufferItem(const QByteArray &data) : mData(data), mPos(0) {}
+
+    virtual QString type() const { return "buffer"; }
+    virtual QString name() const { return "buffer"; }
+    virtual qint64 size() const { return mData.size(); }
+
+    virtual QByteArray read() {
+        QByteArray data = mData.mid(mPos, 1000);
+        mPos += data.size();
+        return data;
+    }
+    virtual bool seek(qint64 offset) { mPos = offset; return true; }
+
+private:
+
+    QByteArray mData;
+    int mPos;
+};
+
+class TestDeltaUtil : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void testRoll();
+    void testBlockSize();
+    void testSignature();
+
+    void benchmarkChecksum();
+    void benchmarkRoll();
+
+private:
+
+    QByteArray mData;
+};
+
+void TestDeltaUtil::initTestCase()
+{
+    mData.resize(DataSize);
+    for (int i = 0; i < DataSize; ++i) {
+        mData[i] = static_cast<char>(qrand());
+    }
+}
+
+void TestDeltaUtil::testRoll()
+{
+    // Rolling the checksum must produce the same value as calculating it
+    quint32 checksum = DeltaUtil::checksum(mData.constData(), BlockSize);
+    for (int i = 1; i < 10000; ++i) {
+        checksum = DeltaUtil::roll(checksum, mData.at(i - 1), mData.at(i + BlockSize - 1), BlockSize);
+        QCOMPARE(checksum, DeltaUtil::checksum(mData.constData() + i, BlockSize));
+    }
+}
+
+void TestDeltaUtil::testBlockSize()
+{
+    QCOMPARE(DeltaUtil::blockSize(0), 1024);
+    QCOMPARE(DeltaUtil::blockSize(Q_INT64_C(1) << 24), 4096);
+    QCOMPARE(DeltaUtil::blockSize(Q_INT64_C(1) << 40), 131072);
+}
+
+void TestDeltaUtil::testSignature()
+{
+    // The partial block at the end is not included
+    BufferItem item(mData.left(BlockSize * 3 + 1));
+    QByteArray signature = DeltaUtil::signature(&item, BlockSize);
+    QCOMPARE(signature.size(), static_cast<int>(sizeof(qint32)) + DeltaUtil::SignatureEntrySize * 3);
+    QCOMPARE(qFromLittleEndian<qint32>(reinterpret_cast<const uchar*>(signature.constData())), BlockSize);
+
+    // Check the entry for the second block
+    const char *entry = signature.constData() + sizeof(qint32) + DeltaUtil::SignatureEntrySize;
+    QCOMPARE(qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(entry)),
+             DeltaUtil::checksum(mData.constData() + BlockSize, BlockSize));
+    QCOMPARE(QByteArray(entry + sizeof(quint32), DeltaUtil::SignatureEntrySize - sizeof(quint32)),
+             DeltaUtil::strongChecksum(mData.constData() + BlockSize, BlockSize));
+}
+
+void TestDeltaUtil::benchmarkChecksum()
+{
+    QBENCHMARK {
+        for (int i = 0; i + BlockSize <= DataSize; i += BlockSize) {
+            DeltaUtil::checksum(mData.constData() + i, BlockSize);
+        }
+    }
+}
+
+void TestDeltaUtil::benchmarkRoll()
+{
+    QBENCHMARK {
+        quint32 checksum = DeltaUtil::checksum(mData.constData(), BlockSize);
+        for (int i = 1; i + BlockSize <= DataSize; ++i) {
+            checksum = DeltaUtil::roll(checksum, mData.at(i - 1), mData.at(i + BlockSize - 1), BlockSize);
+        }
+    }
+}
+
+QTEST_MAIN(TestDeltaUtil)
+#include "TestDeltaUtil.moc"
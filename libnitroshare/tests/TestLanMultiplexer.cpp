@@ -0,0 +1,402 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QScopedPointer>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <nitroshare/packet.h>
+
+#include "lanchannel.h"
+#include "lanmultiplexer.h"
+#include "lantransport.h"
+#include "server.h"
+
+// Size and number of packets sent by a bulk transfer - far more than the
+// window of a channel
+const int BulkPacketSize = 65536;
+const int BulkPacketCount = 64;
+
+// Number of packets sent by a small transfer
+const int SmallPacketCount = 4;
+
+// Size of the frame that accepts a shared connection
+const int AcceptSize = 17;
+
+class TestLanMultiplexer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void init();
+    void cleanup();
+
+    void testNegotiation();
+    void testFallback();
+    void testNegotiationTimeout();
+    void testInterleaving();
+    void testCredit();
+    void testIdleReuse();
+    void testIdleTimeout();
+    void testPing();
+    void testPingTimeout();
+
+private:
+
+    /*
+     * The accepting side either shares connections like this version,
+     * behaves like an older version (replying to the hello or not), or
+     * accepts the connection and then stops responding
+     */
+    enum Mode {
+        Shared,
+        LegacyReply,
+        LegacySilent,
+        Unresponsive
+    };
+
+    LanPeer createPeer() const;
+    Packet bulkPacket(int index) const;
+
+    Mode mMode;
+    Server mServer;
+
+    QList<LanTransport*> mConnections;
+    QList<LanMultiplexer*> mMultiplexers;
+    QList<LanChannel*> mChannels;
+    QList<Packet> mLegacyPackets;
+};
+
+void TestLanMultiplexer::init()
+{
+    mMode = Shared;
+    mLegacyPackets.clear();
+
+    // Incoming connections are handled the same way as the transport server
+    QVERIFY(mServer.listen(QHostAddress::LocalHost));
+    connect(&mServer, &Server::newSocketDescriptor, this, [this](qintptr socketDescriptor) {
+        LanTransport *transport = new LanTransport(
+            socketDescriptor
+#ifdef ENABLE_TLS
+          , QSslConfiguration()
+#endif
+        );
+        mConnections.append(transport);
+
+        if (mMode != Shared) {
+            connect(transport, &Transport::packetReceived, this, [this, transport](const Packet &packet) {
+                if (mMode == LegacyReply && mLegacyPackets.isEmpty()) {
+                    transport->sendPacket(Packet(Packet::Error, "unexpected packet"));
+                }
+
+                // An acceptance is a control frame for channel 0 with every
+                // field set to zero
+                if (mMode == Unresponsive && mLegacyPackets.isEmpty()) {
+                    transport->sendPacket(Packet(static_cast<Packet::Type>(LanMultiplexer::PacketType),
+                                                 QByteArray(AcceptSize, 0)));
+                }
+                mLegacyPackets.append(packet);
+            });
+            return;
+        }
+
+        connect(transport, &LanTransport::packetPeeked, this, [this, transport](Packet::Type type) {
+            QVERIFY(static_cast<int>(type) == LanMultiplexer::PacketType);
+            mConnections.removeOne(transport);
+            LanMultiplexer *multiplexer = new LanMultiplexer(transport, nullptr);
+            connect(multiplexer, &LanMultiplexer::channelReceived, this, [this](LanChannel *channel) {
+                mChannels.append(channel);
+            });
+            mMultiplexers.append(multiplexer);
+            transport->setReadPaused(false);
+        });
+        transport->peekPacket();
+    });
+}
+
+void TestLanMultiplexer::cleanup()
+{
+    disconnect(&mServer, nullptr, this, nullptr);
+    mServer.close();
+
+    qDeleteAll(mChannels);
+    mChannels.clear();
+    qDeleteAll(mMultiplexers);
+    mMultiplexers.clear();
+    qDeleteAll(mConnections);
+    mConnections.clear();
+}
+
+void TestLanMultiplexer::testNegotiation()
+{
+    LanMultiplexer multiplexer(createPeer(), "test", 0, nullptr);
+    QSignalSpy fallbackSpy(&multiplexer, &LanMultiplexer::fallback);
+    QScopedPointer<LanChannel> channel(multiplexer.openChannel());
+    QSignalSpy connectedSpy(channel.data(), &Transport::connected);
+    QSignalSpy receivedSpy(channel.data(), &Transport::packetReceived);
+
+    QVERIFY(connectedSpy.wait());
+    QTRY_COMPARE(mChannels.count(), 1);
+    QCOMPARE(mMultiplexers.count(), 1);
+    QCOMPARE(fallbackSpy.count(), 0);
+
+    // Packets make it through the channel in both directions
+    QSignalSpy peerReceivedSpy(mChannels.first(), &Transport::packetReceived);
+    channel->sendPacket(Packet(Packet::Json, "request"));
+    QVERIFY(peerReceivedSpy.wait());
+    QCOMPARE(peerReceivedSpy.at(0).at(0).value<Packet>().content(), QByteArray("request"));
+
+    mChannels.first()->sendPacket(Packet(Packet::Success, "reply"));
+    QVERIFY(receivedSpy.wait());
+    Packet reply = receivedSpy.at(0).at(0).value<Packet>();
+    QCOMPARE(reply.type(), Packet::Success);
+    QCOMPARE(reply.content(), QByteArray("reply"));
+}
+
+void TestLanMultiplexer::testFallback()
+{
+    mMode = LegacyReply;
+
+    LanMultiplexer multiplexer(createPeer(), "test", 0, nullptr);
+    QSignalSpy fallbackSpy(&multiplexer, &LanMultiplexer::fallback);
+    QSignalSpy finishedSpy(&multiplexer, &LanMultiplexer::finished);
+    QScopedPointer<LanChannel> channel(multiplexer.openChannel());
+    QSignalSpy connectedSpy(channel.data(), &Transport::connected);
+
+    // An older peer sees the hello as an empty transfer header; the error
+    // it replies with makes the channel open a connection of its own
+    QVERIFY(connectedSpy.wait());
+    QCOMPARE(fallbackSpy.count(), 1);
+    QCOMPARE(finishedSpy.count(), 1);
+    QTRY_COMPARE(mConnections.count(), 2);
+
+    QCOMPARE(mLegacyPackets.count(), 1);
+    QCOMPARE(static_cast<int>(mLegacyPackets.at(0).type()), LanMultiplexer::PacketType);
+    QJsonObject hello = QJsonDocument::fromJson(mLegacyPackets.at(0).content()).object();
+    QCOMPARE(hello.value("count").toString(), QString("0"));
+    QCOMPARE(hello.value("name").toString(), QString("test"));
+
+    // Packets on the channel are now sent as is on the new connection
+    channel->sendPacket(Packet(Packet::Json, "header"));
+    QTRY_COMPARE(mLegacyPackets.count(), 2);
+    QCOMPARE(mLegacyPackets.at(1).type(), Packet::Json);
+    QCOMPARE(mLegacyPackets.at(1).content(), QByteArray("header"));
+}
+
+void TestLanMultiplexer::testNegotiationTimeout()
+{
+    mMode = LegacySilent;
+
+    LanMultiplexer multiplexer(createPeer(), "test", 0, nullptr);
+    QSignalSpy fallbackSpy(&multiplexer, &LanMultiplexer::fallback);
+    QScopedPointer<LanChannel> channel(multiplexer.openChannel());
+    QSignalSpy connectedSpy(channel.data(), &Transport::connected);
+
+    // An older peer that does not reply is given up on and the empty
+    // transfer it is waiting on is failed
+    QVERIFY(fallbackSpy.wait(5000));
+    QVERIFY(connectedSpy.count() || connectedSpy.wait());
+    QTRY_COMPARE(mConnections.count(), 2);
+    QTRY_COMPARE(mLegacyPackets.count(), 2);
+    QCOMPARE(static_cast<int>(mLegacyPackets.at(0).type()), LanMultiplexer::PacketType);
+    QCOMPARE(mLegacyPackets.at(1).type(), Packet::Error);
+}
+
+void TestLanMultiplexer::testInterleaving()
+{
+    LanMultiplexer multiplexer(createPeer(), "test", 0, nullptr);
+    QScopedPointer<LanChannel> bulk(multiplexer.openChannel());
+    QScopedPointer<LanChannel> small(multiplexer.openChannel());
+    QSignalSpy connectedSpy(small.data(), &Transport::connected);
+    QVERIFY(connectedSpy.wait());
+    QTRY_COMPARE(mChannels.count(), 2);
+
+    // Record the order in which packets arrive on either channel
+    QList<int> arrivals;
+    connect(mChannels.at(0), &Transport::packetReceived, this, [&arrivals](const Packet &) {
+        arrivals.append(0);
+    });
+    connect(mChannels.at(1), &Transport::packetReceived, this, [&arrivals](const Packet &) {
+        arrivals.append(1);
+    });
+
+    // The small transfer starts after the bulk one has queued everything
+    // but must not wait for it to finish
+    for (int i = 0; i < BulkPacketCount; ++i) {
+        bulk->sendPacket(bulkPacket(i));
+    }
+    for (int i = 0; i < SmallPacketCount; ++i) {
+        small->sendPacket(Packet(Packet::Json, "small"));
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(arrivals.count(), BulkPacketCount + SmallPacketCount, 10000);
+    QCOMPARE(arrivals.count(1), SmallPacketCount);
+
+    // The bulk transfer can get no further ahead than its window
+    int window = static_cast<int>(LanChannel::Window / BulkPacketSize);
+    QVERIFY(arrivals.lastIndexOf(1) < window + SmallPacketCount);
+}
+
+void TestLanMultiplexer::testCredit()
+{
+    LanMultiplexer multiplexer(createPeer(), "test", 0, nullptr);
+    QScopedPointer<LanChannel> bulk(multiplexer.openChannel());
+    QScopedPointer<LanChannel> small(multiplexer.openChannel());
+    QSignalSpy connectedSpy(small.data(), &Transport::connected);
+    QVERIFY(connectedSpy.wait());
+    QTRY_COMPARE(mChannels.count(), 2);
+
+    QList<Packet> bulkPackets;
+    connect(mChannels.at(0), &Transport::packetReceived, this, [&bulkPackets](const Packet &packet) {
+        bulkPackets.append(packet);
+    });
+    QSignalSpy smallSpy(mChannels.at(1), &Transport::packetReceived);
+
+    // While the bulk transfer is not reading, no credit is returned and it
+    // cannot send more than its window - the other channel is unaffected
+    mChannels.at(0)->setReadPaused(true);
+    for (int i = 0; i < BulkPacketCount; ++i) {
+        bulk->sendPacket(bulkPacket(i));
+    }
+    for (int i = 0; i < SmallPacketCount; ++i) {
+        small->sendPacket(Packet(Packet::Json, "small"));
+    }
+
+    QTRY_COMPARE(smallSpy.count(), SmallPacketCount);
+    QTest::qWait(100);
+    QVERIFY(bulkPackets.isEmpty());
+    QVERIFY(bulk->bytesToWrite() >= BulkPacketCount * BulkPacketSize - LanChannel::Window - BulkPacketSize);
+
+    // Once reading resumes, everything arrives in order
+    mChannels.at(0)->setReadPaused(false);
+    QTRY_COMPARE_WITH_TIMEOUT(bulkPackets.count(), BulkPacketCount, 10000);
+    for (int i = 0; i < BulkPacketCount; ++i) {
+        QVERIFY(bulkPackets.at(i).content() == bulkPacket(i).content());
+    }
+    QTRY_COMPARE(bulk->bytesToWrite(), static_cast<qint64>(0));
+}
+
+void TestLanMultiplexer::testIdleReuse()
+{
+    LanMultiplexer multiplexer(createPeer(), "test", 10000, nullptr);
+    QSignalSpy reusedSpy(&multiplexer, &LanMultiplexer::reused);
+    QSignalSpy finishedSpy(&multiplexer, &LanMultiplexer::finished);
+
+    QScopedPointer<LanChannel> first(multiplexer.openChannel());
+    QSignalSpy firstConnectedSpy(first.data(), &Transport::connected);
+    QVERIFY(firstConnectedSpy.wait());
+    QTRY_COMPARE(mChannels.count(), 1);
+
+    // Closing the last channel leaves the connection open
+    QSignalSpy peerErrorSpy(mChannels.at(0), &Transport::error);
+    first->close();
+    QVERIFY(peerErrorSpy.wait());
+    QCOMPARE(finishedSpy.count(), 0);
+    QCOMPARE(reusedSpy.count(), 0);
+
+    // The next channel is ready without opening another connection
+    QScopedPointer<LanChannel> second(multiplexer.openChannel());
+    QCOMPARE(reusedSpy.count(), 1);
+    QSignalSpy secondConnectedSpy(second.data(), &Transport::connected);
+    QVERIFY(secondConnectedSpy.wait());
+    QTRY_COMPARE(mChannels.count(), 2);
+    QCOMPARE(mMultiplexers.count(), 1);
+    QCOMPARE(finishedSpy.count(), 0);
+}
+
+void TestLanMultiplexer::testIdleTimeout()
+{
+    LanMultiplexer multiplexer(createPeer(), "test", 200, nullptr);
+    QSignalSpy finishedSpy(&multiplexer, &LanMultiplexer::finished);
+
+    QScopedPointer<LanChannel> channel(multiplexer.openChannel());
+    QSignalSpy connectedSpy(channel.data(), &Transport::connected);
+    QVERIFY(connectedSpy.wait());
+    QTRY_COMPARE(mMultiplexers.count(), 1);
+    QSignalSpy peerFinishedSpy(mMultiplexers.first(), &LanMultiplexer::finished);
+
+    // The idle connection is closed once the timeout expires and the peer
+    // notices that it was closed
+    channel->close();
+    QVERIFY(finishedSpy.wait());
+    QVERIFY(peerFinishedSpy.count() || peerFinishedSpy.wait());
+    QVERIFY(!multiplexer.openChannel());
+}
+
+void TestLanMultiplexer::testPing()
+{
+    LanMultiplexer multiplexer(createPeer(), "test", 10000, nullptr);
+    multiplexer.setPingInterval(50);
+    QSignalSpy finishedSpy(&multiplexer, &LanMultiplexer::finished);
+
+    QScopedPointer<LanChannel> channel(multiplexer.openChannel());
+    QSignalSpy connectedSpy(channel.data(), &Transport::connected);
+    QVERIFY(connectedSpy.wait());
+
+    // A peer that answers every ping keeps the idle connection open
+    channel->close();
+    QTest::qWait(500);
+    QCOMPARE(finishedSpy.count(), 0);
+}
+
+void TestLanMultiplexer::testPingTimeout()
+{
+    mMode = Unresponsive;
+
+    LanMultiplexer multiplexer(createPeer(), "test", 10000, nullptr);
+    multiplexer.setPingInterval(50);
+    QSignalSpy finishedSpy(&multiplexer, &LanMultiplexer::finished);
+
+    QScopedPointer<LanChannel> channel(multiplexer.openChannel());
+    QSignalSpy connectedSpy(channel.data(), &Transport::connected);
+    QVERIFY(connectedSpy.wait());
+
+    // The connection is dropped long before the idle timeout since the
+    // peer never answers the ping
+    channel->close();
+    QVERIFY(finishedSpy.wait(2000));
+    QVERIFY(!multiplexer.openChannel());
+}
+
+LanPeer TestLanMultiplexer::createPeer() const
+{
+    LanPeer peer;
+    peer.address = QHostAddress::LocalHost;
+    peer.port = mServer.serverPort();
+    return peer;
+}
+
+Packet TestLanMultiplexer::bulkPacket(int index) const
+{
+    return Packet(Packet::Binary, QByteArray(BulkPacketSize, static_cast<char>(index)));
+}
+
+QTEST_MAIN(TestLanMultiplexer)
+#include "TestLanMultiplexer.moc"
@@ -0,0 +1,196 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <QFile>
+#include <QList>
+#include <QSignalSpy>
+#include <QTemporaryFile>
+#include <QTest>
+
+#include <nitroshare/packet.h>
+
+#include "lantransport.h"
+#include "server.h"
+
+// Amount of file data sent - more than the socket can take at once
+const int DataSize = 4194304;
+
+// Position of the data in the file
+const int Offset = 4096;
+
+/*
+ * Create data that differs at every position within a packet
+ */
+QByteArray createData(int size)
+{
+    QByteArray data(size, 0);
+    for (int i = 0; i < size; ++i) {
+        data[i] = static_cast<char>((i * 7 + i / 251) & 0xff);
+    }
+    return data;
+}
+
+class TestLanTransport : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void init();
+    void cleanup();
+
+    void testSendFile();
+    void testReceiveFile();
+
+private:
+
+    Server mServer;
+    LanTransport *mSender;
+    LanTransport *mReceiver;
+};
+
+void TestLanTransport::init()
+{
+    mSender = nullptr;
+    mReceiver = nullptr;
+
+    QVERIFY(mServer.listen(QHostAddress::LocalHost));
+    connect(&mServer, &Server::newSocketDescriptor, this, [this](qintptr socketDescriptor) {
+        mReceiver = new LanTransport(
+            socketDescriptor
+#ifdef ENABLE_TLS
+          , QSslConfiguration()
+#endif
+        );
+    });
+
+    mSender = new LanTransport(
+        QHostAddress::LocalHost
+      , mServer.serverPort()
+#ifdef ENABLE_TLS
+      , QSslConfiguration()
+#endif
+    );
+    QSignalSpy connectedSpy(mSender, &Transport::connected);
+    QTRY_VERIFY(connectedSpy.count() && mReceiver);
+
+    mSender->setMaxPacketSize(DataSize * 2);
+    mReceiver->setMaxPacketSize(DataSize * 2);
+}
+
+void TestLanTransport::cleanup()
+{
+    disconnect(&mServer, nullptr, this, nullptr);
+    mServer.close();
+    delete mSender;
+    delete mReceiver;
+}
+
+void TestLanTransport::testSendFile()
+{
+    if (!mSender->canSendFile()) {
+        QSKIP("file data is always copied on this platform");
+    }
+
+    QByteArray data = createData(DataSize);
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QCOMPARE(file.write(QByteArray(Offset, 'x') + data), static_cast<qint64>(Offset + DataSize));
+    QVERIFY(file.flush());
+
+    QList<Packet> packets;
+    connect(mReceiver, &Transport::packetReceived, this, [&packets](const Packet &packet) {
+        packets.append(packet);
+    });
+
+    // The file data must arrive intact and in order with the packets around
+    // it, even though the descriptor is closed right away and the data is
+    // split into two packets
+    mSender->sendPacket(Packet(Packet::Json, "before"));
+    mSender->sendFile(Packet::Binary, "prefix", file.handle(), Offset, DataSize / 2);
+    mSender->sendFile(Packet::Binary, QByteArray(), file.handle(), Offset + DataSize / 2, DataSize / 2);
+    mSender->sendPacket(Packet(Packet::Success, "after"));
+    file.close();
+
+    QTRY_COMPARE_WITH_TIMEOUT(packets.count(), 4, 10000);
+    QCOMPARE(packets.at(0).type(), Packet::Json);
+    QCOMPARE(packets.at(0).content(), QByteArray("before"));
+    QCOMPARE(packets.at(1).type(), Packet::Binary);
+    QVERIFY(packets.at(1).content() == "prefix" + data.left(DataSize / 2));
+    QCOMPARE(packets.at(2).type(), Packet::Binary);
+    QVERIFY(packets.at(2).content() == data.mid(DataSize / 2));
+    QCOMPARE(packets.at(3).type(), Packet::Success);
+    QCOMPARE(packets.at(3).content(), QByteArray("after"));
+    QCOMPARE(mSender->bytesToWrite(), static_cast<qint64>(0));
+}
+
+void TestLanTransport::testReceiveFile()
+{
+    if (!mReceiver->canReceiveFile()) {
+        QSKIP("received data is always copied on this platform");
+    }
+
+    QByteArray data = createData(DataSize);
+    QTemporaryFile file;
+    QVERIFY(file.open());
+
+    qint64 bytesReceived = 0;
+    QList<Packet> packets;
+    connect(mReceiver, &Transport::fileReceived, this, [&bytesReceived](qint64 length) {
+        bytesReceived += length;
+    });
+    connect(mReceiver, &Transport::packetReceived, this, [&packets](const Packet &packet) {
+        packets.append(packet);
+    });
+
+    // The content of consecutive binary packets is written one after the
+    // other while other packets are received as usual
+    mReceiver->receiveFile(file.handle(), Offset);
+    mSender->sendPacket(Packet(Packet::Binary, data.left(DataSize / 4)));
+    mSender->sendPacket(Packet(Packet::Json, "between"));
+    mSender->sendPacket(Packet(Packet::Binary, data.mid(DataSize / 4, 1)));
+    mSender->sendPacket(Packet(Packet::Binary, data.mid(DataSize / 4 + 1)));
+
+    QTRY_COMPARE_WITH_TIMEOUT(bytesReceived, static_cast<qint64>(DataSize), 10000);
+    mReceiver->receiveFile(-1, 0);
+
+    // Packets that follow are no longer written to the file
+    mSender->sendPacket(Packet(Packet::Binary, "after"));
+    QTRY_COMPARE(packets.count(), 2);
+    QCOMPARE(packets.at(0).type(), Packet::Json);
+    QCOMPARE(packets.at(0).content(), QByteArray("between"));
+    QCOMPARE(packets.at(1).type(), Packet::Binary);
+    QCOMPARE(packets.at(1).content(), QByteArray("after"));
+
+    QFile written(file.fileName());
+    QVERIFY(written.open(QIODevice::ReadOnly));
+    QCOMPARE(written.size(), static_cast<qint64>(Offset + DataSize));
+    QVERIFY(written.seek(Offset));
+    QVERIFY(written.readAll() == data);
+}
+
+QTEST_MAIN(TestLanTransport)
+#include "TestLanTransport.moc"
@@ -0,0 +1,126 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <QScopedPointer>
+#include <QSettings>
+#include <QSignalSpy>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QTest>
+
+#include <nitroshare/application.h>
+#include <nitroshare/logger.h>
+#include <nitroshare/message.h>
+#include <nitroshare/packet.h>
+#include <nitroshare/settingsregistry.h>
+
+#include "lanchannel.h"
+#include "lanmultiplexer.h"
+#include "lantransport.h"
+#include "lantransportserver.h"
+#include "mock/mockdevice.h"
+
+// Ports used by the sending and receiving devices
+const int SenderPort = 40828;
+const int ReceiverPort = 40829;
+
+class TestLanTransportServer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void testSharedConnections();
+
+private:
+
+    int incomingConnections(Application *application) const;
+};
+
+void TestLanTransportServer::testSharedConnections()
+{
+    // Each device has an application of its own with default settings
+    QTemporaryFile senderFile;
+    QTemporaryFile receiverFile;
+    QVERIFY(senderFile.open());
+    QVERIFY(receiverFile.open());
+    QSettings senderSettings(senderFile.fileName(), QSettings::IniFormat);
+    QSettings receiverSettings(receiverFile.fileName(), QSettings::IniFormat);
+    Application sender(&senderSettings);
+    Application receiver(&receiverSettings);
+    sender.settingsRegistry()->setValue("TransferPort", SenderPort);
+    receiver.settingsRegistry()->setValue("TransferPort", ReceiverPort);
+
+    LanTransportServer senderServer(&sender);
+    LanTransportServer receiverServer(&receiver);
+    QSignalSpy transportReceivedSpy(&receiverServer, &TransportServer::transportReceived);
+
+    MockDevice device;
+    device.setProperty("addresses", QStringList{ "127.0.0.1" });
+    device.setProperty("port", ReceiverPort);
+
+    // The first transport to the device asks whether it shares connections
+    QScopedPointer<Transport> probe(senderServer.createTransport(&device));
+    QVERIFY(qobject_cast<LanTransport*>(probe.data()));
+    QCOMPARE(probe->features(), QStringList{ LanMultiplexer::Feature });
+    QSignalSpy connectedSpy(probe.data(), &Transport::connected);
+    QTRY_COMPARE(connectedSpy.count(), 1);
+    probe->sendPacket(Packet(Packet::Json, "{}"));
+
+    // The receiving end offers to share connections
+    QTRY_COMPARE(transportReceivedSpy.count(), 1);
+    QScopedPointer<Transport> incoming(transportReceivedSpy.at(0).at(0).value<Transport*>());
+    QCOMPARE(incoming->features(), QStringList{ LanMultiplexer::Feature });
+
+    // Once the transfer acknowledges it, the following transfers share a
+    // connection that stays open between them
+    probe->setPeerFeatures({ LanMultiplexer::Feature });
+    probe->close();
+    for (int i = 0; i < 2; ++i) {
+        QScopedPointer<Transport> channel(senderServer.createTransport(&device));
+        QVERIFY(qobject_cast<LanChannel*>(channel.data()));
+        channel->sendPacket(Packet(Packet::Json, "{}"));
+        QTRY_COMPARE(transportReceivedSpy.count(), i + 2);
+        QScopedPointer<Transport> incomingChannel(transportReceivedSpy.last().at(0).value<Transport*>());
+        QVERIFY(qobject_cast<LanChannel*>(incomingChannel.data()));
+        channel->close();
+    }
+    QCOMPARE(incomingConnections(&receiver), 2);
+}
+
+int TestLanTransportServer::incomingConnections(Application *application) const
+{
+    int count = 0;
+    foreach (Message *message, application->logger()->messages()) {
+        if (message->body() == "socket descriptor for incoming connection received") {
+            ++count;
+        }
+    }
+    return count;
+}
+
+QTEST_MAIN(TestLanTransportServer)
+#include "TestLanTransportServer.moc"
@@ -0,0 +1,180 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <limits>
+
+#include <QList>
+#include <QTest>
+#include <QtEndian>
+
+#include <nitroshare/packet.h>
+
+#include "packetframer.h"
+
+typedef QList<QPair<Packet::Type, QByteArray>> PacketList;
+
+/*
+ * Encode a packet the way it is written to the socket
+ */
+QByteArray encode(Packet::Type type, const QByteArray &content)
+{
+    QByteArray data(PacketFramer::HeaderSize, 0);
+    qToLittleEndian<qint32>(content.size() + 1, reinterpret_cast<uchar*>(data.data()));
+    data[PacketFramer::HeaderSize - 1] = static_cast<char>(type);
+    return data + content;
+}
+
+/*
+ * Take every complete packet from the framer
+ */
+void takePackets(PacketFramer &framer, PacketList &packets)
+{
+    while (framer.hasPacket()) {
+        QVERIFY(framer.isHeaderValid());
+        Packet packet = framer.takePacket();
+        packets.append({ packet.type(), packet.content() });
+    }
+}
+
+class TestPacketFramer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void initTestCase();
+
+    void testSplit();
+    void testByteByByte();
+    void testZeroLength();
+    void testInvalidHeader();
+    void testOversized();
+
+private:
+
+    PacketList mPackets;
+    QByteArray mStream;
+};
+
+void TestPacketFramer::initTestCase()
+{
+    QByteArray binary;
+    for (int i = 0; i < 300; ++i) {
+        binary.append(static_cast<char>(i));
+    }
+
+    mPackets = PacketList{
+        { Packet::Success, QByteArray() },
+        { Packet::Json, "{\"name\":\"test\"}" },
+        { Packet::Binary, binary },
+        { Packet::Error, QByteArray() },
+        { Packet::Binary, QByteArray(1, 'x') }
+    };
+    foreach (auto packet, mPackets) {
+        mStream.append(encode(packet.first, packet.second));
+    }
+}
+
+void TestPacketFramer::testSplit()
+{
+    // Split the stream at every possible position, including within headers
+    for (int i = 0; i <= mStream.size(); ++i) {
+        PacketFramer framer;
+        PacketList packets;
+
+        framer.append(mStream.left(i));
+        takePackets(framer, packets);
+        framer.append(mStream.mid(i));
+        takePackets(framer, packets);
+
+        QCOMPARE(packets, mPackets);
+        QCOMPARE(framer.available(), 0);
+    }
+}
+
+void TestPacketFramer::testByteByByte()
+{
+    // Packets are taken as soon as they are complete, which moves the
+    // unread data around in the buffer as it is compacted
+    PacketFramer framer;
+    PacketList packets;
+    for (int i = 0; i < mStream.size(); ++i) {
+        framer.append(mStream.mid(i, 1));
+        takePackets(framer, packets);
+    }
+    QCOMPARE(packets, mPackets);
+    QCOMPARE(framer.available(), 0);
+}
+
+void TestPacketFramer::testZeroLength()
+{
+    PacketFramer framer;
+    framer.append(encode(Packet::Success, QByteArray()));
+
+    QVERIFY(framer.hasHeader());
+    QVERIFY(framer.isHeaderValid());
+    QCOMPARE(framer.contentSize(), 0);
+    QVERIFY(framer.hasPacket());
+
+    Packet packet = framer.takePacket();
+    QCOMPARE(packet.type(), Packet::Success);
+    QVERIFY(packet.content().isEmpty());
+    QCOMPARE(framer.available(), 0);
+}
+
+void TestPacketFramer::testInvalidHeader()
+{
+    // The size includes the type, so neither zero nor a negative size is
+    // possible
+    foreach (qint32 size, QList<qint32>({ 0, -1 })) {
+        QByteArray data(PacketFramer::HeaderSize, 0);
+        qToLittleEndian<qint32>(size, reinterpret_cast<uchar*>(data.data()));
+
+        PacketFramer framer;
+        framer.append(data);
+        QVERIFY(framer.hasHeader());
+        QVERIFY(!framer.isHeaderValid());
+    }
+}
+
+void TestPacketFramer::testOversized()
+{
+    // The header of a packet far larger than the data available must be
+    // reported as is (so that the transport can reject it) without the
+    // packet ever appearing complete
+    QByteArray data(PacketFramer::HeaderSize, 0);
+    qToLittleEndian<qint32>(std::numeric_limits<qint32>::max(), reinterpret_cast<uchar*>(data.data()));
+    data[PacketFramer::HeaderSize - 1] = static_cast<char>(Packet::Binary);
+
+    PacketFramer framer;
+    framer.append(data + QByteArray(65536, 'x'));
+    QVERIFY(framer.hasHeader());
+    QVERIFY(framer.isHeaderValid());
+    QCOMPARE(framer.contentSize(), std::numeric_limits<qint32>::max() - 1);
+    QCOMPARE(framer.type(), Packet::Binary);
+    QVERIFY(!framer.hasPacket());
+}
+
+QTEST_MAIN(TestPacketFramer)
+#include "TestPacketFramer.moc"
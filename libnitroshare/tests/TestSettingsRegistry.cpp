@@ -26,6 +26,7 @@
 #include <QSignalSpy>
 #include <QTemporaryFile>
 #include <QTest>
+#include <QThread>
 
 #include <nitroshare/setting.h>
 #include <nitroshare/settingsregistry.h>
@@ -45,6 +46,32 @@ Setting TestSetting({
     { Setting::DefaultValueKey, DefaultValue }
 });
 
+// Reads the setting repeatedly, the way transfer worker threads do
+class ReaderThread : public QThread
+{
+public:
+
+    explicit ReaderThread(SettingsRegistry *registry) : mRegistry(registry), mInvalid(0) {}
+
+    int invalid() const { return mInvalid; }
+
+protected:
+
+    void run() override {
+        for (int i = 0; i < 10000; ++i) {
+            QString value = mRegistry->value(Name).toString();
+            if (value != DefaultValue && value != TestValue) {
+                ++mInvalid;
+            }
+        }
+    }
+
+private:
+
+    SettingsRegistry *mRegistry;
+    int mInvalid;
+};
+
 class TestSettingsRegistry : public QObject
 {
     Q_OBJECT
@@ -56,6 +83,7 @@ private slots:
     void testAddRemove();
     void testChange();
     void testBeginEnd();
+    void testThreads();
 
 private:
 
@@ -125,5 +153,20 @@ void TestSettingsRegistry::testBeginEnd()
     QCOMPARE(settingsChanged.at(0).at(0).toStringList().at(0), Name);
 }
 
+void TestSettingsRegistry::testThreads()
+{
+    DECLARE_REGISTRY(registry);
+    registry.addSetting(&TestSetting);
+
+    // Change the value on this thread while it is read on another
+    ReaderThread thread(&registry);
+    thread.start();
+    for (int i = 0; !thread.isFinished(); ++i) {
+        registry.setValue(Name, i % 2 ? TestValue : DefaultValue);
+    }
+    QVERIFY(thread.wait());
+    QCOMPARE(thread.invalid(), 0);
+}
+
 QTEST_MAIN(TestSettingsRegistry)
 #include "TestSettingsRegistry.moc"
@@ -22,15 +22,25 @@
  * IN THE SOFTWARE.
  */
 
+#include <limits>
+
+#include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QSettings>
 #include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryFile>
 #include <QTest>
+#include <QtEndian>
 
 #include <nitroshare/application.h>
 #include <nitroshare/bundle.h>
+#include <nitroshare/cborutil.h>
 #include <nitroshare/handlerregistry.h>
+#include <nitroshare/settingsregistry.h>
 #include <nitroshare/transfer.h>
+#include <nitroshare/transfermodel.h>
 #include <nitroshare/transportserverregistry.h>
 
 #include "mock/mockapplication.h"
@@ -44,6 +54,26 @@ Q_DECLARE_METATYPE(Transfer::State)
 
 const QString ErrorMessage = "test";
 
+// XXH64 digest of MockItem::Data
+const QByteArray DataDigest = QByteArray::fromHex("b7119b48552d1da3");
+
+// Delta operations as they are encoded in Delta packets
+QByteArray literalOperation(qint32 length, const QByteArray &data)
+{
+    QByteArray operation(1 + sizeof(qint32), 0);
+    qToLittleEndian<qint32>(length, reinterpret_cast<uchar*>(operation.data() + 1));
+    return operation + data;
+}
+
+QByteArray copyOperation(qint64 offset, qint64 length)
+{
+    QByteArray operation(1 + sizeof(qint64) * 2, 0);
+    operation[0] = 1;
+    qToLittleEndian<qint64>(offset, reinterpret_cast<uchar*>(operation.data() + 1));
+    qToLittleEndian<qint64>(length, reinterpret_cast<uchar*>(operation.data() + 1 + sizeof(qint64)));
+    return operation;
+}
+
 class TestTransfer : public QObject
 {
     Q_OBJECT
@@ -53,7 +83,34 @@ private slots:
     void initTestCase();
 
     void testSending();
+    void testSendingDefaults();
+    void testSendWindow();
+    void testSendUnknownWindow();
+    void testSendingStreams();
+    void testSendingDelta();
+    void testSendingDigest();
+    void testSendingReadAhead();
+    void testSendingTransportFeatures();
     void testReceiving();
+    void testReceivingStreams();
+    void testReceivingStripes();
+    void testReceivingStripeOutOfRange();
+    void testReceivingStripeOverlap();
+    void testReceivingInvalidDelta_data();
+    void testReceivingInvalidDelta();
+    void testResuming();
+    void testResumingMissingPartial();
+    void testReceivingCompressed();
+    void testReceivingBatch();
+    void testReceivingCbor();
+    void testReceivingDigest();
+    void testReceivingLimit();
+    void testReceivingMaxPacketSize();
+    void testReceivingTransportFeatures();
+    void testReceivingNoSpace();
+    void testReceivingWriteBehind();
+    void testWorkerThread();
+    void testQueue();
     void testAbort();
 
 private:
@@ -67,6 +124,9 @@ void TestTransfer::initTestCase()
 {
     qRegisterMetaType<Transfer::State>("State");
 
+    // Transfer journals are written to the application data directory
+    QStandardPaths::setTestModeEnabled(true);
+
     mApplication.application()->handlerRegistry()->add(&mHandler);
     mApplication.application()->transportServerRegistry()->add(&mTransportServer);
 }
@@ -110,6 +170,7 @@ void TestTransfer::testSending()
     QCOMPARE(packets.at(0).first, Packet::Json);
     QJsonObject transferHeader{
         { "name", MockApplication::DeviceName },
+        { "uuid", MockApplication::DeviceUuid },
         { "size", QString::number(MockItem::Data.size()) },
         { "count", QString::number(1) }
     };
@@ -138,6 +199,273 @@ void TestTransfer::testSending()
     QCOMPARE(transfer.state(), Transfer::Succeeded);
 
     QVERIFY(transport->isClosed());
+
+    // Ensure the item header and item read were counted
+    QVariantMap stats = transfer.stats();
+    QCOMPARE(stats.value("headerCount").toLongLong(), static_cast<qint64>(1));
+    QCOMPARE(stats.value("readCount").toLongLong(), static_cast<qint64>(1));
+    QCOMPARE(stats.value("readBytes").toLongLong(), static_cast<qint64>(MockItem::Data.size()));
+}
+
+void TestTransfer::testSendingDefaults()
+{
+    // Use an application with every setting left at its default
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QSettings settings(file.fileName(), QSettings::IniFormat);
+    Application application(&settings);
+    application.handlerRegistry()->add(&mHandler);
+    application.transportServerRegistry()->add(&mTransportServer);
+
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    Transfer *transfer = new Transfer(&application, &device, bundle);
+    application.transferModel()->add(transfer);
+    QTRY_VERIFY(device.transport());
+
+    MockTransport *transport = device.transport();
+    transport->emitConnected();
+
+    // Nothing is requested that a legacy receiver would have to acknowledge,
+    // so the item follows the transfer header right away
+    QTRY_COMPARE(transport->packets().count(), 3);
+    QJsonObject transferHeader = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QVERIFY(!transferHeader.contains("features"));
+    QCOMPARE(transport->packets().at(2).first, Packet::Binary);
+    QCOMPARE(transport->packets().at(2).second, MockItem::Data);
+
+    transfer->cancel();
+    QTRY_COMPARE(transfer->state(), Transfer::Failed);
+
+    application.transportServerRegistry()->remove(&mTransportServer);
+    application.handlerRegistry()->remove(&mHandler);
+}
+
+void TestTransfer::testSendWindow()
+{
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    Transfer transfer(mApplication.application(), &device, bundle);
+    MockTransport *transport = device.transport();
+
+    // Report a full send window so that nothing beyond the transfer header
+    // is sent when the transport indicates data was written
+    transport->setBytesToWrite(std::numeric_limits<qint64>::max());
+    transport->emitConnected();
+    QTest::qWait(100);
+    QCOMPARE(transport->packets().count(), 1);
+
+    // Once the window drains, the remaining packets should be sent at once
+    transport->setBytesToWrite(0);
+    emit transport->packetSent();
+    QCOMPARE(transport->packets().count(), 3);
+}
+
+void TestTransfer::testSendUnknownWindow()
+{
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    Transfer transfer(mApplication.application(), &device, bundle);
+    MockTransport *transport = device.transport();
+
+    // A transport that cannot report pending data should receive a single
+    // packet each time it indicates data was written
+    transport->setBytesToWrite(-1);
+    transport->emitConnected();
+    QTest::qWait(100);
+    QCOMPARE(transport->packets().count(), 1);
+
+    emit transport->packetSent();
+    QCOMPARE(transport->packets().count(), 2);
+
+    emit transport->packetSent();
+    QCOMPARE(transport->packets().count(), 3);
+}
+
+void TestTransfer::testSendingStreams()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferStreamsSettingName, 2);
+
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    bundle->add(new MockItem);
+    Transfer transfer(mApplication.application(), &device, bundle);
+    MockTransport *transport = device.transport();
+
+    // Keep the first stream from claiming any items
+    transport->setBytesToWrite(std::numeric_limits<qint64>::max());
+    transport->emitConnected();
+
+    // The transfer header should request the additional stream
+    QCOMPARE(transport->packets().count(), 1);
+    QJsonObject transferHeader = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(transferHeader.value("features").toArray(), (QJsonArray{ "streams", "stripes" }));
+    QCOMPARE(transferHeader.value("streams").toInt(), 2);
+    QString id = transferHeader.value("id").toString();
+    QVERIFY(!id.isEmpty());
+
+    // Acknowledge the feature, which should open the second stream
+    QJsonObject ack{
+        { "features", QJsonArray{ "streams" } },
+        { "streams", 2 }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(ack).toJson());
+    MockTransport *secondTransport = device.transport();
+    QVERIFY(secondTransport != transport);
+
+    // The second stream identifies the transfer and then sends both items
+    secondTransport->emitConnected();
+    QCOMPARE(secondTransport->packets().count(), 5);
+    QJsonObject streamHeader{
+        { "id", id },
+        { "stream", 1 }
+    };
+    QCOMPARE(QJsonDocument::fromJson(secondTransport->packets().at(0).second).object(), streamHeader);
+    QCOMPARE(secondTransport->packets().at(2).second, MockItem::Data);
+    QCOMPARE(secondTransport->packets().at(4).second, MockItem::Data);
+
+    // The success packet may arrive on either stream
+    transport->sendData(Packet::Success);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+    QVERIFY(transport->isClosed());
+    QVERIFY(secondTransport->isClosed());
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferStreamsSettingName, 1);
+}
+
+void TestTransfer::testSendingDelta()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferDeltaThresholdSettingName, 1);
+
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    Transfer transfer(mApplication.application(), &device, bundle);
+    MockTransport *transport = device.transport();
+    transport->emitConnected();
+
+    QJsonObject ack{
+        { "features", QJsonArray{ "delta" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(ack).toJson());
+
+    // The item header should request a signature and nothing else is sent
+    // until it arrives
+    QTest::qWait(100);
+    QCOMPARE(transport->packets().count(), 2);
+    QVERIFY(QJsonDocument::fromJson(transport->packets().at(1).second).object().value("delta").toBool());
+
+    // Reply with a signature containing no blocks
+    QByteArray signature(sizeof(qint32), 0);
+    qToLittleEndian<qint32>(1024, reinterpret_cast<uchar*>(signature.data()));
+    transport->sendData(Packet::Signature, signature);
+
+    // The item is too small to match anything and is sent as a literal run
+    QCOMPARE(transport->packets().count(), 3);
+    QCOMPARE(transport->packets().at(2).first, Packet::Delta);
+    QByteArray literal(1 + sizeof(qint32), 0);
+    qToLittleEndian<qint32>(MockItem::Data.size(), reinterpret_cast<uchar*>(literal.data() + 1));
+    QCOMPARE(transport->packets().at(2).second, literal + MockItem::Data);
+    QCOMPARE(transfer.progress(), 100);
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferDeltaThresholdSettingName, 0);
+}
+
+void TestTransfer::testSendingDigest()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferDigestSettingName, "xxh64");
+
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    Transfer transfer(mApplication.application(), &device, bundle);
+    MockTransport *transport = device.transport();
+    transport->emitConnected();
+
+    // Ensure the digest was requested
+    QJsonObject transferHeader = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(transferHeader.value("features").toArray(), (QJsonArray{ "digest" }));
+    QCOMPARE(transferHeader.value("digest").toString(), QString("xxh64"));
+
+    QJsonObject ack{
+        { "features", QJsonArray{ "digest" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(ack).toJson());
+
+    // The item content should be followed by its digest
+    QTRY_COMPARE(transport->packets().count(), 4);
+    QVERIFY(QJsonDocument::fromJson(transport->packets().at(1).second).object().value("digest").toBool());
+    QCOMPARE(transport->packets().at(2).first, Packet::Binary);
+    QCOMPARE(transport->packets().at(3).first, Packet::Digest);
+    QCOMPARE(transport->packets().at(3).second, DataDigest);
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferDigestSettingName, "none");
+}
+
+void TestTransfer::testSendingReadAhead()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferReadAheadSettingName, 1048576);
+
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    for (int i = 0; i < 3; ++i) {
+        bundle->add(new MockItem);
+    }
+    Transfer transfer(mApplication.application(), &device, bundle);
+
+    MockTransport *transport = device.transport();
+    transport->emitConnected();
+
+    // The transfer header is followed by the header & content of each item
+    QTRY_COMPARE(transport->packets().count(), 7);
+
+    const MockTransport::PacketList &packets = transport->packets();
+    for (int i = 0; i < 3; ++i) {
+        QCOMPARE(packets.at(1 + i * 2).first, Packet::Json);
+        QCOMPARE(packets.at(2 + i * 2).first, Packet::Binary);
+        QCOMPARE(packets.at(2 + i * 2).second, MockItem::Data);
+    }
+    QCOMPARE(transfer.progress(), 100);
+
+    transport->sendData(Packet::Success);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+
+    // Ensure every block was read from the read-ahead buffer
+    QVariantMap stats = transfer.stats();
+    QCOMPARE(stats.value("readCount").toLongLong(), static_cast<qint64>(3));
+    QCOMPARE(stats.value("readBytes").toLongLong(), static_cast<qint64>(MockItem::Data.size() * 3));
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferReadAheadSettingName, 0);
+}
+
+void TestTransfer::testSendingTransportFeatures()
+{
+    MockDevice device;
+    Bundle *bundle = new Bundle;
+    bundle->add(new MockItem);
+    Transfer transfer(mApplication.application(), &device, bundle);
+    MockTransport *transport = device.transport();
+    transport->setFeatures({ "test" });
+    transport->emitConnected();
+
+    // The features of the transport are requested in the transfer header
+    QCOMPARE(transport->packets().count(), 1);
+    QJsonObject transferHeader = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(transferHeader.value("features").toArray(), QJsonArray{ "test" });
+
+    // The transport is told once the receiver acknowledges them
+    QJsonObject ack{
+        { "features", QJsonArray{ "test" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(ack).toJson());
+    QCOMPARE(transport->peerFeatures(), QStringList{ "test" });
+
+    QTRY_COMPARE(transport->packets().count(), 3);
+    QCOMPARE(transport->packets().at(2).second, MockItem::Data);
 }
 
 void TestTransfer::testReceiving()
@@ -190,6 +518,711 @@ void TestTransfer::testReceiving()
     QCOMPARE(transport->packets().count(), 1);
     QCOMPARE(transport->packets().at(0).first, Packet::Success);
     QVERIFY(transport->isClosed());
+
+    // Ensure the item header and item write were counted
+    QVariantMap stats = transfer.stats();
+    QCOMPARE(stats.value("headerCount").toLongLong(), static_cast<qint64>(1));
+    QCOMPARE(stats.value("writeCount").toLongLong(), static_cast<qint64>(1));
+    QCOMPARE(stats.value("writeBytes").toLongLong(), static_cast<qint64>(MockItem::Data.size()));
+}
+
+void TestTransfer::testReceivingStreams()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer *transfer = new Transfer(mApplication.application(), transport);
+    mApplication.application()->transferModel()->add(transfer);
+
+    // Request an additional stream in the transfer header
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size() * 2) },
+        { "count", QString::number(2) },
+        { "id", "transfer-id" },
+        { "features", QJsonArray{ "streams" } },
+        { "streams", 2 }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // Ensure the feature was acknowledged
+    QCOMPARE(transport->packets().count(), 1);
+    QJsonObject ack{
+        { "features", QJsonArray{ "streams" } },
+        { "streams", 2 }
+    };
+    QCOMPARE(QJsonDocument::fromJson(transport->packets().at(0).second).object(), ack);
+
+    // Connect the second stream, which should join the first transfer
+    MockTransport *secondTransport = new MockTransport;
+    Transfer placeholder(mApplication.application(), secondTransport);
+    QJsonObject streamHeader{
+        { "id", "transfer-id" },
+        { "stream", 1 }
+    };
+    secondTransport->sendData(Packet::Json, QJsonDocument(streamHeader).toJson());
+    QCOMPARE(placeholder.state(), Transfer::Succeeded);
+
+    // Send one item over each stream
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) }
+    };
+    secondTransport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    secondTransport->sendData(Packet::Binary, MockItem::Data);
+    QCOMPARE(transfer->state(), Transfer::InProgress);
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    transport->sendData(Packet::Binary, MockItem::Data);
+
+    // Ensure the transfer succeeded and both streams were notified
+    QCOMPARE(transfer->state(), Transfer::Succeeded);
+    QCOMPARE(transport->packets().last().first, Packet::Success);
+    QCOMPARE(secondTransport->packets().last().first, Packet::Success);
+    QVERIFY(transport->isClosed());
+    QVERIFY(secondTransport->isClosed());
+
+    mApplication.application()->transferModel()->dismissAll();
+}
+
+void TestTransfer::testReceivingStripes()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer *transfer = new Transfer(mApplication.application(), transport);
+    mApplication.application()->transferModel()->add(transfer);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "id", "transfer-id" },
+        { "features", QJsonArray{ "streams", "stripes" } },
+        { "streams", 2 }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+    QCOMPARE(QJsonDocument::fromJson(transport->packets().at(0).second).object().value("features").toArray(),
+             (QJsonArray{ "streams", "stripes" }));
+
+    MockTransport *secondTransport = new MockTransport;
+    Transfer placeholder(mApplication.application(), secondTransport);
+    QJsonObject streamHeader{
+        { "id", "transfer-id" },
+        { "stream", 1 }
+    };
+    secondTransport->sendData(Packet::Json, QJsonDocument(streamHeader).toJson());
+
+    // Both streams announce the same striped item
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "stripe", QString::number(0) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    secondTransport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+
+    auto chunk = [](qint64 offset, const QByteArray &data) {
+        QByteArray content(sizeof(qint64), 0);
+        qToLittleEndian<qint64>(offset, reinterpret_cast<uchar*>(content.data()));
+        return content + data;
+    };
+
+    // Send the second half of the item before the first half
+    int half = MockItem::Data.size() / 2;
+    secondTransport->sendData(Packet::Chunk, chunk(half, MockItem::Data.mid(half)));
+    QCOMPARE(transfer->state(), Transfer::InProgress);
+    transport->sendData(Packet::Chunk, chunk(0, MockItem::Data.left(half)));
+
+    QCOMPARE(transfer->progress(), 100);
+    QCOMPARE(transfer->state(), Transfer::Succeeded);
+
+    mApplication.application()->transferModel()->dismissAll();
+}
+
+void TestTransfer::testReceivingStripeOutOfRange()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "id", "transfer-id" },
+        { "features", QJsonArray{ "streams", "stripes" } },
+        { "streams", 2 }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "stripe", QString::number(0) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+
+    // A chunk that extends past the end of the item must be rejected
+    QByteArray content(sizeof(qint64), 0);
+    qToLittleEndian<qint64>(1, reinterpret_cast<uchar*>(content.data()));
+    transport->sendData(Packet::Chunk, content + MockItem::Data);
+
+    QCOMPARE(transfer.state(), Transfer::Failed);
+    QCOMPARE(transport->packets().last().first, Packet::Error);
+}
+
+void TestTransfer::testReceivingStripeOverlap()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "id", "transfer-id" },
+        { "features", QJsonArray{ "streams", "stripes" } },
+        { "streams", 2 }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "stripe", QString::number(0) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+
+    auto chunk = [](qint64 offset, const QByteArray &data) {
+        QByteArray content(sizeof(qint64), 0);
+        qToLittleEndian<qint64>(offset, reinterpret_cast<uchar*>(content.data()));
+        return content + data;
+    };
+
+    // Repeated and overlapping chunks must not complete the item while part
+    // of it is still missing
+    int half = MockItem::Data.size() / 2;
+    transport->sendData(Packet::Chunk, chunk(0, MockItem::Data.left(half)));
+    transport->sendData(Packet::Chunk, chunk(0, MockItem::Data.left(half)));
+    transport->sendData(Packet::Chunk, chunk(1, MockItem::Data.mid(1, half)));
+    QCOMPARE(transfer.state(), Transfer::InProgress);
+    QVERIFY(transfer.progress() < 100);
+
+    // The rest of the item completes it
+    transport->sendData(Packet::Chunk, chunk(half, MockItem::Data.mid(half)));
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+}
+
+void TestTransfer::testReceivingInvalidDelta_data()
+{
+    QTest::addColumn<QByteArray>("delta");
+
+    QTest::newRow("negative copy") << copyOperation(0, -1);
+    QTest::newRow("copy past end") << copyOperation(2, MockItem::Data.size());
+    QTest::newRow("copy backwards") << literalOperation(2, "da") + copyOperation(0, 2);
+    QTest::newRow("negative literal") << literalOperation(-1, QByteArray());
+    QTest::newRow("literal past packet") << literalOperation(MockItem::Data.size(), "da");
+    QTest::newRow("literal past end") << literalOperation(8, "datadata");
+}
+
+void TestTransfer::testReceivingInvalidDelta()
+{
+    QFETCH(QByteArray, delta);
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "delta" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "delta", true }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+
+    // The reply to the transfer header is followed by the signature
+    QCOMPARE(transport->packets().count(), 2);
+    QCOMPARE(transport->packets().at(1).first, Packet::Signature);
+
+    // Operations that would write outside the item must be rejected
+    transport->sendData(Packet::Delta, delta);
+
+    QCOMPARE(transfer.state(), Transfer::Failed);
+    QCOMPARE(transport->packets().last().first, Packet::Error);
+}
+
+void TestTransfer::testResuming()
+{
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size() * 2) },
+        { "count", QString::number(2) },
+        { "features", QJsonArray{ "resume" } },
+        { "resume", QString(40, 'a') }
+    };
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) }
+    };
+    int half = MockItem::Data.size() / 2;
+
+    {
+        MockTransport *transport = new MockTransport;
+        Transfer transfer(mApplication.application(), transport);
+        transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+        // Receive the first item and half of the second before failing
+        itemHeader.insert("index", "0");
+        transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+        transport->sendData(Packet::Binary, MockItem::Data);
+        itemHeader.insert("index", "1");
+        transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+        transport->sendData(Packet::Binary, MockItem::Data.left(half));
+        emit transport->error(ErrorMessage);
+        QCOMPARE(transfer.state(), Transfer::Failed);
+    }
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // The acknowledgement should indicate where to continue
+    QJsonObject resume{
+        { "completed", QJsonArray{ "0" } },
+        { "offsets", QJsonObject{ { "1", QString::number(half) } } }
+    };
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("resume").toObject(), resume);
+
+    // Send the rest of the second item
+    itemHeader.insert("offset", QString::number(half));
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    transport->sendData(Packet::Binary, MockItem::Data.mid(half));
+
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+}
+
+void TestTransfer::testResumingMissingPartial()
+{
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "resume" } },
+        { "resume", QString(40, 'b') }
+    };
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "index", "0" }
+    };
+    int half = MockItem::Data.size() / 2;
+
+    {
+        MockTransport *transport = new MockTransport;
+        Transfer transfer(mApplication.application(), transport);
+        transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+        // Receive half of the item before failing
+        transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+        transport->sendData(Packet::Binary, MockItem::Data.left(half));
+        emit transport->error(ErrorMessage);
+        QCOMPARE(transfer.state(), Transfer::Failed);
+    }
+
+    QJsonObject itemHeaderOffset = itemHeader;
+    itemHeaderOffset.insert("offset", QString::number(half));
+
+    {
+        MockTransport *transport = new MockTransport;
+        Transfer transfer(mApplication.application(), transport);
+        transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+        // An offset other than the one that was journalled is rejected
+        QJsonObject itemHeaderInvalid = itemHeader;
+        itemHeaderInvalid.insert("offset", QString::number(half + 1));
+        transport->sendData(Packet::Json, QJsonDocument(itemHeaderInvalid).toJson());
+        QCOMPARE(transfer.state(), Transfer::Failed);
+        QCOMPARE(transport->packets().last().first, Packet::Error);
+    }
+
+    {
+        MockTransport *transport = new MockTransport;
+        Transfer transfer(mApplication.application(), transport);
+        transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+        // The partially received item was deleted in the meantime
+        mHandler.setExistingSize(0);
+        transport->sendData(Packet::Json, QJsonDocument(itemHeaderOffset).toJson());
+        mHandler.setExistingSize(-1);
+        QCOMPARE(transfer.state(), Transfer::Failed);
+        QCOMPARE(transport->packets().last().first, Packet::Error);
+    }
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // The next attempt receives the item from the start
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QVERIFY(ack.value("resume").toObject().value("offsets").toObject().isEmpty());
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    transport->sendData(Packet::Binary, MockItem::Data);
+
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+}
+
+void TestTransfer::testReceivingCompressed()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "compression" } },
+        { "compression", QJsonArray{ "unknown", "zlib" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // The first supported method should be selected
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("compression").toString(), QString("zlib"));
+
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+
+    // Send the item content compressed with zlib (method 1)
+    transport->sendData(Packet::Compressed, QByteArray(1, 1) + qCompress(MockItem::Data));
+
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+}
+
+void TestTransfer::testReceivingBatch()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size() * 2) },
+        { "count", QString::number(2) },
+        { "features", QJsonArray{ "batch" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("features").toArray(), (QJsonArray{ "batch" }));
+
+    // Pack both items into a single batch
+    QByteArray header = QJsonDocument(QJsonObject{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) }
+    }).toJson(QJsonDocument::Compact);
+    QByteArray entry(sizeof(qint32), 0);
+    qToLittleEndian<qint32>(header.size(), reinterpret_cast<uchar*>(entry.data()));
+    entry.append(header);
+    entry.append(MockItem::Data);
+    transport->sendData(Packet::Batch, entry + entry);
+
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+    QCOMPARE(transport->packets().last().first, Packet::Success);
+}
+
+void TestTransfer::testReceivingCbor()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "cbor" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("features").toArray(), (QJsonArray{ "cbor" }));
+
+    // Numbers in binary headers do not need to be sent as strings
+    QVariantMap itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", static_cast<qint64>(MockItem::Data.size()) }
+    };
+    transport->sendData(Packet::Cbor, CborUtil::encode(itemHeader));
+    transport->sendData(Packet::Binary, MockItem::Data);
+
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+}
+
+void TestTransfer::testReceivingMaxPacketSize()
+{
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "cbor" } },
+        { "maxPacketSize", QString::number(4194304) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // Senders that announce a limit are told the receiver's limit in turn
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("maxPacketSize").toString(), QString::number(16777216));
+}
+
+void TestTransfer::testReceivingTransportFeatures()
+{
+    MockTransport *transport = new MockTransport;
+    transport->setFeatures({ "test" });
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "test", "unknown" } }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // Only the features the transport has are acknowledged
+    QCOMPARE(transport->packets().count(), 1);
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("features").toArray(), QJsonArray{ "test" });
+}
+
+void TestTransfer::testReceivingNoSpace()
+{
+    // Files have one byte less than the transfer needs
+    MockHandler fileHandler("file", MockItem::Data.size() - 1);
+    mApplication.application()->handlerRegistry()->add(&fileHandler);
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+
+    // The transfer should be rejected before any items arrive
+    QCOMPARE(transfer.state(), Transfer::Failed);
+    QCOMPARE(transport->packets().count(), 1);
+    QCOMPARE(transport->packets().at(0).first, Packet::Error);
+
+    mApplication.application()->handlerRegistry()->remove(&fileHandler);
+}
+
+void TestTransfer::testReceivingWriteBehind()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferWriteBufferSettingName, 1048576);
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+
+    // Send the item data in two blocks that are written on the disk thread
+    int half = MockItem::Data.size() / 2;
+    transport->sendData(Packet::Binary, MockItem::Data.left(half));
+    transport->sendData(Packet::Binary, MockItem::Data.mid(half));
+
+    // The writes must complete before success is reported to the sender
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+    QCOMPARE(transport->packets().count(), 1);
+    QCOMPARE(transport->packets().at(0).first, Packet::Success);
+
+    // Ensure writes on the disk thread were counted
+    QVariantMap stats = transfer.stats();
+    QCOMPARE(stats.value("writeBytes").toLongLong(), static_cast<qint64>(MockItem::Data.size()));
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferWriteBufferSettingName, 0);
+}
+
+void TestTransfer::testWorkerThread()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferWorkerThreadsSettingName, 2);
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QSignalSpy progressChangedSpy(&transfer, &Transfer::progressChanged);
+    QSignalSpy stateChangedSpy(&transfer, &Transfer::stateChanged);
+
+    // The packets are emitted on this thread and queued to the worker
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    transport->sendData(Packet::Binary, MockItem::Data);
+
+    // Ensure the changes were published on this thread
+    QTRY_COMPARE(transfer.state(), Transfer::Succeeded);
+    QCOMPARE(stateChangedSpy.count(), 1);
+    QCOMPARE(progressChangedSpy.last().at(0), QVariant(100));
+    QCOMPARE(transfer.progress(), 100);
+    QCOMPARE(transfer.deviceName(), MockDevice::Name);
+
+    // Ensure a success packet was sent and the transport closed
+    QCOMPARE(transport->packets().count(), 1);
+    QCOMPARE(transport->packets().at(0).first, Packet::Success);
+    QVERIFY(transport->isClosed());
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferWorkerThreadsSettingName, 0);
+}
+
+void TestTransfer::testReceivingDigest()
+{
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "count", QString::number(1) },
+        { "features", QJsonArray{ "digest" } },
+        { "digest", "xxh64" }
+    };
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(MockItem::Data.size()) },
+        { "digest", true }
+    };
+
+    // The item is only accepted once the digest arrives and matches
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+    QJsonObject ack = QJsonDocument::fromJson(transport->packets().at(0).second).object();
+    QCOMPARE(ack.value("features").toArray(), (QJsonArray{ "digest" }));
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    transport->sendData(Packet::Binary, MockItem::Data);
+    QCOMPARE(transfer.state(), Transfer::InProgress);
+    transport->sendData(Packet::Digest, DataDigest);
+    QCOMPARE(transfer.state(), Transfer::Succeeded);
+
+    // A mismatch fails the transfer
+    MockTransport *badTransport = new MockTransport;
+    Transfer badTransfer(mApplication.application(), badTransport);
+    badTransport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+    badTransport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    badTransport->sendData(Packet::Binary, MockItem::Data);
+    badTransport->sendData(Packet::Digest, QByteArray(DataDigest.size(), 0));
+    QCOMPARE(badTransfer.state(), Transfer::Failed);
+    QCOMPARE(badTransport->packets().last().first, Packet::Error);
+}
+
+void TestTransfer::testReceivingLimit()
+{
+    // Allow 1 KiB/s, which the item is well over
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferDownloadLimitSettingName, 1);
+
+    const QByteArray data(4096, 'x');
+
+    MockTransport *transport = new MockTransport;
+    Transfer transfer(mApplication.application(), transport);
+
+    QJsonObject transferHeader{
+        { "name", MockDevice::Name },
+        { "size", QString::number(data.size() * 2) },
+        { "count", QString::number(2) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(transferHeader).toJson());
+    QJsonObject itemHeader{
+        { "name", MockItem::Name },
+        { "type", MockItem::Type },
+        { "size", QString::number(data.size()) }
+    };
+    transport->sendData(Packet::Json, QJsonDocument(itemHeader).toJson());
+    QVERIFY(!transport->isReadPaused());
+
+    // Reading should stop once the limit is exceeded
+    transport->sendData(Packet::Binary, data);
+    QVERIFY(transport->isReadPaused());
+    QCOMPARE(transfer.state(), Transfer::InProgress);
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferDownloadLimitSettingName, 0);
+}
+
+void TestTransfer::testQueue()
+{
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferMaxActiveSettingName, 1);
+
+    // Only one transfer may be active, so the first one starts once added
+    MockDevice device;
+    Bundle *bulkBundle = new Bundle;
+    bulkBundle->add(new MockItem);
+    Transfer *bulk = new Transfer(mApplication.application(), &device, bulkBundle);
+    bulk->setPriority(Transfer::Bulk);
+    QCOMPARE(bulk->state(), Transfer::Queued);
+    mApplication.application()->transferModel()->add(bulk);
+    QTRY_COMPARE(bulk->state(), Transfer::Connecting);
+
+    // A small bundle is interactive by default and preempts the bulk transfer
+    Bundle *interactiveBundle = new Bundle;
+    interactiveBundle->add(new MockItem);
+    Transfer *interactive = new Transfer(mApplication.application(), &device, interactiveBundle);
+    QCOMPARE(interactive->priority(), Transfer::Interactive);
+    QCOMPARE(interactive->state(), Transfer::Queued);
+    mApplication.application()->transferModel()->add(interactive);
+    QTRY_COMPARE(interactive->state(), Transfer::Connecting);
+    QCOMPARE(bulk->state(), Transfer::Paused);
+
+    // Once the interactive transfer finishes, the bulk transfer resumes
+    interactive->cancel();
+    QTRY_COMPARE(interactive->state(), Transfer::Failed);
+    QTRY_COMPARE(bulk->state(), Transfer::Connecting);
+
+    bulk->cancel();
+    QTRY_COMPARE(bulk->state(), Transfer::Failed);
+    mApplication.application()->transferModel()->dismissAll();
+
+    mApplication.application()->settingsRegistry()->setValue(Application::TransferMaxActiveSettingName, 0);
 }
 
 void TestTransfer::testAbort()
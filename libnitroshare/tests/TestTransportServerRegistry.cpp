@@ -0,0 +1,99 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QScopedPointer>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <nitroshare/transportserverregistry.h>
+
+#include "mock/mockdevice.h"
+#include "mock/mocktransport.h"
+#include "mock/mocktransportserver.h"
+
+const qint64 Budget = 1024;
+
+class TestTransportServerRegistry : public QObject
+{
+    Q_OBJECT
+
+private slots:
+
+    void testReceiveBudget();
+    void testReceiveOversized();
+    void testDedicatedTransport();
+};
+
+void TestTransportServerRegistry::testReceiveBudget()
+{
+    TransportServerRegistry registry;
+    registry.setReceiveBudget(Budget);
+
+    QSignalSpy releasedSpy(&registry, &TransportServerRegistry::receiveMemoryReleased);
+
+    // Reservations succeed until the budget is used up
+    QVERIFY(registry.reserveReceiveMemory(Budget / 2));
+    QVERIFY(registry.reserveReceiveMemory(Budget / 2));
+    QCOMPARE(registry.receiveMemoryUsed(), Budget);
+    QVERIFY(!registry.reserveReceiveMemory(1));
+
+    // Releasing memory after a refusal notifies the waiting transports
+    registry.releaseReceiveMemory(Budget / 2);
+    QCOMPARE(releasedSpy.count(), 1);
+    QVERIFY(registry.reserveReceiveMemory(1));
+
+    // Without a refusal, nobody is waiting and no signal is emitted
+    registry.releaseReceiveMemory(1);
+    QCOMPARE(releasedSpy.count(), 1);
+}
+
+void TestTransportServerRegistry::testReceiveOversized()
+{
+    TransportServerRegistry registry;
+    registry.setReceiveBudget(Budget);
+
+    // A packet larger than the budget is accepted if nothing else is using
+    // memory but blocks every other packet until it is released
+    QVERIFY(registry.reserveReceiveMemory(Budget * 2));
+    QVERIFY(!registry.reserveReceiveMemory(1));
+    registry.releaseReceiveMemory(Budget * 2);
+    QCOMPARE(registry.receiveMemoryUsed(), static_cast<qint64>(0));
+    QVERIFY(registry.reserveReceiveMemory(1));
+}
+
+void TestTransportServerRegistry::testDedicatedTransport()
+{
+    TransportServerRegistry registry;
+    MockTransportServer server;
+    registry.add(&server);
+
+    // Servers that never share connections create the same transport either way
+    MockDevice device;
+    QScopedPointer<Transport> transport(registry.createDedicatedTransport(&device));
+    QVERIFY(transport);
+    QCOMPARE(transport.data(), static_cast<Transport*>(device.transport()));
+}
+
+QTEST_MAIN(TestTransportServerRegistry)
+#include "TestTransportServerRegistry.moc"
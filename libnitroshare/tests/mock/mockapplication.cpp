@@ -36,6 +36,14 @@ MockApplication::MockApplication()
 {
     mApplication.settingsRegistry()->setValue(Application::DeviceUuidSettingName, DeviceUuid);
     mApplication.settingsRegistry()->setValue(Application::DeviceNameSettingName, DeviceName);
+
+    // Tests drive transfers directly and expect them on the main thread, to
+    // start right away, and to read and write item data immediately
+    mApplication.settingsRegistry()->setValue(Application::TransferWorkerThreadsSettingName, 0);
+    mApplication.settingsRegistry()->setValue(Application::TransferMaxActiveSettingName, 0);
+    mApplication.settingsRegistry()->setValue(Application::TransferMaxActivePerDeviceSettingName, 0);
+    mApplication.settingsRegistry()->setValue(Application::TransferWriteBufferSettingName, 0);
+    mApplication.settingsRegistry()->setValue(Application::TransferReadAheadSettingName, 0);
 }
 
 Application *MockApplication::application()
@@ -25,12 +25,34 @@
 #include "mockhandler.h"
 #include "mockitem.h"
 
+MockHandler::MockHandler()
+    : MockHandler(MockItem::Type, -1)
+{
+}
+
+MockHandler::MockHandler(const QString &name, qint64 bytesAvailable)
+    : mName(name),
+      mBytesAvailable(bytesAvailable),
+      mExistingSize(-1)
+{
+}
+
 QString MockHandler::name() const
 {
-    return MockItem::Type;
+    return mName;
 }
 
 Item *MockHandler::createItem(const QString &, const QVariantMap &params)
 {
-    return new MockItem(params);
+    return new MockItem(params, mExistingSize);
+}
+
+qint64 MockHandler::bytesAvailable() const
+{
+    return mBytesAvailable;
+}
+
+void MockHandler::setExistingSize(qint64 existingSize)
+{
+    mExistingSize = existingSize;
 }
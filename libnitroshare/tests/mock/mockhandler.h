@@ -35,8 +35,20 @@ class MOCK_EXPORT MockHandler : public Handler
 
 public:
 
+    MockHandler();
+    MockHandler(const QString &name, qint64 bytesAvailable);
+
     virtual QString name() const;
     virtual Item *createItem(const QString &type, const QVariantMap &params);
+    virtual qint64 bytesAvailable() const;
+
+    void setExistingSize(qint64 existingSize);
+
+private:
+
+    QString mName;
+    qint64 mBytesAvailable;
+    qint64 mExistingSize;
 };
 
 #endif // MOCKHANDLER_H
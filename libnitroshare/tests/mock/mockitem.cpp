@@ -31,13 +31,15 @@ const QByteArray MockItem::Data = "data";
 MockItem::MockItem()
     : mName(Name),
       mSize(Data.size()),
+      mExistingSize(-1),
       mData(Data)
 {
 }
 
-MockItem::MockItem(const QVariantMap &params)
+MockItem::MockItem(const QVariantMap &params, qint64 existingSize)
     : mName(params.value("name").toString()),
-      mSize(params.value("size").toString().toLongLong())
+      mSize(params.value("size").toString().toLongLong()),
+      mExistingSize(existingSize)
 {
 }
 
@@ -60,3 +62,13 @@ QByteArray MockItem::read()
 {
     return mData;
 }
+
+bool MockItem::seek(qint64)
+{
+    return true;
+}
+
+qint64 MockItem::existingSize() const
+{
+    return mExistingSize;
+}
@@ -42,17 +42,20 @@ public:
     static const QByteArray Data;
 
     MockItem();
-    explicit MockItem(const QVariantMap &params);
+    explicit MockItem(const QVariantMap &params, qint64 existingSize = -1);
 
     virtual QString type() const;
     virtual QString name() const;
     virtual qint64 size() const;
     virtual QByteArray read();
+    virtual bool seek(qint64 offset);
+    virtual qint64 existingSize() const;
 
 private:
 
     QString mName;
     qint64 mSize;
+    qint64 mExistingSize;
     QByteArray mData;
 };
 
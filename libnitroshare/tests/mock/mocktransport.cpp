@@ -27,16 +27,38 @@
 #include "mocktransport.h"
 
 MockTransport::MockTransport()
-    : mClosed(false)
+    : mClosed(false),
+      mReadPaused(false),
+      mBytesToWrite(0)
 {
 }
 
-void MockTransport::sendPacket(Packet *packet)
+void MockTransport::sendPacket(const Packet &packet)
 {
-    mPackets.append({ packet->type(), packet->content() });
+    mPackets.append({ packet.type(), packet.content() });
     QMetaObject::invokeMethod(this, "packetSent", Qt::QueuedConnection);
 }
 
+qint64 MockTransport::bytesToWrite() const
+{
+    return mBytesToWrite;
+}
+
+void MockTransport::setReadPaused(bool paused)
+{
+    mReadPaused = paused;
+}
+
+QStringList MockTransport::features() const
+{
+    return mFeatures;
+}
+
+void MockTransport::setPeerFeatures(const QStringList &features)
+{
+    mPeerFeatures = features;
+}
+
 void MockTransport::close()
 {
     mClosed = true;
@@ -52,6 +74,26 @@ bool MockTransport::isClosed() const
     return mClosed;
 }
 
+bool MockTransport::isReadPaused() const
+{
+    return mReadPaused;
+}
+
+const QStringList &MockTransport::peerFeatures() const
+{
+    return mPeerFeatures;
+}
+
+void MockTransport::setBytesToWrite(qint64 bytesToWrite)
+{
+    mBytesToWrite = bytesToWrite;
+}
+
+void MockTransport::setFeatures(const QStringList &features)
+{
+    mFeatures = features;
+}
+
 void MockTransport::emitConnected()
 {
     emit connected();
@@ -59,6 +101,5 @@ void MockTransport::emitConnected()
 
 void MockTransport::sendData(Packet::Type type, const QByteArray &data)
 {
-    Packet packet(type, data);
-    emit packetReceived(&packet);
+    emit packetReceived(Packet(type, data));
 }
@@ -27,6 +27,7 @@
 
 #include <QList>
 #include <QPair>
+#include <QStringList>
 
 #include <nitroshare/packet.h>
 #include <nitroshare/transport.h>
@@ -43,11 +44,20 @@ public:
 
     MockTransport();
 
-    virtual void sendPacket(Packet *packet);
+    virtual void sendPacket(const Packet &packet);
+    virtual qint64 bytesToWrite() const;
+    virtual void setReadPaused(bool paused);
+    virtual QStringList features() const;
+    virtual void setPeerFeatures(const QStringList &features);
     virtual void close();
 
     const PacketList &packets() const;
     bool isClosed() const;
+    bool isReadPaused() const;
+    const QStringList &peerFeatures() const;
+
+    void setBytesToWrite(qint64 bytesToWrite);
+    void setFeatures(const QStringList &features);
 
     void emitConnected();
     void sendData(Packet::Type type, const QByteArray &data = QByteArray());
@@ -56,6 +66,10 @@ private:
 
     PacketList mPackets;
     bool mClosed;
+    bool mReadPaused;
+    qint64 mBytesToWrite;
+    QStringList mFeatures;
+    QStringList mPeerFeatures;
 };
 
 #endif // MOCKTRANSPORT_H
@@ -28,6 +28,7 @@
 #include "actionswidget.h"
 #include "deviceswidget.h"
 #include "devwindow.h"
+#include "transferswidget.h"
 
 DevWindow::DevWindow(Application *application)
 {
@@ -36,6 +37,7 @@ DevWindow::DevWindow(Application *application)
     QTabWidget *tabWidget = new QTabWidget;
     tabWidget->addTab(new ActionsWidget(application), tr("Actions"));
     tabWidget->addTab(new DevicesWidget(application), tr("Devices"));
+    tabWidget->addTab(new TransfersWidget(application), tr("Transfers"));
 
     QVBoxLayout *vboxLayout = new QVBoxLayout;
     vboxLayout->addWidget(tabWidget);
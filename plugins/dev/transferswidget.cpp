@@ -0,0 +1,91 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+
+#include <QHeaderView>
+#include <QLabel>
+#include <QTableWidgetItem>
+#include <QVBoxLayout>
+
+#include <nitroshare/application.h>
+#include <nitroshare/transfer.h>
+#include <nitroshare/transfermodel.h>
+
+#include "transferswidget.h"
+
+// Counters from Transfer::stats() shown in the table
+const QStringList StatNames = {
+    "readTime",
+    "readBytes",
+    "writeTime",
+    "writeBytes",
+    "headerTime",
+    "headerCount",
+    "blockedTime",
+    "blockedCount"
+};
+
+// Interval for refreshing the table
+const int RefreshInterval = 1000;
+
+TransfersWidget::TransfersWidget(Application *application)
+    : mApplication(application),
+      mTableWidget(new QTableWidget)
+{
+    QLabel *instructionsLabel = new QLabel(tr(
+        "Use this tool to view where transfers spend their time (in microseconds)."
+    ));
+
+    mTableWidget->setColumnCount(StatNames.count() + 1);
+    mTableWidget->setHorizontalHeaderLabels(QStringList() << tr("Device") << StatNames);
+    mTableWidget->horizontalHeader()->setStretchLastSection(true);
+    mTableWidget->verticalHeader()->setVisible(false);
+
+    connect(&mTimer, &QTimer::timeout, this, &TransfersWidget::onTimeout);
+    mTimer.start(RefreshInterval);
+
+    QVBoxLayout *vboxLayout = new QVBoxLayout;
+    vboxLayout->addWidget(instructionsLabel);
+    vboxLayout->addWidget(mTableWidget);
+    setLayout(vboxLayout);
+
+    onTimeout();
+}
+
+void TransfersWidget::onTimeout()
+{
+    TransferModel *model = mApplication->transferModel();
+    mTableWidget->setRowCount(model->rowCount());
+
+    // Populate the table with the stats for each transfer
+    for (int i = 0; i < model->rowCount(); ++i) {
+        Transfer *transfer = model->data(model->index(i, 0), Qt::UserRole).value<Transfer*>();
+        QVariantMap stats = transfer->stats();
+
+        mTableWidget->setItem(i, 0, new QTableWidgetItem(transfer->deviceName()));
+        for (int j = 0; j < StatNames.count(); ++j) {
+            mTableWidget->setItem(i, j + 1, new QTableWidgetItem(
+                QString::number(stats.value(StatNames.at(j)).toLongLong())
+            ));
+        }
+    }
+}
@@ -27,6 +27,8 @@
 #if defined(Q_OS_WIN32)
 #  include <windows.h>
 #elif defined(Q_OS_UNIX)
+#  include <cerrno>
+#  include <fcntl.h>
 #  include <sys/stat.h>
 #  include <utime.h>
 #endif
@@ -35,7 +37,16 @@
 
 #include "file.h"
 
+// Amount of data read at once from files being received (only used for
+// reading blocks of an existing copy)
+const int ReceiveBlockSize = 65536;
+
+// Amount of data at the start of files being sent that the kernel is asked to
+// begin reading right away
+const qint64 WillNeedSize = 4194304;
+
 File::File(const QString &root, const QVariantMap &properties)
+    : mBlockSize(ReceiveBlockSize)
 {
     mRelativeFilename = properties.value("name").toString();
 
@@ -47,6 +58,10 @@ File::File(const QString &root, const QVariantMap &properties)
     mReadOnly = properties.value("readOnly").toBool();
     mExecutable = properties.value("executable").toBool();
 
+    // The existing content is only kept when the item continues an earlier
+    // attempt or is rebuilt from a delta against the existing copy
+    mTruncate = !properties.contains("offset") && !properties.value("delta").toBool();
+
     // Suppport older versions of NitroShare that send the last modification
     // and last read properties with different names
 
@@ -58,6 +73,7 @@ File::File(const QString &root, const QVariantMap &properties)
 }
 
 File::File(const QDir &root, const QFileInfo &info, int blockSize)
+    : mTruncate(false)
 {
     mFile.setFileName(info.absoluteFilePath());
     mBlockSize = blockSize;
@@ -128,7 +144,72 @@ bool File::open(OpenMode openMode)
     if (openMode == Write && !QDir(QFileInfo(mFile.fileName()).absolutePath()).mkpath(".")) {
         return false;
     }
-    return mFile.open(openMode == Read ? QIODevice::ReadOnly : QIODevice::WriteOnly);
+
+    if (openMode == Read) {
+        if (!mFile.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        adviseSequential();
+        return true;
+    }
+
+    // Files that continue an interrupted transfer or are rebuilt from a delta
+    // keep their content and are truncated to their final size when closed
+    QIODevice::OpenMode mode = QIODevice::ReadWrite | QIODevice::Unbuffered;
+    if (mTruncate) {
+        mode |= QIODevice::Truncate;
+    }
+    if (!mFile.open(mode)) {
+        return false;
+    }
+    if (!preallocate()) {
+        mFile.close();
+        return false;
+    }
+    return true;
+}
+
+bool File::preallocate()
+{
+    qint64 length = mSize - mFile.size();
+    if (length <= 0) {
+        return true;
+    }
+
+    // Reserve the space for the rest of the file before any content arrives
+    // so that it is laid out contiguously and a lack of space is caught now;
+    // the size of the file is left alone (posix_fallocate() would change it
+    // and falls back to writing zeros where the filesystem has no support)
+#if defined(Q_OS_LINUX)
+    if (fallocate(mFile.handle(), FALLOC_FL_KEEP_SIZE, mFile.size(), length) && errno == ENOSPC) {
+        emit error(QString("not enough space for \"%1\"").arg(mRelativeFilename));
+        return false;
+    }
+#elif defined(Q_OS_MAC)
+    fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, length, 0 };
+    if (fcntl(mFile.handle(), F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        if (fcntl(mFile.handle(), F_PREALLOCATE, &store) == -1 && errno == ENOSPC) {
+            emit error(QString("not enough space for \"%1\"").arg(mRelativeFilename));
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
+void File::adviseSequential()
+{
+    // The file is read from start to finish, so have the kernel read further
+    // ahead than usual and start on the first part of the file now - items
+    // are often opened before they are sent, which hides the cost of seeking
+    // on spinning disks and reading from a cold cache
+#if defined(Q_OS_LINUX)
+    posix_fadvise(mFile.handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(mFile.handle(), 0, qMin(mSize, WillNeedSize), POSIX_FADV_WILLNEED);
+#elif defined(Q_OS_MAC)
+    fcntl(mFile.handle(), F_RDAHEAD, 1);
+#endif
 }
 
 QByteArray File::read()
@@ -153,6 +234,24 @@ void File::write(const QByteArray &data)
     }
 }
 
+bool File::seek(qint64 offset)
+{
+    // Writing past the end of the file extends it, which allows chunks to be
+    // written in any order
+    return mFile.seek(offset);
+}
+
+int File::handle() const
+{
+    return mFile.handle();
+}
+
+qint64 File::existingSize() const
+{
+    // Space reserved by preallocate() is not included in the size
+    return mFile.size();
+}
+
 #ifdef Q_OS_WIN32
 
 // Adapted from https://support.microsoft.com/en-us/help/167296
@@ -170,6 +269,9 @@ void unixTimestampMsToFiletime(qint64 timestampMs, LPFILETIME pft)
 
 void File::close()
 {
+    if ((mFile.openMode() & QIODevice::WriteOnly) && !mFile.resize(mSize)) {
+        emit error(mFile.errorString());
+    }
     mFile.close();
 
 #if defined(Q_OS_WIN32)
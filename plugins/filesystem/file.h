@@ -70,16 +70,23 @@ public:
     virtual bool open(OpenMode openMode);
     virtual QByteArray read();
     virtual void write(const QByteArray &data);
+    virtual bool seek(qint64 offset);
+    virtual int handle() const;
+    virtual qint64 existingSize() const;
     virtual void close();
 
 private:
 
+    bool preallocate();
+    void adviseSequential();
+
     QFile mFile;
     int mBlockSize;
 
     QString mRelativeFilename;
 
     qint64 mSize;
+    bool mTruncate;
     bool mReadOnly;
     bool mExecutable;
 
@@ -22,7 +22,10 @@
  * IN THE SOFTWARE.
  */
 
+#include <QDir>
+#include <QFileInfo>
 #include <QStandardPaths>
+#include <QStorageInfo>
 
 #include <nitroshare/application.h>
 #include <nitroshare/settingsregistry.h>
@@ -61,3 +64,21 @@ Item *FileHandler::createItem(const QString &, const QVariantMap &properties)
         properties
     );
 }
+
+qint64 FileHandler::bytesAvailable() const
+{
+    // The transfer directory is created when the first item is received, so
+    // look for the closest directory that already exists
+    QString path = QDir::cleanPath(
+        mApplication->settingsRegistry()->value(TransferDirectory).toString());
+    while (!QFileInfo::exists(path)) {
+        QString parent = QFileInfo(path).absolutePath();
+        if (parent == path) {
+            return -1;
+        }
+        path = parent;
+    }
+
+    QStorageInfo storageInfo(path);
+    return storageInfo.isValid() ? storageInfo.bytesAvailable() : -1;
+}
@@ -44,6 +44,7 @@ public:
 
     virtual QString name() const;
     virtual Item *createItem(const QString &type, const QVariantMap &properties);
+    virtual qint64 bytesAvailable() const;
 
 private:
 
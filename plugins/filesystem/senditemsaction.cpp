@@ -70,6 +70,9 @@ QString SendItemsAction::description() const
         "- \"enumerator\" (string) name of the enumerator for the device\n"
         "- \"items\" (array of strings) absolute paths for the items to send\n"
         "\n"
+        "The optional \"priority\" parameter (\"interactive\", \"normal\", or "
+        "\"bulk\") determines the order in which queued transfers start.\n"
+        "\n"
         "The return value will be a boolean indicating if the transfer was created."
     );
 }
@@ -89,9 +92,19 @@ QVariant SendItemsAction::invoke(const QVariantMap &params)
     Bundle *bundle = createBundle(params.value("items").toStringList());
 
     // Create the transfer
-    mApplication->transferModel()->add(
-        new Transfer(mApplication, device, bundle)
-    );
+    Transfer *transfer = new Transfer(mApplication, device, bundle);
+
+    // Override the default priority (based on size) if requested
+    QString priority = params.value("priority").toString();
+    if (priority == "interactive") {
+        transfer->setPriority(Transfer::Interactive);
+    } else if (priority == "normal") {
+        transfer->setPriority(Transfer::Normal);
+    } else if (priority == "bulk") {
+        transfer->setPriority(Transfer::Bulk);
+    }
+
+    mApplication->transferModel()->add(transfer);
 
     return true;
 }
@@ -0,0 +1,190 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QMetaObject>
+
+#include "lanchannel.h"
+
+const qint64 LanChannel::Window = 1048576;
+
+// Largest packet accepted before a transfer sets its own limit
+const qint64 DefaultMaxPacketSize = 16777216;
+
+LanChannel::LanChannel(quint32 id, const LanPeer &peer)
+    : mId(id)
+    , mPeer(peer)
+    , mTransport(nullptr)
+    , mReadPaused(false)
+    , mBytesToWrite(0)
+    , mBytesConsumed(0)
+    , mMaxPacketSize(DefaultMaxPacketSize)
+    , mClosed(false)
+{
+}
+
+void LanChannel::sendPacket(const Packet &packet)
+{
+    if (mTransport) {
+        mTransport->sendPacket(packet);
+        return;
+    }
+    if (mClosed) {
+        return;
+    }
+    mBytesToWrite += packet.content().size();
+    emit packetQueued(mId, packet);
+}
+
+qint64 LanChannel::bytesToWrite() const
+{
+    // Only the packets still waiting for their turn on the connection count
+    // towards the send window of the transfer
+    return mTransport ? mTransport->bytesToWrite() : mBytesToWrite;
+}
+
+void LanChannel::setReadPaused(bool paused)
+{
+    mReadPaused = paused;
+    if (mTransport) {
+        mTransport->setReadPaused(paused);
+        return;
+    }
+
+    // The call may come from a slot connected to packetReceived, so the
+    // packets received while paused are delivered later
+    if (!paused && !mPending.isEmpty()) {
+        QMetaObject::invokeMethod(this, "deliverPending", Qt::QueuedConnection);
+    }
+}
+
+bool LanChannel::canSendFile() const
+{
+    // File data cannot be interleaved with packets from the other channels
+    return mTransport && mTransport->canSendFile();
+}
+
+void LanChannel::sendFile(Packet::Type type, const QByteArray &prefix,
+                          int handle, qint64 offset, qint64 length)
+{
+    if (mTransport) {
+        mTransport->sendFile(type, prefix, handle, offset, length);
+    }
+}
+
+bool LanChannel::canReceiveFile() const
+{
+    return mTransport && mTransport->canReceiveFile();
+}
+
+void LanChannel::receiveFile(int handle, qint64 offset)
+{
+    if (mTransport) {
+        mTransport->receiveFile(handle, offset);
+    }
+}
+
+void LanChannel::setMaxPacketSize(qint64 size)
+{
+    mMaxPacketSize = size;
+    if (mTransport) {
+        mTransport->setMaxPacketSize(size);
+    } else {
+        emit maxPacketSizeChanged(mId, size);
+    }
+}
+
+void LanChannel::close()
+{
+    if (mTransport) {
+        mTransport->close();
+        return;
+    }
+    if (!mClosed) {
+        mClosed = true;
+        mPending.clear();
+        emit closeRequested(mId);
+    }
+}
+
+void LanChannel::onLinkPacketReceived(const Packet &packet)
+{
+    if (mClosed) {
+        return;
+    }
+    if (packet.content().size() > mMaxPacketSize) {
+        emit error(tr("packet of %1 bytes exceeds the limit").arg(packet.content().size()));
+        return;
+    }
+
+    // Packets are held while paused - the peer stops sending once the window
+    // is used up since no credit is returned for them
+    if (mReadPaused || !mPending.isEmpty()) {
+        mPending.enqueue(packet);
+        return;
+    }
+    deliver(packet);
+}
+
+void LanChannel::onLinkPacketsWritten(qint64 bytes)
+{
+    mBytesToWrite -= bytes;
+    emit packetSent();
+}
+
+void LanChannel::onLinkFallback()
+{
+    if (mClosed) {
+        return;
+    }
+
+    mTransport = mPeer.createTransport();
+    mTransport->setParent(this);
+    mTransport->setMaxPacketSize(mMaxPacketSize);
+    mTransport->setReadPaused(mReadPaused);
+
+    connect(mTransport, &Transport::connected, this, &Transport::connected);
+    connect(mTransport, &Transport::packetReceived, this, &Transport::packetReceived);
+    connect(mTransport, &Transport::fileReceived, this, &Transport::fileReceived);
+    connect(mTransport, &Transport::packetSent, this, &Transport::packetSent);
+    connect(mTransport, &Transport::error, this, &Transport::error);
+}
+
+void LanChannel::deliverPending()
+{
+    while (!mReadPaused && !mClosed && !mPending.isEmpty()) {
+        deliver(mPending.dequeue());
+    }
+}
+
+void LanChannel::deliver(const Packet &packet)
+{
+    emit packetReceived(packet);
+
+    // Credit is returned in larger amounts to limit the number of updates
+    mBytesConsumed += packet.content().size();
+    if (mBytesConsumed >= Window / 4) {
+        emit creditReturned(mId, mBytesConsumed);
+        mBytesConsumed = 0;
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LANCHANNEL_H
+#define LANCHANNEL_H
+
+#include <QQueue>
+
+#include <nitroshare/transport.h>
+
+#include "lantransport.h"
+
+/**
+ * @brief Logical stream carried over a connection shared with other transfers
+ *
+ * Packets are passed to and from the LanMultiplexer that owns the connection
+ * by way of queued signals, since the channel moves to the thread of the
+ * transfer using it. Each channel may only have a limited amount of data in
+ * flight before the peer consumes it, so a paused or slow transfer does not
+ * hold back the others sharing the connection.
+ *
+ * If the peer turns out not to support shared connections, the channel opens
+ * a connection of its own and passes everything through to it.
+ */
+class LanChannel : public Transport
+{
+    Q_OBJECT
+
+public:
+
+    /// Amount of data that may be sent before the peer consumes it
+    static const qint64 Window;
+
+    LanChannel(quint32 id, const LanPeer &peer);
+
+    virtual void sendPacket(const Packet &packet);
+    virtual qint64 bytesToWrite() const;
+    virtual void setReadPaused(bool paused);
+    virtual bool canSendFile() const;
+    virtual void sendFile(Packet::Type type, const QByteArray &prefix,
+                          int handle, qint64 offset, qint64 length);
+    virtual bool canReceiveFile() const;
+    virtual void receiveFile(int handle, qint64 offset);
+    virtual void setMaxPacketSize(qint64 size);
+    virtual void close();
+
+signals:
+
+    void packetQueued(quint32 id, const Packet &packet);
+    void creditReturned(quint32 id, qint64 bytes);
+    void maxPacketSizeChanged(quint32 id, qint64 size);
+    void closeRequested(quint32 id);
+
+public slots:
+
+    void onLinkPacketReceived(const Packet &packet);
+    void onLinkPacketsWritten(qint64 bytes);
+    void onLinkFallback();
+
+private slots:
+
+    void deliverPending();
+
+private:
+
+    void deliver(const Packet &packet);
+
+    quint32 mId;
+    LanPeer mPeer;
+    LanTransport *mTransport;
+
+    bool mReadPaused;
+    QQueue<Packet> mPending;
+    qint64 mBytesToWrite;
+    qint64 mBytesConsumed;
+    qint64 mMaxPacketSize;
+    bool mClosed;
+};
+
+#endif // LANCHANNEL_H
@@ -0,0 +1,465 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtEndian>
+
+#include "lanchannel.h"
+#include "lanmultiplexer.h"
+
+const int LanMultiplexer::PacketType = 0x80;
+const QString LanMultiplexer::Feature = "multiplex";
+
+// Size of the channel ID and packet type that precede the content
+const int FrameHeaderSize = 5;
+
+// Size of the channel ID and value in control messages
+const int ControlSize = 12;
+
+// Amount of data handed to the connection at a time - once it has been
+// written, the channels with packets waiting take turns to add more
+const qint64 WriteBufferSize = 262144;
+
+// Time to wait for the peer to accept the connection - older peers treat
+// the hello as an empty transfer and never reply to it
+const int NegotiationTimeout = 2000;
+
+// Time between pings while the connection is idle - the peer must respond
+// to each before the next one is due
+const int PingInterval = 15000;
+
+LanChannelLink::LanChannelLink(QObject *parent)
+    : QObject(parent)
+{
+}
+
+LanMultiplexer::LanMultiplexer(const LanPeer &peer, const QString &deviceName,
+                               int idleTimeout, QObject *parent)
+    : QObject(parent)
+    , mConnection(peer.createTransport())
+    , mPeer(peer)
+    , mDeviceName(deviceName)
+    , mState(Negotiating)
+    , mDialed(true)
+    , mChannelThread(QThread::currentThread())
+    , mNextId(1)
+    , mLastId(0)
+    , mMaxPacketSize(0)
+    , mNegotiationTimer(this)
+    , mIdleTimer(this)
+    , mPingTimer(this)
+    , mPingPending(false)
+{
+    mIdleTimer.setInterval(idleTimeout);
+    init();
+}
+
+LanMultiplexer::LanMultiplexer(LanTransport *connection, QObject *parent)
+    : QObject(parent)
+    , mConnection(connection)
+    , mState(Negotiating)
+    , mDialed(false)
+    , mChannelThread(QThread::currentThread())
+    , mNextId(1)
+    , mLastId(0)
+    , mMaxPacketSize(0)
+    , mNegotiationTimer(this)
+    , mIdleTimer(this)
+    , mPingTimer(this)
+    , mPingPending(false)
+{
+    init();
+}
+
+LanChannel *LanMultiplexer::openChannel()
+{
+    if (mState == Closed) {
+        return nullptr;
+    }
+    if (mState == Established && mChannels.isEmpty()) {
+        emit reused();
+    }
+
+    quint32 id = mNextId++;
+    LanChannel *channel = addChannel(id);
+
+    mIdleTimer.stop();
+    mPingTimer.stop();
+    mPingPending = false;
+
+    // The link is connected to the channel with a queued connection, so the
+    // transfer has a chance to connect to the channel first
+    if (mState == Established) {
+        sendControl(Open, id);
+        emit mChannels[id].link->connected();
+    }
+    return channel;
+}
+
+void LanMultiplexer::setPingInterval(int msecs)
+{
+    mPingTimer.setInterval(msecs);
+}
+
+void LanMultiplexer::onConnected()
+{
+    // The hello doubles as an empty transfer header for older peers
+    QJsonObject object{
+        { "name", mDeviceName },
+        { "size", QString::number(0) },
+        { "count", QString::number(0) }
+    };
+    mConnection->sendPacket(Packet(static_cast<Packet::Type>(PacketType),
+        QJsonDocument(object).toJson(QJsonDocument::Compact)));
+
+    mNegotiationTimer.start();
+}
+
+void LanMultiplexer::onPacketReceived(const Packet &packet)
+{
+    if (mState == Closed) {
+        return;
+    }
+
+    const QByteArray &content = packet.content();
+    bool isFrame = packet.type() == PacketType && content.size() >= FrameHeaderSize;
+    quint32 id = isFrame ? qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(content.constData())) : 0;
+    quint8 type = isFrame ? static_cast<quint8>(content.at(FrameHeaderSize - 1)) : 0;
+
+    if (mState == Negotiating) {
+
+        // The first packet from the connecting side is the hello
+        if (!mDialed) {
+            mState = Established;
+            sendControl(Accept, 0);
+            return;
+        }
+
+        // Anything other than an acceptance means the peer is older
+        mNegotiationTimer.stop();
+        if (!isFrame || id || type != Accept) {
+            fallBack();
+            return;
+        }
+
+        mState = Established;
+        for (auto i = mChannels.begin(); i != mChannels.end(); ++i) {
+            sendControl(Open, i.key());
+            emit i->link->connected();
+        }
+        closeIfIdle();
+        writeFrames();
+        return;
+    }
+
+    if (!isFrame) {
+        onError(tr("invalid packet received"));
+        return;
+    }
+
+    if (!id) {
+        processControl(content);
+        return;
+    }
+
+    // Packets for channels that were already closed here are dropped
+    auto i = mChannels.find(id);
+    if (i != mChannels.end() && !i->closing) {
+        emit i->link->packetReceived(Packet(static_cast<Packet::Type>(type), content.mid(FrameHeaderSize)));
+    }
+}
+
+void LanMultiplexer::onError(const QString &message)
+{
+    if (mState == Closed) {
+        return;
+    }
+    foreach (const Channel &channel, mChannels) {
+        emit channel.link->error(message);
+    }
+    shutdown();
+}
+
+void LanMultiplexer::onNegotiationTimeout()
+{
+    if (mState != Negotiating) {
+        return;
+    }
+
+    // The peer is waiting for the items of the empty transfer - fail it so
+    // that it does not linger there
+    mConnection->sendPacket(Packet(Packet::Error,
+        tr("shared connections are not supported").toUtf8()));
+    fallBack();
+}
+
+void LanMultiplexer::onPacketQueued(quint32 id, const Packet &packet)
+{
+    auto i = mChannels.find(id);
+    if (i == mChannels.end() || i->closing) {
+        return;
+    }
+    i->packets.enqueue(packet);
+    writeFrames();
+}
+
+void LanMultiplexer::onCreditReturned(quint32 id, qint64 bytes)
+{
+    if (mState == Established && mChannels.contains(id)) {
+        sendControl(Credit, id, bytes);
+    }
+}
+
+void LanMultiplexer::onMaxPacketSizeChanged(quint32, qint64 size)
+{
+    // The connection must accept the largest packet of any channel
+    if (size > mMaxPacketSize) {
+        mMaxPacketSize = size;
+        mConnection->setMaxPacketSize(size + FrameHeaderSize);
+    }
+}
+
+void LanMultiplexer::onCloseRequested(quint32 id)
+{
+    auto i = mChannels.find(id);
+    if (i == mChannels.end()) {
+        return;
+    }
+
+    // Packets already queued are sent before the channel is closed, just as
+    // closing a socket sends the data it has buffered
+    if (mState == Established && !i->packets.isEmpty()) {
+        i->closing = true;
+        writeFrames();
+        return;
+    }
+
+    if (mState == Established) {
+        sendControl(Close, id);
+    }
+    removeChannel(id);
+}
+
+void LanMultiplexer::onPingTimeout()
+{
+    // The connection is only reused if the peer answered the last ping
+    if (mPingPending) {
+        mConnection->close();
+        onError(tr("peer stopped responding"));
+        return;
+    }
+    mPingPending = true;
+    sendControl(Ping, 0);
+}
+
+void LanMultiplexer::writeFrames()
+{
+    // Channels take turns and only a little data is handed to the connection
+    // at a time, so a bulk transfer cannot hold back the others
+    while (mState == Established && mConnection->bytesToWrite() < WriteBufferSize) {
+        auto i = mChannels.upperBound(mLastId);
+        int count = 0;
+        for (; count < mChannels.count(); ++count, ++i) {
+            if (i == mChannels.end()) {
+                i = mChannels.begin();
+            }
+            if (!i->packets.isEmpty() && (i->credit > 0 || i->closing)) {
+                break;
+            }
+        }
+        if (count == mChannels.count()) {
+            break;
+        }
+
+        quint32 id = i.key();
+        Packet packet = i->packets.dequeue();
+        sendFrame(id, packet.type(), packet.content());
+        i->credit -= packet.content().size();
+        emit i->link->packetsWritten(packet.content().size());
+        mLastId = id;
+
+        if (i->closing && i->packets.isEmpty()) {
+            sendControl(Close, id);
+            removeChannel(id);
+        }
+    }
+}
+
+void LanMultiplexer::init()
+{
+    // Packets are passed to channels on other threads
+    qRegisterMetaType<Packet>("Packet");
+
+    mConnection->setParent(this);
+
+    connect(mConnection, &Transport::connected, this, &LanMultiplexer::onConnected);
+    connect(mConnection, &Transport::packetReceived, this, &LanMultiplexer::onPacketReceived);
+    connect(mConnection, &Transport::packetSent, this, &LanMultiplexer::writeFrames);
+    connect(mConnection, &Transport::error, this, &LanMultiplexer::onError);
+
+    // The operating system also checks that an idle connection is alive
+    mConnection->setKeepAlive(true);
+
+    mNegotiationTimer.setSingleShot(true);
+    mNegotiationTimer.setInterval(NegotiationTimeout);
+    connect(&mNegotiationTimer, &QTimer::timeout, this, &LanMultiplexer::onNegotiationTimeout);
+
+    mIdleTimer.setSingleShot(true);
+    mPingTimer.setInterval(PingInterval);
+    connect(&mIdleTimer, &QTimer::timeout, this, [this]() {
+        mConnection->close();
+        shutdown();
+    });
+    connect(&mPingTimer, &QTimer::timeout, this, &LanMultiplexer::onPingTimeout);
+}
+
+void LanMultiplexer::fallBack()
+{
+    emit fallback();
+    foreach (const Channel &channel, mChannels) {
+        emit channel.link->fallbackRequested();
+    }
+    mConnection->close();
+    shutdown();
+}
+
+LanChannel *LanMultiplexer::addChannel(quint32 id)
+{
+    LanChannel *channel = new LanChannel(id, mPeer);
+    LanChannelLink *link = new LanChannelLink(this);
+
+    // Transfers take over the channel from the thread that created the
+    // multiplexer
+    channel->moveToThread(mChannelThread);
+
+    connect(link, &LanChannelLink::connected, channel, &Transport::connected, Qt::QueuedConnection);
+    connect(link, &LanChannelLink::packetReceived, channel, &LanChannel::onLinkPacketReceived, Qt::QueuedConnection);
+    connect(link, &LanChannelLink::packetsWritten, channel, &LanChannel::onLinkPacketsWritten, Qt::QueuedConnection);
+    connect(link, &LanChannelLink::error, channel, &Transport::error, Qt::QueuedConnection);
+    connect(link, &LanChannelLink::fallbackRequested, channel, &LanChannel::onLinkFallback, Qt::QueuedConnection);
+
+    connect(channel, &LanChannel::packetQueued, this, &LanMultiplexer::onPacketQueued, Qt::QueuedConnection);
+    connect(channel, &LanChannel::creditReturned, this, &LanMultiplexer::onCreditReturned, Qt::QueuedConnection);
+    connect(channel, &LanChannel::maxPacketSizeChanged, this, &LanMultiplexer::onMaxPacketSizeChanged, Qt::QueuedConnection);
+    connect(channel, &LanChannel::closeRequested, this, &LanMultiplexer::onCloseRequested, Qt::QueuedConnection);
+
+    // Channels destroyed without being closed must not keep the connection
+    // open - this is queued like the other signals so that the packets the
+    // channel sent before it was destroyed are not dropped
+    connect(channel, &QObject::destroyed, this, [this, id]() {
+        onCloseRequested(id);
+    }, Qt::QueuedConnection);
+
+    mChannels.insert(id, { link, QQueue<Packet>(), LanChannel::Window, false });
+    return channel;
+}
+
+void LanMultiplexer::removeChannel(quint32 id)
+{
+    delete mChannels.take(id).link;
+    closeIfIdle();
+}
+
+void LanMultiplexer::processControl(const QByteArray &content)
+{
+    if (content.size() < FrameHeaderSize + ControlSize) {
+        return;
+    }
+    const uchar *data = reinterpret_cast<const uchar*>(content.constData()) + FrameHeaderSize;
+    quint8 control = static_cast<quint8>(content.at(FrameHeaderSize - 1));
+    quint32 id = qFromLittleEndian<quint32>(data);
+    qint64 value = qFromLittleEndian<qint64>(data + sizeof(quint32));
+
+    switch (control) {
+    case Open:
+        if (!mDialed && id && !mChannels.contains(id)) {
+            emit channelReceived(addChannel(id));
+        }
+        break;
+    case Close:
+        if (mChannels.contains(id)) {
+            emit mChannels[id].link->error(tr("channel closed by the peer"));
+            removeChannel(id);
+        }
+        break;
+    case Credit:
+        if (mChannels.contains(id)) {
+            mChannels[id].credit += value;
+            writeFrames();
+        }
+        break;
+    case Ping:
+        sendControl(Pong, 0);
+        break;
+    case Pong:
+        mPingPending = false;
+        break;
+    }
+}
+
+void LanMultiplexer::sendFrame(quint32 id, quint8 type, const QByteArray &content)
+{
+    // The header is passed separately so that the content is not copied
+    QByteArray header(FrameHeaderSize, 0);
+    qToLittleEndian<quint32>(id, reinterpret_cast<uchar*>(header.data()));
+    header[FrameHeaderSize - 1] = static_cast<char>(type);
+    mConnection->sendPacket(static_cast<Packet::Type>(PacketType), header, content);
+}
+
+void LanMultiplexer::sendControl(Control control, quint32 id, qint64 value)
+{
+    QByteArray content(ControlSize, 0);
+    qToLittleEndian<quint32>(id, reinterpret_cast<uchar*>(content.data()));
+    qToLittleEndian<qint64>(value, reinterpret_cast<uchar*>(content.data()) + sizeof(quint32));
+    sendFrame(0, control, content);
+}
+
+void LanMultiplexer::closeIfIdle()
+{
+    // The connecting side keeps the connection for the next transfer unless
+    // idle connections are not kept at all
+    if (mDialed && mState == Established && mChannels.isEmpty()) {
+        if (mIdleTimer.interval() > 0) {
+            mIdleTimer.start();
+            mPingTimer.start();
+        } else {
+            mConnection->close();
+            shutdown();
+        }
+    }
+}
+
+void LanMultiplexer::shutdown()
+{
+    mState = Closed;
+    mNegotiationTimer.stop();
+    mIdleTimer.stop();
+    mPingTimer.stop();
+    foreach (const Channel &channel, mChannels) {
+        delete channel.link;
+    }
+    mChannels.clear();
+    emit finished();
+}
@@ -0,0 +1,223 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LANMULTIPLEXER_H
+#define LANMULTIPLEXER_H
+
+#include <QMap>
+#include <QObject>
+#include <QQueue>
+#include <QThread>
+#include <QTimer>
+
+#include <nitroshare/packet.h>
+
+#include "lanchannel.h"
+#include "lantransport.h"
+
+/**
+ * @brief Relay between a multiplexer and one of its channels
+ *
+ * The channel may live on another thread, so it is only ever reached through
+ * queued connections to these signals, which Qt drops if either end goes
+ * away.
+ */
+class LanChannelLink : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit LanChannelLink(QObject *parent);
+
+signals:
+
+    void connected();
+    void packetReceived(const Packet &packet);
+    void packetsWritten(qint64 bytes);
+    void error(const QString &message);
+    void fallbackRequested();
+};
+
+/**
+ * @brief Connection shared by several transfers to the same device
+ *
+ * Every packet on the connection has a type of its own and its content is
+ * prefixed with the ID of the channel (32-bit) and the type of the packet
+ * being carried (8-bit). Channel 0 carries control messages that open and
+ * close channels and return credit to the sender.
+ *
+ * Shared connections are only opened to peers that have acknowledged the
+ * feature in the header of an earlier transfer. The connecting side first
+ * sends a packet of this type whose content is an empty transfer header.
+ * Peers that support shared connections reply with an acceptance; if
+ * anything else arrives or nothing arrives in time, the peer is assumed to
+ * be older and each channel opens a connection of its own.
+ *
+ * Once the last channel closes, the connecting side keeps the connection
+ * open for a while so that the next transfer to the device can use it
+ * right away. The peer is pinged while the connection is idle and the
+ * connection is dropped if it stops responding.
+ *
+ * The multiplexer may be moved to a thread of its own once it has been
+ * created. Channels are handed out on the thread that created it.
+ */
+class LanMultiplexer : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    /// Type of the packets sent on a shared connection
+    static const int PacketType;
+
+    /// Transfer header feature acknowledged by peers with shared connections
+    static const QString Feature;
+
+    /**
+     * @brief Connect to a peer
+     * @param peer parameters for the connection
+     * @param deviceName name of this device
+     * @param idleTimeout time in milliseconds to keep the idle connection
+     * @param parent QObject
+     */
+    LanMultiplexer(const LanPeer &peer, const QString &deviceName,
+                   int idleTimeout, QObject *parent);
+
+    /**
+     * @brief Take over a connection from a peer
+     * @param connection transport whose first packet has been peeked
+     * @param parent QObject
+     */
+    LanMultiplexer(LanTransport *connection, QObject *parent);
+
+    /**
+     * @brief Open a new channel to the peer
+     * @return pointer to LanChannel or nullptr if the connection was closed
+     *
+     * This must be invoked on the thread that the multiplexer lives on.
+     */
+    Q_INVOKABLE LanChannel *openChannel();
+
+    /**
+     * @brief Set the time between pings while the connection is idle
+     * @param msecs interval in milliseconds
+     */
+    void setPingInterval(int msecs);
+
+signals:
+
+    /**
+     * @brief Indicate that the peer opened a channel
+     * @param channel pointer to LanChannel
+     */
+    void channelReceived(LanChannel *channel);
+
+    /**
+     * @brief Indicate that an idle connection was taken by a new channel
+     */
+    void reused();
+
+    /**
+     * @brief Indicate that the peer does not support shared connections
+     */
+    void fallback();
+
+    /**
+     * @brief Indicate that the connection is no longer usable
+     */
+    void finished();
+
+private slots:
+
+    void onConnected();
+    void onPacketReceived(const Packet &packet);
+    void onError(const QString &message);
+    void onNegotiationTimeout();
+
+    void onPacketQueued(quint32 id, const Packet &packet);
+    void onCreditReturned(quint32 id, qint64 bytes);
+    void onMaxPacketSizeChanged(quint32 id, qint64 size);
+    void onCloseRequested(quint32 id);
+    void onPingTimeout();
+    void writeFrames();
+
+private:
+
+    enum State {
+        Negotiating,
+        Established,
+        Closed
+    };
+
+    enum Control {
+        Accept = 0,
+        Open,
+        Close,
+        Credit,
+        Ping,
+        Pong
+    };
+
+    /*
+     * Packets waiting to be sent on a channel and the amount of data that
+     * may still be sent before the peer returns credit
+     */
+    struct Channel
+    {
+        LanChannelLink *link;
+        QQueue<Packet> packets;
+        qint64 credit;
+        bool closing;
+    };
+
+    void init();
+    void fallBack();
+    LanChannel *addChannel(quint32 id);
+    void removeChannel(quint32 id);
+    void processControl(const QByteArray &content);
+    void sendFrame(quint32 id, quint8 type, const QByteArray &content);
+    void sendControl(Control control, quint32 id, qint64 value = 0);
+    void closeIfIdle();
+    void shutdown();
+
+    LanTransport *mConnection;
+    LanPeer mPeer;
+    QString mDeviceName;
+    State mState;
+    bool mDialed;
+    QThread *mChannelThread;
+
+    QMap<quint32, Channel> mChannels;
+    quint32 mNextId;
+    quint32 mLastId;
+    qint64 mMaxPacketSize;
+
+    QTimer mNegotiationTimer;
+    QTimer mIdleTimer;
+    QTimer mPingTimer;
+    bool mPingPending;
+};
+
+#endif // LANMULTIPLEXER_H
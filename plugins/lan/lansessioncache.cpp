@@ -0,0 +1,97 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <QMutexLocker>
+
+#include "lansessioncache.h"
+
+// Maximum number of peers with a cached session
+const int MaxSessions = 64;
+
+LanSessionCache::LanSessionCache(QObject *parent)
+    : QObject(parent)
+    , mFullHandshakes(0)
+    , mResumedHandshakes(0)
+{
+}
+
+QByteArray LanSessionCache::session(const QString &key) const
+{
+    QMutexLocker locker(&mMutex);
+    return mSessions.value(key);
+}
+
+void LanSessionCache::insert(const QString &key, const QByteArray &session)
+{
+    QMutexLocker locker(&mMutex);
+
+    // Evict the peer whose session was stored first to make room
+    if (!mSessions.contains(key)) {
+        if (mKeys.count() >= MaxSessions) {
+            mSessions.remove(mKeys.takeFirst());
+        }
+        mKeys.append(key);
+    }
+    mSessions.insert(key, session);
+}
+
+void LanSessionCache::remove(const QString &key)
+{
+    QMutexLocker locker(&mMutex);
+    mSessions.remove(key);
+    mKeys.removeOne(key);
+}
+
+void LanSessionCache::clear()
+{
+    QMutexLocker locker(&mMutex);
+    mSessions.clear();
+    mKeys.clear();
+}
+
+void LanSessionCache::addHandshake(const QString &key, qint64 msecs, bool resumed)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        if (resumed) {
+            ++mResumedHandshakes;
+        } else {
+            ++mFullHandshakes;
+        }
+    }
+
+    emit handshakeCompleted(key, msecs, resumed);
+}
+
+int LanSessionCache::fullHandshakes() const
+{
+    QMutexLocker locker(&mMutex);
+    return mFullHandshakes;
+}
+
+int LanSessionCache::resumedHandshakes() const
+{
+    QMutexLocker locker(&mMutex);
+    return mResumedHandshakes;
+}
@@ -0,0 +1,115 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef LANSESSIONCACHE_H
+#define LANSESSIONCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+
+/**
+ * @brief TLS sessions negotiated with peers
+ *
+ * Connecting to a peer with the session from an earlier connection lets the
+ * handshake skip the public-key operations. Transports may live on any
+ * thread, so access to the cache is synchronized.
+ *
+ * The cache also keeps count of handshakes and the time they took.
+ */
+class LanSessionCache : public QObject
+{
+    Q_OBJECT
+
+public:
+
+    explicit LanSessionCache(QObject *parent = nullptr);
+
+    /**
+     * @brief Retrieve the session for a peer
+     * @param key peer identifier
+     * @return serialized session or an empty array if none is cached
+     */
+    QByteArray session(const QString &key) const;
+
+    /**
+     * @brief Store the session for a peer
+     * @param key peer identifier
+     * @param session serialized session
+     */
+    void insert(const QString &key, const QByteArray &session);
+
+    /**
+     * @brief Remove the session for a peer
+     * @param key peer identifier
+     */
+    void remove(const QString &key);
+
+    /**
+     * @brief Remove all sessions
+     */
+    void clear();
+
+    /**
+     * @brief Record a completed handshake
+     * @param key peer identifier or an empty string for incoming connections
+     * @param msecs duration of the handshake in milliseconds
+     * @param resumed true if the peer accepted the cached session
+     */
+    void addHandshake(const QString &key, qint64 msecs, bool resumed);
+
+    /**
+     * @brief Retrieve the number of full handshakes completed
+     */
+    int fullHandshakes() const;
+
+    /**
+     * @brief Retrieve the number of handshakes that resumed a cached session
+     */
+    int resumedHandshakes() const;
+
+signals:
+
+    /**
+     * @brief Indicate that a handshake was completed
+     * @param key peer identifier or an empty string for incoming connections
+     * @param msecs duration of the handshake in milliseconds
+     * @param resumed true if the peer accepted the cached session
+     */
+    void handshakeCompleted(const QString &key, qint64 msecs, bool resumed);
+
+private:
+
+    mutable QMutex mMutex;
+
+    QHash<QString, QByteArray> mSessions;
+    QStringList mKeys;
+
+    int mFullHandshakes;
+    int mResumedHandshakes;
+};
+
+#endif // LANSESSIONCACHE_H
@@ -24,12 +24,73 @@
 
 #include <cstring>
 
+#include <QMetaObject>
 #include <QtEndian>
 
+#if defined(Q_OS_LINUX)
+#  include <cerrno>
+#  include <csignal>
+#  include <ctime>
+#  include <fcntl.h>
+#  include <pthread.h>
+#  include <sys/sendfile.h>
+#  include <sys/socket.h>
+#  include <sys/uio.h>
+#  include <unistd.h>
+#endif
+
 #include <nitroshare/packet.h>
+#include <nitroshare/transportserverregistry.h>
 
+#include "lansessioncache.h"
 #include "lantransport.h"
 
+// Amount of data buffered by the socket while reading is paused
+const qint64 PausedReadBufferSize = 65536;
+
+// Amount of data buffered by the socket while content is written directly to
+// a file - anything beyond this is left with the kernel so it can be spliced
+const qint64 ReceiveFileReadBufferSize = 16384;
+
+// Capacity requested for the pipe used to splice data into files
+const int PipeSize = 1048576;
+
+// Largest packet accepted before a transfer sets its own limit
+const qint64 DefaultMaxPacketSize = 16777216;
+
+#if defined(Q_OS_LINUX)
+
+// Unlike send(), sendfile() has no way to suppress SIGPIPE if the peer
+// disconnects, so the signal is blocked on this thread during the call and
+// any SIGPIPE it raised is discarded before it is unblocked
+static ssize_t sendFileNoSignal(int socket, int handle, off_t *offset, size_t length)
+{
+    sigset_t pipeSet;
+    sigset_t oldSet;
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+
+    // A SIGPIPE that was already pending belongs to someone else
+    sigset_t pending;
+    sigpending(&pending);
+    bool wasPending = sigismember(&pending, SIGPIPE);
+
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+    ssize_t result = sendfile(socket, handle, offset, length);
+    int sendError = errno;
+    if (result == -1 && sendError == EPIPE && !wasPending) {
+        timespec timeout = { 0, 0 };
+        while (sigtimedwait(&pipeSet, nullptr, &timeout) == -1 && errno == EINTR) {
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSet, nullptr);
+
+    errno = sendError;
+    return result;
+}
+
+#endif
+
 LanTransport::LanTransport(
     const QHostAddress &address
   , quint16 port
@@ -62,30 +123,251 @@ LanTransport::LanTransport(
 
 #ifdef ENABLE_TLS
     if (mSslSocket) {
+        mHandshakeTimer.start();
         mSslSocket->startServerEncryption();
     }
 #endif
 }
 
-void LanTransport::sendPacket(Packet *packet)
+LanTransport::~LanTransport()
+{
+    clearSegments();
+    releasePacket();
+
+#if defined(Q_OS_LINUX)
+    if (mPipe[0] != -1) {
+        ::close(mPipe[0]);
+        ::close(mPipe[1]);
+    }
+#endif
+}
+
+void LanTransport::setReceiveLimits(TransportServerRegistry *registry, qint64 readBufferSize)
+{
+    mRegistry = registry;
+    mReadBufferSize = readBufferSize;
+    updateReadBufferSize();
+
+    // Memory may be released by a transport on another thread
+    connect(mRegistry, &TransportServerRegistry::receiveMemoryReleased,
+            this, &LanTransport::onReceiveMemoryReleased, Qt::QueuedConnection);
+}
+
+void LanTransport::peekPacket()
+{
+    mPeeking = true;
+}
+
+void LanTransport::setKeepAlive(bool enabled)
+{
+    mSocket->setSocketOption(QAbstractSocket::KeepAliveOption, enabled ? 1 : 0);
+}
+
+void LanTransport::setFeatures(const QStringList &features)
+{
+    mFeatures = features;
+}
+
+#ifdef ENABLE_TLS
+
+void LanTransport::setSessionCache(LanSessionCache *cache, const QString &key)
+{
+    mSessionCache = cache;
+    mSessionKey = key;
+}
+
+#endif
+
+void LanTransport::sendPacket(const Packet &packet)
+{
+    sendPacket(packet.type(), QByteArray(), packet.content());
+}
+
+void LanTransport::sendPacket(Packet::Type type, const QByteArray &prefix, const QByteArray &content)
+{
+    // Build the header of the packet - its length and type
+    char header[PacketFramer::HeaderSize];
+    qToLittleEndian<qint32>(prefix.size() + content.size() + 1, reinterpret_cast<uchar*>(header));
+    header[PacketFramer::HeaderSize - 1] = static_cast<char>(type);
+
+    // Packets must not overtake file data still waiting to be sent
+    if (!mSegments.isEmpty()) {
+        QByteArray data(header, PacketFramer::HeaderSize);
+        data.append(prefix);
+        data.append(content);
+        mSegments.enqueue({ data, -1, 0, data.size() });
+        mSegmentBytes += data.size();
+        return;
+    }
+
+    const char *pieces[] = { header, prefix.constData(), content.constData() };
+    const int sizes[] = { PacketFramer::HeaderSize, prefix.size(), content.size() };
+    const int numPieces = sizeof(sizes) / sizeof(sizes[0]);
+    qint64 written = 0;
+
+#if defined(Q_OS_LINUX)
+    // If nothing is waiting to be written, the pieces of the packet are
+    // written to the socket together with a single call and only what the
+    // socket could not take is buffered
+    if (canSendFile() && !mSocket->bytesToWrite()) {
+        iovec vectors[numPieces];
+        int count = 0;
+        for (int i = 0; i < numPieces; ++i) {
+            if (sizes[i]) {
+                vectors[count++] = { const_cast<char*>(pieces[i]), static_cast<size_t>(sizes[i]) };
+            }
+        }
+        msghdr message = {};
+        message.msg_iov = vectors;
+        message.msg_iovlen = count;
+        ssize_t result;
+        do {
+            result = sendmsg(mSocket->socketDescriptor(), &message, MSG_NOSIGNAL);
+        } while (result == -1 && errno == EINTR);
+
+        // Errors are left for the socket to report when it writes the rest
+        if (result > 0) {
+            written = result;
+        }
+    }
+#endif
+
+    for (int i = 0; i < numPieces; ++i) {
+        int skipped = static_cast<int>(qMin<qint64>(written, sizes[i]));
+        written -= skipped;
+        if (skipped < sizes[i]) {
+            mSocket->write(pieces[i] + skipped, sizes[i] - skipped);
+        }
+    }
+}
+
+qint64 LanTransport::bytesToWrite() const
+{
+#ifdef ENABLE_TLS
+    // Data waiting to be encrypted is still in flight as far as the transfer
+    // is concerned, so include it in the total
+    if (mSslSocket) {
+        return mSslSocket->bytesToWrite() + mSslSocket->encryptedBytesToWrite();
+    }
+#endif
+    return mSocket->bytesToWrite() + mSegmentBytes;
+}
+
+void LanTransport::setReadPaused(bool paused)
 {
-    // Build the parts of the packet
-    QByteArray content = packet->content();
-    qint32 packetSize = qToLittleEndian(content.size() + 1);
-    qint8 packetType = packet->type();
+    mReadPaused = paused;
+    updateReadBufferSize();
 
-    // Send the length and type of the packet
-    mSocket->write(reinterpret_cast<const char*>(&packetSize), sizeof(packetSize));
-    mSocket->write(reinterpret_cast<const char*>(&packetType), sizeof(packetType));
+    // Process anything that arrived while paused (the call may come from
+    // a slot connected to packetReceived, so it is queued)
+    if (!paused) {
+        QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+    }
+}
 
-    // If the packet includes content, send it too
-    if (content.length()) {
-        mSocket->write(content);
+bool LanTransport::canSendFile() const
+{
+#if defined(Q_OS_LINUX)
+#  ifdef ENABLE_TLS
+    // Encrypted data must pass through the TLS library
+    if (mSslSocket) {
+        return false;
     }
+#  endif
+    return mSocket->state() == QAbstractSocket::ConnectedState;
+#else
+    return false;
+#endif
+}
+
+void LanTransport::sendFile(Packet::Type type, const QByteArray &prefix,
+                            int handle, qint64 offset, qint64 length)
+{
+#if defined(Q_OS_LINUX)
+    // The item may be closed before the data is sent, so keep a descriptor
+    // of its own for the file
+    int descriptor = dup(handle);
+    if (descriptor == -1) {
+        emit error(QString::fromLocal8Bit(strerror(errno)));
+        return;
+    }
+
+    // The packet header is written from memory and is followed by the file
+    // data, which the kernel copies from the page cache to the socket
+    QByteArray header(PacketFramer::HeaderSize, 0);
+    qToLittleEndian<qint32>(static_cast<qint32>(prefix.size() + length + 1),
+                            reinterpret_cast<uchar*>(header.data()));
+    header[PacketFramer::HeaderSize - 1] = static_cast<char>(type);
+    header.append(prefix);
+
+    mSegments.enqueue({ header, -1, 0, header.size() });
+    mSegments.enqueue({ QByteArray(), descriptor, offset, length });
+    mSegmentBytes += header.size() + length;
+
+    if (!mWriteNotifier) {
+        mWriteNotifier = new QSocketNotifier(mSocket->socketDescriptor(), QSocketNotifier::Write, this);
+        mWriteNotifier->setEnabled(false);
+        connect(mWriteNotifier, &QSocketNotifier::activated, this, &LanTransport::writeSegments);
+    }
+
+    writeSegments();
+#else
+    Q_UNUSED(type)
+    Q_UNUSED(prefix)
+    Q_UNUSED(handle)
+    Q_UNUSED(offset)
+    Q_UNUSED(length)
+#endif
+}
+
+bool LanTransport::canReceiveFile() const
+{
+    // The same conditions apply as for sending
+    return canSendFile();
+}
+
+void LanTransport::receiveFile(int handle, qint64 offset)
+{
+#if defined(Q_OS_LINUX)
+    // The pipe is created the first time it is needed; if that fails,
+    // content continues to be received as packets
+    if (handle != -1 && mPipe[0] == -1) {
+        if (pipe2(mPipe, O_CLOEXEC | O_NONBLOCK)) {
+            mPipe[0] = mPipe[1] = -1;
+            return;
+        }
+        fcntl(mPipe[1], F_SETPIPE_SZ, PipeSize);
+    }
+
+    mReceiveHandle = handle;
+    mReceiveOffset = offset;
+    updateReadBufferSize();
+#else
+    Q_UNUSED(handle)
+    Q_UNUSED(offset)
+#endif
+}
+
+void LanTransport::setMaxPacketSize(qint64 size)
+{
+    mMaxPacketSize = size;
+}
+
+QStringList LanTransport::features() const
+{
+    return mFeatures;
+}
+
+void LanTransport::setPeerFeatures(const QStringList &features)
+{
+    emit peerFeaturesReceived(features);
 }
 
 void LanTransport::close()
 {
+    clearSegments();
+    releasePacket();
+    mReceiveHandle = -1;
     mSocket->close();
 }
 
@@ -93,6 +375,18 @@ void LanTransport::onConnected()
 {
 #ifdef ENABLE_TLS
     if (mSslSocket) {
+
+        // Offer the session from the last connection to the peer (if any)
+        if (mSessionCache && !mSessionKey.isEmpty()) {
+            mOfferedSession = mSessionCache->session(mSessionKey);
+            if (!mOfferedSession.isEmpty()) {
+                QSslConfiguration sslConf = mSslSocket->sslConfiguration();
+                sslConf.setSessionTicket(mOfferedSession);
+                mSslSocket->setSslConfiguration(sslConf);
+            }
+        }
+
+        mHandshakeTimer.start();
         mSslSocket->startClientEncryption();
     } else {
 #endif
@@ -104,52 +398,91 @@ void LanTransport::onConnected()
 
 void LanTransport::onReadyRead()
 {
-    mBuffer.append(mSocket->readAll());
+    if (mReadPaused) {
+        return;
+    }
 
-    // Continue to emit packets as they are read
-    while (mBuffer.size()) {
-        if (mBufferSize) {
+    // Continue to emit packets as they are read (until paused)
+    while (!mReadPaused) {
+        readSocket();
 
-            // Only continue if the buffer has the full packet
-            if (mBuffer.size() < mBufferSize) {
+        // Write the content of a binary packet to the file until the kernel
+        // has no more data for it
+        if (mReceiveRemaining) {
+            if (!receiveContent()) {
                 break;
             }
+            continue;
+        }
 
-            // Grab the type and data
-            const char type = mBuffer.at(0);
-            QByteArray data = mBuffer.mid(1, mBufferSize - 1);
-            mBuffer.remove(0, mBufferSize);
+        // Only continue if the buffer has the size and type of the packet
+        if (!mFramer.hasHeader()) {
+            break;
+        }
 
-            // Emit the new packet and reset the size
-            emit packetReceived(new Packet(static_cast<Packet::Type>(type), data));
-            mBufferSize = 0;
+        // A packet size of zero is an error (and impossible)
+        if (!mFramer.isHeaderValid()) {
+            emit error(tr("invalid packet received"));
+            break;
+        }
 
-        } else {
+        // Packets larger than the limit are rejected before any of their
+        // content is buffered
+        if (mFramer.contentSize() > mMaxPacketSize) {
+            emit error(tr("packet of %1 bytes exceeds the limit").arg(mFramer.contentSize()));
+            break;
+        }
 
-            // Only continue if the buffer has enough data for the size
-            if (mBuffer.size() < sizeof(mBufferSize)) {
-                break;
-            }
+        // The packet stays in the buffer until reading resumes
+        if (mPeeking) {
+            mPeeking = false;
+            setReadPaused(true);
+            emit packetPeeked(mFramer.type());
+            break;
+        }
 
-            // memcpy must be used in order to avoid alignment issues
-            memcpy(&mBufferSize, mBuffer.constData(), sizeof(mBufferSize));
-            mBufferSize = qFromLittleEndian(mBufferSize);
-            mBuffer.remove(0, sizeof(mBufferSize));
+        // Binary packets only need their type before the content can be
+        // written to the file
+        if (mReceiveHandle != -1 && mFramer.contentSize() && mFramer.type() == Packet::Binary) {
+            mReceiveRemaining = mReceiveLength = mFramer.contentSize();
+            mFramer.skip(PacketFramer::HeaderSize);
+            continue;
+        }
 
-            // A packet size of zero is an error (and impossible)
-            if (!mBufferSize) {
-                emit error(tr("invalid packet received"));
+        // Memory for the whole packet is reserved before its content is
+        // read; if the budget is exhausted, the data is left with the socket
+        // (and eventually the kernel) until another packet is released
+        if (mRegistry && !mPacketReserved) {
+            qint64 size = PacketFramer::HeaderSize + mFramer.contentSize();
+            mWaitingForMemory = !mRegistry->reserveReceiveMemory(size);
+            if (mWaitingForMemory) {
                 break;
             }
+            mPacketReserved = size;
+            continue;
+        }
+
+        // Only continue if the buffer has the full packet
+        if (!mFramer.hasPacket()) {
+            break;
         }
+
+        // Emit the new packet - it only needs to live for the duration of
+        // the signal
+        emit packetReceived(mFramer.takePacket());
+        releasePacket();
     }
 }
 
 void LanTransport::onBytesWritten()
 {
-    // TODO: packet doesn't necessarily correspond with bytes being written,
-    // so this really should be rewritten to take that into account
+    // Segments wait for the data buffered by the socket to be written first
+    if (!mSegments.isEmpty()) {
+        writeSegments();
+    }
 
+    // The transfer uses bytesToWrite() to determine how much of the send
+    // window is still occupied, so there is no need to track packets here
     emit packetSent();
 }
 
@@ -158,15 +491,250 @@ void LanTransport::onError()
     emit error(mSocket->errorString());
 }
 
+void LanTransport::onReceiveMemoryReleased()
+{
+    if (mWaitingForMemory) {
+        mWaitingForMemory = false;
+        onReadyRead();
+    }
+}
+
+void LanTransport::writeSegments()
+{
+#if defined(Q_OS_LINUX)
+    if (mSocket->bytesToWrite()) {
+        return;
+    }
+
+    // Write directly to the socket until it would block
+    qint64 bytesWritten = 0;
+    while (!mSegments.isEmpty()) {
+        Segment &segment = mSegments.head();
+
+        ssize_t result;
+        if (segment.handle == -1) {
+            result = send(mSocket->socketDescriptor(), segment.data.constData() + segment.offset,
+                          segment.length, MSG_NOSIGNAL);
+        } else {
+            off_t offset = segment.offset;
+            result = sendFileNoSignal(mSocket->socketDescriptor(), segment.handle, &offset, segment.length);
+        }
+
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (result <= 0) {
+            QString message = result ? QString::fromLocal8Bit(strerror(errno)) : tr("file is truncated");
+            clearSegments();
+            emit error(message);
+            return;
+        }
+
+        segment.offset += result;
+        segment.length -= result;
+        mSegmentBytes -= result;
+        bytesWritten += result;
+
+        if (!segment.length) {
+            if (segment.handle != -1) {
+                ::close(segment.handle);
+            }
+            mSegments.dequeue();
+        }
+    }
+
+    // Wait for the socket to become writable again if anything is left
+    mWriteNotifier->setEnabled(!mSegments.isEmpty());
+
+    if (bytesWritten) {
+        emit packetSent();
+    }
+#endif
+}
+
+void LanTransport::readSocket()
+{
+    // With a budget, only the header and then the reserved packet are read
+    // so that the rest stays within the socket's bounded buffer; content
+    // written to a file never passes through the budget
+    qint64 size = mSocket->bytesAvailable();
+    if (mRegistry && !mReceiveRemaining) {
+        qint64 needed = mPacketReserved ? mPacketReserved : PacketFramer::HeaderSize;
+        size = qMin(size, needed - mFramer.available());
+    }
+    if (size > 0) {
+        mFramer.append(mSocket->read(size));
+    }
+}
+
+void LanTransport::releasePacket()
+{
+    if (mPacketReserved) {
+        mRegistry->releaseReceiveMemory(mPacketReserved);
+        mPacketReserved = 0;
+    }
+}
+
+void LanTransport::updateReadBufferSize()
+{
+    // Once the bounded buffer fills, the socket stops reading and the peer
+    // is held back by TCP flow control
+    if (mReadPaused) {
+        mSocket->setReadBufferSize(PausedReadBufferSize);
+    } else if (mReceiveHandle != -1) {
+        mSocket->setReadBufferSize(ReceiveFileReadBufferSize);
+    } else {
+        mSocket->setReadBufferSize(mReadBufferSize);
+    }
+}
+
+bool LanTransport::receiveContent()
+{
+#if defined(Q_OS_LINUX)
+    // Data that the socket already read is written from memory
+    while (mFramer.available()) {
+        ssize_t result = pwrite(mReceiveHandle, mFramer.data(),
+                                qMin<qint64>(mFramer.available(), mReceiveRemaining), mReceiveOffset);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            emit error(QString::fromLocal8Bit(strerror(errno)));
+            return false;
+        }
+        mFramer.skip(static_cast<int>(result));
+        mReceiveOffset += result;
+        mReceiveRemaining -= result;
+        if (!mReceiveRemaining) {
+            break;
+        }
+    }
+
+    // The rest is moved from the socket to the file through the pipe without
+    // being copied to memory
+    while (mReceiveRemaining) {
+        ssize_t result = splice(mSocket->socketDescriptor(), nullptr, mPipe[1], nullptr,
+                                qMin<qint64>(mReceiveRemaining, PipeSize),
+                                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+        if (result == -1) {
+            emit error(QString::fromLocal8Bit(strerror(errno)));
+            return false;
+        }
+
+        // The socket was closed - this is reported by the socket itself
+        if (!result) {
+            return false;
+        }
+
+        while (result) {
+            loff_t offset = mReceiveOffset;
+            ssize_t written = splice(mPipe[0], nullptr, mReceiveHandle, &offset, result, SPLICE_F_MOVE);
+            if (written == -1 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                emit error(QString::fromLocal8Bit(strerror(errno)));
+                return false;
+            }
+            result -= written;
+            mReceiveOffset += written;
+            mReceiveRemaining -= written;
+        }
+    }
+
+    emit fileReceived(mReceiveLength);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void LanTransport::clearSegments()
+{
+#if defined(Q_OS_LINUX)
+    foreach (const Segment &segment, mSegments) {
+        if (segment.handle != -1) {
+            ::close(segment.handle);
+        }
+    }
+#endif
+    mSegments.clear();
+    mSegmentBytes = 0;
+
+    if (mWriteNotifier) {
+        mWriteNotifier->setEnabled(false);
+    }
+}
+
+LanPeer::LanPeer()
+    : port(0)
+#ifdef ENABLE_TLS
+    , sessionCache(nullptr)
+#endif
+    , registry(nullptr)
+    , readBufferSize(0)
+{
+}
+
+LanTransport *LanPeer::createTransport() const
+{
+    LanTransport *transport = new LanTransport(
+        address
+      , port
+#ifdef ENABLE_TLS
+      , sslConf
+#endif
+    );
+    if (registry) {
+        transport->setReceiveLimits(registry, readBufferSize);
+    }
+#ifdef ENABLE_TLS
+    if (sessionCache) {
+        transport->setSessionCache(sessionCache, sessionKey);
+    }
+#endif
+    return transport;
+}
+
 #ifdef ENABLE_TLS
 
 void LanTransport::onEncrypted()
 {
+    if (mSessionCache) {
+
+        // The session is only the one that was offered if the peer accepted
+        // it; either way, keep it so that the next connection can resume it
+        QByteArray session;
+        if (!mSessionKey.isEmpty()) {
+            session = mSslSocket->sslConfiguration().sessionTicket();
+            if (!session.isEmpty()) {
+                mSessionCache->insert(mSessionKey, session);
+            }
+        }
+
+        bool resumed = !mOfferedSession.isEmpty() && session == mOfferedSession;
+        mSessionCache->addHandshake(mSessionKey, mHandshakeTimer.elapsed(), resumed);
+    }
+
     emit connected();
 }
 
 void LanTransport::onSslErrors()
 {
+    // A session that fails the handshake must not be offered again
+    if (mSessionCache && !mOfferedSession.isEmpty()) {
+        mSessionCache->remove(mSessionKey);
+    }
+
     // No need to emit more than one error
     emit error(mSslSocket->sslErrors().at(0).errorString());
 }
@@ -181,15 +749,31 @@ LanTransport::LanTransport(
     : mSocket(nullptr)
 #ifdef ENABLE_TLS
     , mSslSocket(nullptr)
+    , mSessionCache(nullptr)
 #endif
-    , mBufferSize(0)
+    , mReadPaused(false)
+    , mPeeking(false)
+    , mRegistry(nullptr)
+    , mReadBufferSize(0)
+    , mMaxPacketSize(DefaultMaxPacketSize)
+    , mPacketReserved(0)
+    , mWaitingForMemory(false)
+    , mSegmentBytes(0)
+    , mWriteNotifier(nullptr)
+    , mReceiveHandle(-1)
+    , mReceiveOffset(0)
+    , mReceiveLength(0)
+    , mReceiveRemaining(0)
 {
+    mPipe[0] = mPipe[1] = -1;
+
 #ifdef ENABLE_TLS
     if (!sslConf.isNull()) {
         mSslSocket = new QSslSocket(this);
         mSslSocket->ignoreSslErrors({ QSslError::HostNameMismatch });
         mSslSocket->setSslConfiguration(sslConf);
 
+        connect(mSslSocket, &QSslSocket::connected, this, &LanTransport::onConnected);
         connect(mSslSocket, &QSslSocket::encrypted, this, &LanTransport::onEncrypted);
         connect(mSslSocket, &QSslSocket::encryptedBytesWritten, this, &LanTransport::onBytesWritten);
         connect(mSslSocket, static_cast<void(QSslSocket::*)(const QList<QSslError> &)>(&QSslSocket::sslErrors), this, &LanTransport::onSslErrors);
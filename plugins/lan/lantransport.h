@@ -27,7 +27,11 @@
 
 #include "config.h"
 
+#include <QElapsedTimer>
 #include <QHostAddress>
+#include <QQueue>
+#include <QSocketNotifier>
+#include <QStringList>
 #include <QTcpSocket>
 
 #ifdef ENABLE_TLS
@@ -37,7 +41,10 @@
 
 #include <nitroshare/transport.h>
 
-class Packet;
+#include "packetframer.h"
+
+class LanSessionCache;
+class TransportServerRegistry;
 
 /**
  * @brief Local network transport
@@ -66,15 +73,93 @@ public:
 #endif
     );
 
-    virtual void sendPacket(Packet *packet);
+    virtual ~LanTransport();
+
+    /**
+     * @brief Limit the memory used for received data
+     * @param registry registry whose budget packets are reserved from
+     * @param readBufferSize maximum amount of data buffered by the socket
+     */
+    void setReceiveLimits(TransportServerRegistry *registry, qint64 readBufferSize);
+
+    /**
+     * @brief Pause reading once the header of the next packet arrives
+     *
+     * packetPeeked() is emitted with the type of the packet; it is not
+     * emitted with packetReceived() until setReadPaused(false) is called.
+     */
+    void peekPacket();
+
+    /**
+     * @brief Enable or disable TCP keep-alive probes on the connection
+     * @param enabled true to send probes while the connection is idle
+     */
+    void setKeepAlive(bool enabled);
+
+    /**
+     * @brief Set the features of the transport
+     * @param features names of the features to request or acknowledge
+     */
+    void setFeatures(const QStringList &features);
+
+#ifdef ENABLE_TLS
+
+    /**
+     * @brief Resume TLS sessions from a cache
+     * @param cache cache to retrieve sessions from and record handshakes in
+     * @param key peer identifier or an empty string for incoming connections
+     *
+     * This must be called before the connection is established.
+     */
+    void setSessionCache(LanSessionCache *cache, const QString &key);
+
+#endif
+
+    /**
+     * @brief Send a packet whose content begins with a prefix
+     * @param type type of the packet
+     * @param prefix data that precedes the content
+     * @param content content of the packet
+     *
+     * This avoids copying the content in order to add the prefix.
+     */
+    void sendPacket(Packet::Type type, const QByteArray &prefix, const QByteArray &content);
+
+    virtual void sendPacket(const Packet &packet);
+    virtual qint64 bytesToWrite() const;
+    virtual void setReadPaused(bool paused);
+    virtual bool canSendFile() const;
+    virtual void sendFile(Packet::Type type, const QByteArray &prefix,
+                          int handle, qint64 offset, qint64 length);
+    virtual bool canReceiveFile() const;
+    virtual void receiveFile(int handle, qint64 offset);
+    virtual void setMaxPacketSize(qint64 size);
+    virtual QStringList features() const;
+    virtual void setPeerFeatures(const QStringList &features);
     virtual void close();
 
+signals:
+
+    /**
+     * @brief Indicate which features the receiver acknowledged
+     * @param features names of the features
+     */
+    void peerFeaturesReceived(const QStringList &features);
+
+    /**
+     * @brief Indicate the type of the packet that was peeked
+     * @param type type of the packet
+     */
+    void packetPeeked(Packet::Type type);
+
 private slots:
 
     void onConnected();
     void onReadyRead();
     void onBytesWritten();
     void onError();
+    void onReceiveMemoryReleased();
+    void writeSegments();
 
 #ifdef ENABLE_TLS
     void onEncrypted();
@@ -89,13 +174,83 @@ private:
 #endif
     );
 
+    /*
+     * Data written directly to the socket - either bytes from memory or a
+     * range of a file (when handle is not -1)
+     */
+    struct Segment
+    {
+        QByteArray data;
+        int handle;
+        qint64 offset;
+        qint64 length;
+    };
+
+    void clearSegments();
+    void readSocket();
+    void releasePacket();
+    void updateReadBufferSize();
+    bool receiveContent();
+
     QTcpSocket *mSocket;
 #ifdef ENABLE_TLS
     QSslSocket *mSslSocket;
+
+    LanSessionCache *mSessionCache;
+    QString mSessionKey;
+    QElapsedTimer mHandshakeTimer;
+    QByteArray mOfferedSession;
+#endif
+
+    QStringList mFeatures;
+
+    PacketFramer mFramer;
+    bool mReadPaused;
+    bool mPeeking;
+
+    TransportServerRegistry *mRegistry;
+    qint64 mReadBufferSize;
+    qint64 mMaxPacketSize;
+    qint64 mPacketReserved;
+    bool mWaitingForMemory;
+
+    QQueue<Segment> mSegments;
+    qint64 mSegmentBytes;
+    QSocketNotifier *mWriteNotifier;
+
+    int mReceiveHandle;
+    qint64 mReceiveOffset;
+    qint64 mReceiveLength;
+    qint64 mReceiveRemaining;
+    int mPipe[2];
+};
+
+/**
+ * @brief Parameters for connecting to a peer
+ *
+ * This allows connections to the same peer to be opened later (and from
+ * other threads) without referring back to the transport server.
+ */
+struct LanPeer
+{
+    LanPeer();
+
+    /**
+     * @brief Create a transport connected to the peer
+     * @return pointer to LanTransport
+     */
+    LanTransport *createTransport() const;
+
+    QHostAddress address;
+    quint16 port;
+#ifdef ENABLE_TLS
+    QSslConfiguration sslConf;
+    LanSessionCache *sessionCache;
+    QString sessionKey;
 #endif
 
-    QByteArray mBuffer;
-    qint32 mBufferSize;
+    TransportServerRegistry *registry;
+    qint64 readBufferSize;
 };
 
 #endif // LANTRANSPORT_H
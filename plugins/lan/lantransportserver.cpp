@@ -25,25 +25,29 @@
 #include "config.h"
 
 #include <QHostAddress>
+#include <QMetaObject>
 
 #ifdef ENABLE_TLS
 #  include <QFile>
 #endif
 
 #include <nitroshare/application.h>
-#include <nitroshare/category.h>
 #include <nitroshare/device.h>
 #include <nitroshare/logger.h>
 #include <nitroshare/message.h>
 #include <nitroshare/settingsregistry.h>
+#include <nitroshare/transportserverregistry.h>
 
+#include "lanchannel.h"
+#include "lanmultiplexer.h"
 #include "lantransport.h"
 #include "lantransportserver.h"
 
 const QString MessageTag = "lantransportserver";
 
-const QString TransferCategory = "transfer";
 const QString TransferPort = "TransferPort";
+const QString TransferMultiplex = "TransferMultiplex";
+const QString TransferIdleTimeout = "TransferIdleTimeout";
 #ifdef ENABLE_TLS
 const QString TlsEnabled = "TlsEnabled";
 const QString TlsCaCertificate = "TlsCaCertificate";
@@ -54,55 +58,73 @@ const QString TlsPrivateKeyPassphrase = "TlsPrivateKeyPassphrase";
 
 LanTransportServer::LanTransportServer(Application *application)
     : mApplication(application)
-    , mTransferCategory({
-          { Category::NameKey, TransferCategory },
-          { Category::TitleKey, tr("Transfer") }
-      })
     , mTransferPort({
           { Setting::TypeKey, Setting::Integer },
           { Setting::NameKey, TransferPort },
           { Setting::TitleKey, tr("Transfer Port") },
-          { Setting::CategoryKey, TransferCategory },
+          { Setting::CategoryKey, Application::TransferCategoryName },
           { Setting::DefaultValueKey, 40818 }
       })
+    , mTransferMultiplex({
+          { Setting::TypeKey, Setting::Boolean },
+          { Setting::NameKey, TransferMultiplex },
+          { Setting::TitleKey, tr("Share one connection between transfers to a device") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, true }
+      })
+    , mTransferIdleTimeout({
+          { Setting::TypeKey, Setting::Integer },
+          { Setting::NameKey, TransferIdleTimeout },
+          { Setting::TitleKey, tr("Idle Connection Timeout") },
+          { Setting::CategoryKey, Application::TransferCategoryName },
+          { Setting::DefaultValueKey, 60000 }
+      })
 #ifdef ENABLE_TLS
     , mTlsEnabled({
           { Setting::TypeKey, Setting::Boolean },
           { Setting::NameKey, TlsEnabled },
           { Setting::TitleKey, tr("Enable TLS") },
-          { Setting::CategoryKey, TransferCategory }
+          { Setting::CategoryKey, Application::TransferCategoryName }
       })
     , mTlsCaCertificate({
           { Setting::TypeKey, Setting::FilePath },
           { Setting::NameKey, TlsCaCertificate },
           { Setting::TitleKey, tr("CA certificate") },
-          { Setting::CategoryKey, TransferCategory }
+          { Setting::CategoryKey, Application::TransferCategoryName }
       })
     , mTlsCertificate({
           { Setting::TypeKey, Setting::FilePath },
           { Setting::NameKey, TlsCertificate },
           { Setting::TitleKey, tr("Certificate") },
-          { Setting::CategoryKey, TransferCategory }
+          { Setting::CategoryKey, Application::TransferCategoryName }
       })
     , mTlsPrivateKey({
           { Setting::TypeKey, Setting::FilePath },
           { Setting::NameKey, TlsPrivateKey },
           { Setting::TitleKey, tr("Private key") },
-          { Setting::CategoryKey, TransferCategory }
+          { Setting::CategoryKey, Application::TransferCategoryName }
       })
     , mTlsPrivateKeyPassphrase({
           { Setting::TypeKey, Setting::String },
           { Setting::NameKey, TlsPrivateKeyPassphrase },
           { Setting::TitleKey, tr("Private key passphrase") },
-          { Setting::CategoryKey, TransferCategory }
+          { Setting::CategoryKey, Application::TransferCategoryName }
       })
 #endif
 {
     connect(&mServer, &Server::newSocketDescriptor, this, &LanTransportServer::onNewSocketDescriptor);
     connect(mApplication->settingsRegistry(), &SettingsRegistry::settingsChanged, this, &LanTransportServer::onSettingsChanged);
+#ifdef ENABLE_TLS
+    connect(&mSessionCache, &LanSessionCache::handshakeCompleted, this, &LanTransportServer::onHandshakeCompleted);
+#endif
+
+    // Shared connections are serviced on a thread of their own so that the
+    // main thread does not handle every packet sent by the transfers
+    mConnectionThread.start();
 
-    mApplication->settingsRegistry()->addCategory(&mTransferCategory);
     mApplication->settingsRegistry()->addSetting(&mTransferPort);
+    mApplication->settingsRegistry()->addSetting(&mTransferMultiplex);
+    mApplication->settingsRegistry()->addSetting(&mTransferIdleTimeout);
 #ifdef ENABLE_TLS
     mApplication->settingsRegistry()->addSetting(&mTlsEnabled);
     mApplication->settingsRegistry()->addSetting(&mTlsCaCertificate);
@@ -122,7 +144,13 @@ LanTransportServer::LanTransportServer(Application *application)
 
 LanTransportServer::~LanTransportServer()
 {
+    // Shared connections still open are freed as the thread finishes
+    mConnectionThread.quit();
+    mConnectionThread.wait();
+
     mApplication->settingsRegistry()->removeSetting(&mTransferPort);
+    mApplication->settingsRegistry()->removeSetting(&mTransferMultiplex);
+    mApplication->settingsRegistry()->removeSetting(&mTransferIdleTimeout);
 #ifdef ENABLE_TLS
     mApplication->settingsRegistry()->removeSetting(&mTlsEnabled);
     mApplication->settingsRegistry()->removeSetting(&mTlsCaCertificate);
@@ -130,7 +158,6 @@ LanTransportServer::~LanTransportServer()
     mApplication->settingsRegistry()->removeSetting(&mTlsPrivateKey);
     mApplication->settingsRegistry()->removeSetting(&mTlsPrivateKeyPassphrase);
 #endif
-    mApplication->settingsRegistry()->removeCategory(&mTransferCategory);
 }
 
 QString LanTransportServer::name() const
@@ -139,6 +166,83 @@ QString LanTransportServer::name() const
 }
 
 Transport *LanTransportServer::createTransport(Device *device)
+{
+    return openTransport(device, mApplication->settingsRegistry()->value(TransferMultiplex).toBool());
+}
+
+Transport *LanTransportServer::createDedicatedTransport(Device *device)
+{
+    return openTransport(device, false);
+}
+
+void LanTransportServer::onNewSocketDescriptor(qintptr socketDescriptor)
+{
+    mApplication->logger()->log(new Message(
+        Message::Debug,
+        MessageTag,
+        "socket descriptor for incoming connection received"
+    ));
+
+    LanTransport *transport = applyReceiveLimits(new LanTransport(
+        socketDescriptor
+#ifdef ENABLE_TLS
+      , mSslConf
+#endif
+    ));
+#ifdef ENABLE_TLS
+    transport->setSessionCache(&mSessionCache, QString());
+#endif
+
+    // Shared connections begin with a packet of their own type, so the type
+    // of the first packet decides what the connection is handed to
+    transport->setParent(this);
+    connect(transport, &LanTransport::packetPeeked, this, &LanTransportServer::onPacketPeeked);
+    connect(transport, &Transport::error, transport, &QObject::deleteLater);
+    transport->peekPacket();
+}
+
+void LanTransportServer::onPacketPeeked(Packet::Type type)
+{
+    LanTransport *transport = qobject_cast<LanTransport*>(sender());
+    disconnect(transport, &LanTransport::packetPeeked, this, &LanTransportServer::onPacketPeeked);
+    disconnect(transport, &Transport::error, transport, &QObject::deleteLater);
+    transport->setParent(nullptr);
+    transport->setReadPaused(false);
+
+    if (type == LanMultiplexer::PacketType) {
+        LanMultiplexer *multiplexer = new LanMultiplexer(transport, nullptr);
+        connect(multiplexer, &LanMultiplexer::channelReceived, this, [this](LanChannel *channel) {
+            emit transportReceived(channel);
+        });
+        connect(multiplexer, &LanMultiplexer::finished, multiplexer, &QObject::deleteLater);
+        adoptMultiplexer(multiplexer);
+    } else {
+
+        // Let the sender know that shared connections are supported here
+        transport->setFeatures({ LanMultiplexer::Feature });
+        emit transportReceived(transport);
+    }
+}
+
+#ifdef ENABLE_TLS
+
+void LanTransportServer::onHandshakeCompleted(const QString &key, qint64 msecs, bool resumed)
+{
+    mApplication->logger()->log(new Message(
+        Message::Debug,
+        MessageTag,
+        QString("%1 TLS handshake with %2 took %3 ms (%4 full, %5 resumed)")
+            .arg(resumed ? "resumed" : "full")
+            .arg(key.isEmpty() ? "incoming connection" : key)
+            .arg(msecs)
+            .arg(mSessionCache.fullHandshakes())
+            .arg(mSessionCache.resumedHandshakes())
+    ));
+}
+
+#endif
+
+Transport *LanTransportServer::openTransport(Device *device, bool shared)
 {
     QStringList addresses = device->property("addresses").toStringList();
     quint16 port = device->property("port").toInt();
@@ -164,30 +268,128 @@ Transport *LanTransportServer::createTransport(Device *device)
             .arg(port)
     ));
 
-    // Create the transport
-    return new LanTransport(
-        QHostAddress(addresses.at(0))
-      , port
-#ifdef ENABLE_TLS
-      , mSslConf
-#endif
+    LanPeer peer = createPeer(QHostAddress(addresses.at(0)), port);
+    if (!shared) {
+        return peer.createTransport();
+    }
+
+    // Peers known not to support shared connections get one of their own
+    QString key = QString("%1@%2:%3").arg(device->uuid()).arg(addresses.at(0)).arg(port);
+    if (mLegacyPeers.contains(key)) {
+        return peer.createTransport();
+    }
+
+    // Until the peer acknowledges shared connections in a transfer header,
+    // transfers to it ask about them on a connection of their own
+    if (!mMultiplexPeers.contains(key)) {
+        return probeTransport(peer, key);
+    }
+
+    // Transfers to the same device share a connection, which is opened when
+    // the first of them starts and kept for a while after the last finishes
+    // (unless it closes before it can be used again)
+    LanChannel *channel = nullptr;
+    LanMultiplexer *multiplexer = mMultiplexers.value(key);
+    if (multiplexer) {
+        QMetaObject::invokeMethod(multiplexer, "openChannel", Qt::BlockingQueuedConnection,
+                                  Q_RETURN_ARG(LanChannel*, channel));
+    }
+    if (!channel) {
+        multiplexer = createMultiplexer(peer, key);
+        channel = multiplexer->openChannel();
+        adoptMultiplexer(multiplexer);
+    }
+    return channel;
+}
+
+LanTransport *LanTransportServer::probeTransport(const LanPeer &peer, const QString &key)
+{
+    LanTransport *transport = peer.createTransport();
+    transport->setFeatures({ LanMultiplexer::Feature });
+    connect(transport, &LanTransport::peerFeaturesReceived, this, [this, key](const QStringList &features) {
+        bool supported = features.contains(LanMultiplexer::Feature);
+        mApplication->logger()->log(new Message(
+            Message::Info,
+            MessageTag,
+            QString("%1 %2 shared connections")
+                .arg(key)
+                .arg(supported ? "supports" : "does not support")
+        ));
+        if (supported) {
+            mMultiplexPeers.insert(key);
+        } else {
+            mLegacyPeers.insert(key);
+        }
+    });
+    return transport;
+}
+
+LanMultiplexer *LanTransportServer::createMultiplexer(const LanPeer &peer, const QString &key)
+{
+    LanMultiplexer *multiplexer = new LanMultiplexer(
+        peer,
+        mApplication->deviceName(),
+        mApplication->settingsRegistry()->value(TransferIdleTimeout).toInt(),
+        nullptr
     );
+    connect(multiplexer, &LanMultiplexer::fallback, this, [this, key]() {
+        mApplication->logger()->log(new Message(
+            Message::Info,
+            MessageTag,
+            QString("%1 does not support shared connections").arg(key)
+        ));
+        mMultiplexPeers.remove(key);
+        mLegacyPeers.insert(key);
+    });
+    connect(multiplexer, &LanMultiplexer::reused, this, [this, key]() {
+        mApplication->logger()->log(new Message(
+            Message::Debug,
+            MessageTag,
+            QString("reusing idle connection to %1").arg(key)
+        ));
+    });
+
+    // The multiplexer is only freed here so that it cannot be deleted while
+    // a channel is being opened on it
+    connect(multiplexer, &LanMultiplexer::finished, this, [this, key, multiplexer]() {
+        if (mMultiplexers.value(key) == multiplexer) {
+            mMultiplexers.remove(key);
+        }
+        multiplexer->deleteLater();
+    });
+    mMultiplexers.insert(key, multiplexer);
+    return multiplexer;
 }
 
-void LanTransportServer::onNewSocketDescriptor(qintptr socketDescriptor)
+void LanTransportServer::adoptMultiplexer(LanMultiplexer *multiplexer)
 {
-    mApplication->logger()->log(new Message(
-        Message::Debug,
-        MessageTag,
-        "socket descriptor for incoming connection received"
-    ));
+    connect(&mConnectionThread, &QThread::finished, multiplexer, &QObject::deleteLater);
+    multiplexer->moveToThread(&mConnectionThread);
+}
 
-    emit transportReceived(new LanTransport(
-        socketDescriptor
+LanPeer LanTransportServer::createPeer(const QHostAddress &address, quint16 port) const
+{
+    LanPeer peer;
+    peer.address = address;
+    peer.port = port;
 #ifdef ENABLE_TLS
-      , mSslConf
+    peer.sslConf = mSslConf;
+    peer.sessionCache = &mSessionCache;
+    peer.sessionKey = QString("%1:%2").arg(address.toString()).arg(port);
 #endif
-    ));
+    peer.registry = mApplication->transportServerRegistry();
+    peer.readBufferSize = mApplication->settingsRegistry()->value(
+        Application::TransferReadBufferSettingName).toLongLong();
+    return peer;
+}
+
+LanTransport *LanTransportServer::applyReceiveLimits(LanTransport *transport) const
+{
+    transport->setReceiveLimits(
+        mApplication->transportServerRegistry(),
+        mApplication->settingsRegistry()->value(Application::TransferReadBufferSettingName).toLongLong()
+    );
+    return transport;
 }
 
 void LanTransportServer::onSettingsChanged(const QStringList &keys)
@@ -215,6 +417,9 @@ void LanTransportServer::onSettingsChanged(const QStringList &keys)
             // Ensure the peer is verified as well
             mSslConf.setPeerVerifyMode(QSslSocket::VerifyPeer);
 
+            // Keep sessions after the handshake so that they can be resumed
+            mSslConf.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
             // Set the root (CA) certificate
             mSslConf.setCaCertificates({
                 loadCert(mApplication->settingsRegistry()->value(TlsCaCertificate).toString())
@@ -234,6 +439,9 @@ void LanTransportServer::onSettingsChanged(const QStringList &keys)
         } else {
             mSslConf = QSslConfiguration();
         }
+
+        // Sessions negotiated with the old configuration must not be reused
+        mSessionCache.clear();
     }
 #endif
 }
@@ -27,7 +27,10 @@
 
 #include "config.h"
 
+#include <QHash>
+#include <QSet>
 #include <QStringList>
+#include <QThread>
 
 #ifdef ENABLE_TLS
 #  include <QSslCertificate>
@@ -35,13 +38,16 @@
 #  include <QSslKey>
 #endif
 
-#include <nitroshare/category.h>
+#include <nitroshare/packet.h>
 #include <nitroshare/setting.h>
 #include <nitroshare/transportserver.h>
 
+#include "lansessioncache.h"
+#include "lantransport.h"
 #include "server.h"
 
 class Application;
+class LanMultiplexer;
 
 class LanTransportServer : public TransportServer
 {
@@ -54,14 +60,26 @@ public:
 
     virtual QString name() const;
     virtual Transport *createTransport(Device *device);
+    virtual Transport *createDedicatedTransport(Device *device);
 
 private slots:
 
     void onNewSocketDescriptor(qintptr socketDescriptor);
+    void onPacketPeeked(Packet::Type type);
+#ifdef ENABLE_TLS
+    void onHandshakeCompleted(const QString &key, qint64 msecs, bool resumed);
+#endif
     void onSettingsChanged(const QStringList &keys);
 
 private:
 
+    Transport *openTransport(Device *device, bool shared);
+    LanTransport *probeTransport(const LanPeer &peer, const QString &key);
+    LanMultiplexer *createMultiplexer(const LanPeer &peer, const QString &key);
+    void adoptMultiplexer(LanMultiplexer *multiplexer);
+    LanPeer createPeer(const QHostAddress &address, quint16 port) const;
+    LanTransport *applyReceiveLimits(LanTransport *transport) const;
+
 #ifdef ENABLE_TLS
     QSslCertificate loadCert(const QString &filename) const;
     QSslKey loadKey(const QString &filename, const QString &passphrase) const;
@@ -71,12 +89,19 @@ private:
 
     Server mServer;
 
+    QThread mConnectionThread;
+    QHash<QString, LanMultiplexer*> mMultiplexers;
+    QSet<QString> mMultiplexPeers;
+    QSet<QString> mLegacyPeers;
+
 #ifdef ENABLE_TLS
     QSslConfiguration mSslConf;
+    LanSessionCache mSessionCache;
 #endif
 
-    Category mTransferCategory;
     Setting mTransferPort;
+    Setting mTransferMultiplex;
+    Setting mTransferIdleTimeout;
 #ifdef ENABLE_TLS
     Setting mTlsEnabled;
     Setting mTlsCaCertificate;
@@ -0,0 +1,101 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <QtEndian>
+
+#include "packetframer.h"
+
+const int PacketFramer::HeaderSize;
+
+PacketFramer::PacketFramer()
+    : mOffset(0)
+{
+}
+
+void PacketFramer::append(const QByteArray &data)
+{
+    // Drop the consumed data once there is more of it than unread data,
+    // which keeps the cost of moving the unread data proportional to the
+    // amount that was consumed
+    if (mOffset && mOffset >= mBuffer.size() - mOffset) {
+        mBuffer.remove(0, mOffset);
+        mOffset = 0;
+    }
+    mBuffer.append(data);
+}
+
+int PacketFramer::available() const
+{
+    return mBuffer.size() - mOffset;
+}
+
+const char *PacketFramer::data() const
+{
+    return mBuffer.constData() + mOffset;
+}
+
+void PacketFramer::skip(int length)
+{
+    mOffset += length;
+    if (mOffset == mBuffer.size()) {
+        mBuffer.clear();
+        mOffset = 0;
+    }
+}
+
+bool PacketFramer::hasHeader() const
+{
+    return available() >= HeaderSize;
+}
+
+bool PacketFramer::isHeaderValid() const
+{
+    // The size includes the type, so zero is impossible
+    return qFromLittleEndian<qint32>(reinterpret_cast<const uchar*>(data())) > 0;
+}
+
+int PacketFramer::contentSize() const
+{
+    return qFromLittleEndian<qint32>(reinterpret_cast<const uchar*>(data())) - 1;
+}
+
+Packet::Type PacketFramer::type() const
+{
+    return static_cast<Packet::Type>(static_cast<uchar>(data()[HeaderSize - 1]));
+}
+
+bool PacketFramer::hasPacket() const
+{
+    return hasHeader() && available() - HeaderSize >= contentSize();
+}
+
+Packet PacketFramer::takePacket()
+{
+    Packet::Type packetType = type();
+    int size = contentSize();
+    QByteArray content(data() + HeaderSize, size);
+    skip(HeaderSize + size);
+    return Packet(packetType, content);
+}
@@ -0,0 +1,117 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#ifndef PACKETFRAMER_H
+#define PACKETFRAMER_H
+
+#include <QByteArray>
+
+#include <nitroshare/packet.h>
+
+/**
+ * @brief Incremental parser for packets read from a stream
+ *
+ * Each packet is sent as its size (32-bit, including the type), its type
+ * (8-bit), and its content. Data is appended as it arrives and packets are
+ * parsed in place - consumed data is only discarded once it makes up most
+ * of the buffer, so reading many small packets does not move the rest of
+ * the buffer each time.
+ */
+class PacketFramer
+{
+public:
+
+    /// Size of the fields that precede the content of a packet
+    static const int HeaderSize = 5;
+
+    PacketFramer();
+
+    /**
+     * @brief Add data read from the stream
+     * @param data data to add
+     */
+    void append(const QByteArray &data);
+
+    /**
+     * @brief Retrieve the number of unread bytes
+     * @return byte count
+     */
+    int available() const;
+
+    /**
+     * @brief Retrieve a pointer to the unread bytes
+     * @return pointer valid until the next non-const call
+     */
+    const char *data() const;
+
+    /**
+     * @brief Discard unread bytes
+     * @param length number of bytes to discard
+     */
+    void skip(int length);
+
+    /**
+     * @brief Determine if the header of the next packet has arrived
+     * @return true if contentSize() and type() can be used
+     */
+    bool hasHeader() const;
+
+    /**
+     * @brief Determine if the header of the next packet is valid
+     * @return false if the header describes an impossible packet
+     */
+    bool isHeaderValid() const;
+
+    /**
+     * @brief Retrieve the size of the content of the next packet
+     * @return content size in bytes
+     */
+    int contentSize() const;
+
+    /**
+     * @brief Retrieve the type of the next packet
+     * @return packet type
+     */
+    Packet::Type type() const;
+
+    /**
+     * @brief Determine if the entire next packet has arrived
+     * @return true if takePacket() can be used
+     */
+    bool hasPacket() const;
+
+    /**
+     * @brief Remove the next packet from the buffer
+     * @return packet
+     */
+    Packet takePacket();
+
+private:
+
+    QByteArray mBuffer;
+    int mOffset;
+};
+
+#endif // PACKETFRAMER_H
@@ -0,0 +1,64 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 Nathan Osman
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+
+#include <nitroshare/application.h>
+#include <nitroshare/jsonutil.h>
+#include <nitroshare/transfer.h>
+#include <nitroshare/transfermodel.h>
+
+#include "transferstatsaction.h"
+
+TransferStatsAction::TransferStatsAction(Application *application)
+    : mApplication(application)
+{
+}
+
+QString TransferStatsAction::name() const
+{
+    return "transferstats";
+}
+
+QString TransferStatsAction::description() const
+{
+    return tr(
+        "Retrieve statistics for the current transfers. "
+        "This action takes no parameters and returns an array of transfers.\n\n"
+        "Each transfer object consists of the properties present in the "
+        "transfer and a \"stats\" object with the time (in microseconds) and "
+        "data spent reading items, writing items, processing item headers, "
+        "and waiting for the socket buffer to drain."
+    );
+}
+
+QVariant TransferStatsAction::invoke(const QVariantMap &)
+{
+    QVariantList transfers;
+    TransferModel *model = mApplication->transferModel();
+    for (int i = 0; i < model->rowCount(); ++i) {
+        Transfer *transfer = model->data(model->index(i, 0), Qt::UserRole).value<Transfer*>();
+        QJsonObject object = JsonUtil::objectToJson(transfer);
+        object.insert("stats", QJsonObject::fromVariantMap(transfer->stats()));
+        transfers.append(object);
+    }
+    return transfers;
+}
@@ -44,6 +44,7 @@ TransferDialog::TransferDialog(Application *application)
     : mApplication(application),
       mTableView(new QTableView),
       mStopButton(new QPushButton(tr("Stop"))),
+      mPauseButton(new QPushButton(tr("Pause"))),
       mDismissButton(new QPushButton(tr("Dismiss")))
 {
     setWindowTitle(tr("Transfers"));
@@ -64,6 +65,7 @@ TransferDialog::TransferDialog(Application *application)
     connect(mTableView->selectionModel(), &QItemSelectionModel::selectionChanged, this, &TransferDialog::updateButtons);
 
     connect(mStopButton, &QPushButton::clicked, this, &TransferDialog::onStop);
+    connect(mPauseButton, &QPushButton::clicked, this, &TransferDialog::onPause);
     connect(mDismissButton, &QPushButton::clicked, this, &TransferDialog::onDismiss);
 
     QPushButton *dismissAllButton = new QPushButton(tr("Dismiss All"));
@@ -78,6 +80,7 @@ TransferDialog::TransferDialog(Application *application)
 
     QVBoxLayout *vboxLayout = new QVBoxLayout;
     vboxLayout->addWidget(mStopButton);
+    vboxLayout->addWidget(mPauseButton);
     vboxLayout->addWidget(mDismissButton);
     vboxLayout->addWidget(dismissAllButton);
     vboxLayout->addWidget(frame);
@@ -117,6 +120,8 @@ void TransferDialog::updateButtons()
     }
 
     mStopButton->setEnabled(transfer && !transfer->isFinished());
+    mPauseButton->setEnabled(transfer && !transfer->isFinished());
+    mPauseButton->setText(transfer && transfer->state() == Transfer::Paused ? tr("Resume") : tr("Pause"));
     mDismissButton->setEnabled(transfer && transfer->isFinished());
 }
 
@@ -129,6 +134,19 @@ void TransferDialog::onStop()
     }
 }
 
+void TransferDialog::onPause()
+{
+    QModelIndex index = currentIndex();
+    if (index.isValid()) {
+        Transfer *transfer = index.data(Qt::UserRole).value<Transfer*>();
+        if (transfer->state() == Transfer::Paused) {
+            transfer->resume();
+        } else {
+            transfer->pause();
+        }
+    }
+}
+
 void TransferDialog::onDismiss()
 {
     QModelIndex index = currentIndex();
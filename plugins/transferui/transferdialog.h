@@ -51,6 +51,7 @@ private slots:
     void updateButtons();
 
     void onStop();
+    void onPause();
     void onDismiss();
     void onDismissAll();
     void onOpenReceivedFiles();
@@ -69,6 +70,7 @@ private:
     TransferProxyModel mModel;
 
     QPushButton *mStopButton;
+    QPushButton *mPauseButton;
     QPushButton *mDismissButton;
 };
 
@@ -62,6 +62,10 @@ QVariant TransferProxyModel::data(const QModelIndex &proxyIndex, int role) const
                 return transfer->error();
             case Transfer::Succeeded:
                 return tr("Succeeded");
+            case Transfer::Queued:
+                return tr("Queued");
+            case Transfer::Paused:
+                return tr("Paused");
             }
         }
         break;